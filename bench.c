@@ -0,0 +1,859 @@
+// NOTE(Alexander): benchmark for generator.h, generates a synthetic markdown corpus of a given
+// size and shape and times each stage of the pipeline separately.
+//
+// The unclosed, nesting, stars and longline shapes are adversarial inputs, they are also parsed at
+// a quarter of the size and the bench fails if parsing doesn't scale linearly or if any of their
+// section headings are lost.
+//
+// Usage: bench [-shape all|prose|lists|emphasis|links|includes|mixed|unclosed|nesting|stars|longline]
+//              [-size kilobytes] [-depth max list depth] [-iterations count] [-out results.json]
+
+#include "stdlib.h"
+#include "stdint.h"
+
+// NOTE(Alexander): counts the heap allocations made by the generator, the render_markdown_buffers
+// stage allocates on worker threads so the count is incremented atomically.
+static volatile uint64_t bench_allocation_count;
+
+#if _WIN32
+#include <windows.h>
+#define bench_count_allocation() InterlockedIncrement64((volatile LONG64*) &bench_allocation_count)
+#else
+#define bench_count_allocation() __atomic_add_fetch(&bench_allocation_count, 1, __ATOMIC_RELAXED)
+#endif
+
+static void*
+bench_malloc(size_t size) {
+    bench_count_allocation();
+    return malloc(size);
+}
+
+static void*
+bench_calloc(size_t count, size_t size) {
+    bench_count_allocation();
+    return calloc(count, size);
+}
+
+static void*
+bench_realloc(void* ptr, size_t size) {
+    bench_count_allocation();
+    return realloc(ptr, size);
+}
+
+#define malloc(size) bench_malloc(size)
+#define calloc(count, size) bench_calloc(count, size)
+#define realloc(ptr, size) bench_realloc(ptr, size)
+
+#include "generator.h"
+
+#define BENCH_CORPUS_DIR "bench_corpus"
+
+typedef enum {
+    CorpusShape_Prose,
+    CorpusShape_Lists,
+    CorpusShape_Emphasis,
+    CorpusShape_Links,
+    CorpusShape_Includes,
+    CorpusShape_Mixed,
+
+    // NOTE(Alexander): adversarial shapes, not part of mixed
+    CorpusShape_Unclosed,
+    CorpusShape_Nesting,
+    CorpusShape_Stars,
+    CorpusShape_Longline,
+
+    CorpusShape_Count,
+} Corpus_Shape;
+
+static cstring corpus_shape_names[] = {
+    "prose", "lists", "emphasis", "links", "includes", "mixed", "unclosed", "nesting", "stars", "longline"
+};
+
+// NOTE(Alexander): the parse time per byte of the full size corpus may be at most this many times
+// the time per byte of a quarter size corpus, a quadratic parser would be around 4.
+#define BENCH_MAX_PARSE_SCALING 2.0
+
+// NOTE(Alexander): approximate size of each document in the render_markdown_buffers stage
+#define BENCH_BATCH_BUFFER_SIZE ((umm) 16*1024)
+
+typedef struct {
+    Corpus_Shape shape;
+    umm size;
+    int list_depth;
+    int paragraph_lines;
+    int partial_count;
+    u32 random_state;
+} Corpus_Options;
+
+static cstring lorem_words[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipisicing", "elit", "sed", "do",
+    "eiusmod", "tempor", "incididunt", "ut", "labore", "et", "dolore", "magna", "aliqua", "enim",
+    "ad", "minim", "veniam", "quis", "nostrud", "exercitation", "ullamco", "laboris", "nisi",
+    "aliquip", "ex", "ea", "commodo", "consequat", "duis", "aute", "irure", "in", "reprehenderit",
+    "voluptate", "velit", "esse", "cillum", "fugiat", "nulla", "pariatur", "excepteur", "sint",
+};
+
+inline u32
+corpus_random(Corpus_Options* options) {
+    u32 x = options->random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    options->random_state = x;
+    return x;
+}
+
+inline cstring
+corpus_random_word(Corpus_Options* options) {
+    return lorem_words[corpus_random(options) % array_count(lorem_words)];
+}
+
+void
+corpus_push_format(String_Builder* sb, cstring format, ...) {
+    char buffer[1024];
+    va_list args;
+    va_start(args, format);
+    int count = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    string str;
+    str.data = buffer;
+    str.count = (umm) min(count, (int) sizeof(buffer) - 1);
+    string_builder_push_string(sb, str);
+}
+
+void
+corpus_push_text_line(String_Builder* sb, Corpus_Options* options, int words,
+                      int emphasis_percent, int link_percent) {
+    for (int i = 0; i < words; i++) {
+        if (i > 0) string_builder_push_cstring(sb, " ");
+
+        u32 roll = corpus_random(options) % 100;
+        cstring word = corpus_random_word(options);
+        if (roll < (u32) emphasis_percent) {
+            static cstring styles[] = { "*", "**", "***", "`" };
+            cstring style = styles[corpus_random(options) % array_count(styles)];
+            corpus_push_format(sb, "%s%s %s%s", style, word, corpus_random_word(options), style);
+        } else if (roll < (u32) (emphasis_percent + link_percent)) {
+            if (corpus_random(options) % 2) {
+                corpus_push_format(sb, "[%s %s](https://example.com/%s/%u)", word,
+                                   corpus_random_word(options), corpus_random_word(options),
+                                   corpus_random(options) % 1000);
+            } else {
+                corpus_push_format(sb, "https://example.com/%s/%u", word, corpus_random(options) % 1000);
+            }
+        } else {
+            string_builder_push_cstring(sb, word);
+        }
+    }
+    string_builder_push_cstring(sb, "\n");
+}
+
+void
+corpus_push_paragraph(String_Builder* sb, Corpus_Options* options, int emphasis_percent, int link_percent) {
+    for (int line = 0; line < options->paragraph_lines; line++) {
+        corpus_push_text_line(sb, options, 8 + corpus_random(options) % 8, emphasis_percent, link_percent);
+    }
+    string_builder_push_cstring(sb, "\n");
+}
+
+void
+corpus_push_list(String_Builder* sb, Corpus_Options* options) {
+    bool ordered = corpus_random(options) % 2;
+    int depth = 0;
+    int numbers[64] = {0};
+    int items = 8 + corpus_random(options) % 24;
+
+    for (int i = 0; i < items; i++) {
+        // NOTE(Alexander): random walk in depth, going deeper is more likely than going back
+        u32 roll = corpus_random(options) % 4;
+        if (roll < 2 && depth + 1 < options->list_depth && depth + 1 < (int) array_count(numbers)) {
+            if (i > 0) depth++;
+        } else if (roll == 3 && depth > 0) {
+            depth--;
+        }
+
+        for (int indent = 0; indent < depth*2; indent++) string_builder_push_cstring(sb, " ");
+        if (ordered) {
+            corpus_push_format(sb, "%d. ", ++numbers[depth]);
+            for (int d = depth + 1; d < (int) array_count(numbers); d++) numbers[d] = 0;
+        } else {
+            string_builder_push_cstring(sb, "* ");
+        }
+        corpus_push_text_line(sb, options, 3 + corpus_random(options) % 6, 10, 5);
+    }
+    string_builder_push_cstring(sb, "\n");
+}
+
+// NOTE(Alexander): brackets, parens and images that are never closed, a closing bracket only
+// shows up now and then so a parser that rescans for it on every open bracket is quadratic.
+void
+corpus_push_unclosed(String_Builder* sb, Corpus_Options* options) {
+    int lines = 4 + corpus_random(options) % 8;
+    for (int line = 0; line < lines; line++) {
+        int count = 8 + corpus_random(options) % 32;
+        u32 kind = corpus_random(options) % 4;
+        for (int i = 0; i < count; i++) {
+            cstring word = corpus_random_word(options);
+            switch (kind) {
+                case 0: corpus_push_format(sb, "[%s ", word); break;
+                case 1: corpus_push_format(sb, "[%s](%s ", word, corpus_random_word(options)); break;
+                case 2: corpus_push_format(sb, "![%s](%s ", word, corpus_random_word(options)); break;
+                case 3: corpus_push_format(sb, "(%s [%s ", word, corpus_random_word(options)); break;
+            }
+        }
+        string_builder_push_cstring(sb, "\n");
+    }
+
+    if (corpus_random(options) % 64 == 0) {
+        string_builder_push_cstring(sb, "] )\n");
+    }
+    string_builder_push_cstring(sb, "\n");
+}
+
+// NOTE(Alexander): a list where every item is indented one more space than the previous
+void
+corpus_push_nesting(String_Builder* sb, Corpus_Options* options) {
+    int depth = 256 + corpus_random(options) % 768;
+    for (int i = 0; i < depth; i++) {
+        for (int indent = 0; indent < i; indent++) string_builder_push_cstring(sb, " ");
+        corpus_push_format(sb, "%s %s [%s\n", i % 2 ? "-" : "*", corpus_random_word(options),
+                           corpus_random_word(options));
+    }
+    string_builder_push_cstring(sb, "\n");
+}
+
+// NOTE(Alexander): long runs of emphasis and code markers
+void
+corpus_push_stars(String_Builder* sb, Corpus_Options* options) {
+    int lines = 4 + corpus_random(options) % 8;
+    for (int line = 0; line < lines; line++) {
+        u32 kind = corpus_random(options) % 3;
+        int count = 64 + corpus_random(options) % 1024;
+        for (int i = 0; i < count; i++) {
+            switch (kind) {
+                case 0: string_builder_push_cstring(sb, "*"); break;
+                case 1: string_builder_push_cstring(sb, i % 2 ? "a" : "*"); break;
+                case 2: string_builder_push_cstring(sb, i % 3 == 0 ? "`" : i % 3 == 1 ? "**" : "b"); break;
+            }
+        }
+        string_builder_push_cstring(sb, "\n");
+    }
+    string_builder_push_cstring(sb, "\n");
+}
+
+// NOTE(Alexander): a single line as long as the rest of the corpus full of links, a parser that
+// rescans the rest of the line from every open bracket is quadratic in the length of the line.
+void
+corpus_push_long_line(String_Builder* sb, Corpus_Options* options) {
+    while (sb->curr_used < options->size) {
+        cstring word = corpus_random_word(options);
+        switch (corpus_random(options) % 3) {
+            case 0: corpus_push_format(sb, "[%s](%s) ", word, corpus_random_word(options)); break;
+            case 1: corpus_push_format(sb, "[%s] ", word); break;
+            case 2: corpus_push_format(sb, "(%s) ", word); break;
+        }
+    }
+    string_builder_push_cstring(sb, "\n\n");
+}
+
+bool
+corpus_write_partials(Corpus_Options* options) {
+    for (int i = 0; i < options->partial_count; i++) {
+        String_Builder sb;
+        zero_struct(sb);
+        corpus_push_format(&sb, "### Partial %d\n", i);
+        corpus_push_paragraph(&sb, options, 10, 5);
+
+        char filepath[256];
+        snprintf(filepath, sizeof(filepath), BENCH_CORPUS_DIR "/partial_%d.md", i);
+        bool result = write_entire_file(filepath, string_builder_to_string_nocopy(&sb));
+        string_builder_free(&sb);
+        if (!result) {
+            return false;
+        }
+    }
+    return true;
+}
+
+string
+generate_corpus(Corpus_Options* options) {
+    String_Builder sb;
+    zero_struct(sb);
+    string_builder_alloc(&sb, options->size + 4096);
+    corpus_push_format(&sb, "# Benchmark corpus: %s\n\n", corpus_shape_names[options->shape]);
+
+    int section = 0;
+    while (sb.curr_used < options->size) {
+        Corpus_Shape shape = options->shape;
+        if (shape == CorpusShape_Mixed) {
+            shape = (Corpus_Shape) (section % CorpusShape_Mixed);
+        }
+
+        if (section % 8 == 0) {
+            corpus_push_format(&sb, "## Section %d\n", section);
+        }
+
+        switch (shape) {
+            case CorpusShape_Prose: {
+                corpus_push_paragraph(&sb, options, 2, 1);
+            } break;
+
+            case CorpusShape_Lists: {
+                corpus_push_list(&sb, options);
+            } break;
+
+            case CorpusShape_Emphasis: {
+                corpus_push_paragraph(&sb, options, 60, 0);
+            } break;
+
+            case CorpusShape_Links: {
+                corpus_push_paragraph(&sb, options, 0, 40);
+            } break;
+
+            case CorpusShape_Includes: {
+                corpus_push_format(&sb, "@include \"" BENCH_CORPUS_DIR "/partial_%d.md\"\n",
+                                   (int) (corpus_random(options) % options->partial_count));
+                corpus_push_text_line(&sb, options, 6, 0, 0);
+                string_builder_push_cstring(&sb, "\n");
+            } break;
+
+            case CorpusShape_Unclosed: {
+                corpus_push_unclosed(&sb, options);
+            } break;
+
+            case CorpusShape_Nesting: {
+                corpus_push_nesting(&sb, options);
+            } break;
+
+            case CorpusShape_Stars: {
+                corpus_push_stars(&sb, options);
+            } break;
+
+            case CorpusShape_Longline: {
+                corpus_push_long_line(&sb, options);
+            } break;
+
+            default: break;
+        }
+        section++;
+    }
+
+    return string_builder_to_string_nocopy(&sb);
+}
+
+typedef struct {
+    cstring name;
+    cstring item_name;
+    u64 bytes;
+    u64 items;
+    u64 allocations;
+    u64 best_ns;
+    u64 total_ns;
+    int iterations;
+} Bench_Stage;
+
+enum {
+    BenchStage_Tokenize,
+    BenchStage_Parse,
+    BenchStage_Render,
+    BenchStage_Render_Minified,
+    BenchStage_Template,
+    BenchStage_Compact,
+    BenchStage_Render_Compact,
+    BenchStage_Batch,
+    BenchStage_Streaming,
+
+    BenchStage_Count,
+};
+
+typedef struct {
+    Corpus_Shape shape;
+    u64 source_size;
+    u64 dom_size;
+    u64 compact_dom_size;
+    f64 parse_scaling; // NOTE(Alexander): only measured for the adversarial shapes
+    Bench_Stage stages[BenchStage_Count];
+} Bench_Result;
+
+inline void
+bench_stage_begin(Bench_Stage* stage, u64* start_time, u64* start_allocations) {
+    *start_allocations = bench_allocation_count;
+    *start_time = platform_get_time_ns();
+}
+
+inline void
+bench_stage_end(Bench_Stage* stage, u64 start_time, u64 start_allocations) {
+    u64 elapsed = platform_get_time_ns() - start_time;
+    if (stage->iterations == 0 || elapsed < stage->best_ns) {
+        stage->best_ns = elapsed;
+    }
+    stage->total_ns += elapsed;
+    stage->allocations = bench_allocation_count - start_allocations;
+    stage->iterations++;
+}
+
+u64
+count_dom_nodes(Dom_Node* node) {
+    u64 result = 0;
+    for (; node; node = node->next) {
+        result++;
+        switch (node->type) {
+            case Dom_Paragraph: result += count_dom_nodes(node->paragraph.seq.first); break;
+            case Dom_Unordered_List: result += count_dom_nodes(node->unordered_list.seq.first); break;
+            case Dom_Ordered_List: result += count_dom_nodes(node->ordered_list.seq.first); break;
+            case Dom_List_Item: result += count_dom_nodes(node->list_item.seq.first); break;
+            case Dom_Include: result += count_dom_nodes(node->include.seq.first); break;
+            default: break;
+        }
+    }
+    return result;
+}
+
+u64
+count_dom_headings(Dom_Node* node) {
+    u64 result = 0;
+    for (; node; node = node->next) {
+        switch (node->type) {
+            case Dom_Heading: result++; break;
+            case Dom_Paragraph: result += count_dom_headings(node->paragraph.seq.first); break;
+            case Dom_Unordered_List: result += count_dom_headings(node->unordered_list.seq.first); break;
+            case Dom_Ordered_List: result += count_dom_headings(node->ordered_list.seq.first); break;
+            case Dom_List_Item: result += count_dom_headings(node->list_item.seq.first); break;
+            case Dom_Include: result += count_dom_headings(node->include.seq.first); break;
+            default: break;
+        }
+    }
+    return result;
+}
+
+// NOTE(Alexander): every line starting with # in the adversarial corpora is a section heading,
+// they all have to survive the unclosed brackets and emphasis in the sections before them.
+bool
+check_corpus_headings(cstring filepath) {
+    Mapped_File file = map_entire_file(filepath);
+    u64 expected = 0;
+    for (umm i = 0; i < file.contents.count; i++) {
+        if (file.contents.data[i] == '#' && (i == 0 || file.contents.data[i - 1] == '\n')) {
+            expected++;
+        }
+    }
+    unmap_file(&file);
+
+    Memory_Arena arena;
+    zero_struct(arena);
+    Dom dom = read_markdown_file_ex(filepath, &arena);
+    u64 headings = count_dom_headings(dom.seq.first);
+    free_dom_sources(&dom);
+    arena_clear(&arena);
+
+    if (headings != expected) {
+        printf("Parsed %llu of the %llu headings in `%s`!\n", (unsigned long long) headings,
+               (unsigned long long) expected, filepath);
+        return false;
+    }
+    return true;
+}
+
+// NOTE(Alexander): the generator prints its diagnostics to stdout, they're redirected into a temporary
+// file so the diagnostics of two stages can be compared.
+typedef struct {
+    FILE* file;
+    int saved_stdout;
+} Bench_Capture;
+
+void
+bench_capture_begin(Bench_Capture* capture) {
+    fflush(stdout);
+    capture->file = tmpfile();
+    capture->saved_stdout = -1;
+    if (capture->file) {
+        capture->saved_stdout = dup(fileno(stdout));
+        dup2(fileno(capture->file), fileno(stdout));
+    }
+}
+
+string
+bench_capture_end(Bench_Capture* capture) {
+    string result;
+    zero_struct(result);
+    fflush(stdout);
+    if (!capture->file) {
+        return result;
+    }
+
+    dup2(capture->saved_stdout, fileno(stdout));
+    close(capture->saved_stdout);
+    fseek(capture->file, 0, SEEK_END);
+    long size = ftell(capture->file);
+    rewind(capture->file);
+    if (size > 0) {
+        result.data = (char*) malloc(size);
+        result.count = fread(result.data, 1, size, capture->file);
+    }
+    fclose(capture->file);
+    return result;
+}
+
+void
+run_benchmark(Bench_Result* result, cstring filepath, string template_source, int iterations) {
+    Bench_Stage* stages = result->stages;
+    stages[BenchStage_Tokenize].name = "tokenize";
+    stages[BenchStage_Tokenize].item_name = "tokens";
+    stages[BenchStage_Parse].name = "read_markdown_file_ex";
+    stages[BenchStage_Parse].item_name = "nodes";
+    stages[BenchStage_Render].name = "generate_html_from_dom";
+    stages[BenchStage_Render].item_name = "nodes";
+    stages[BenchStage_Render_Minified].name = "generate_html_from_dom_ex";
+    stages[BenchStage_Render_Minified].item_name = "nodes";
+    stages[BenchStage_Template].name = "template_process_string_ex";
+    stages[BenchStage_Template].item_name = "bytes";
+    stages[BenchStage_Compact].name = "compact_dom_from_dom";
+    stages[BenchStage_Compact].item_name = "nodes";
+    stages[BenchStage_Render_Compact].name = "generate_html_from_compact_dom";
+    stages[BenchStage_Render_Compact].item_name = "nodes";
+    stages[BenchStage_Batch].name = "render_markdown_buffers";
+    stages[BenchStage_Batch].item_name = "buffers";
+    stages[BenchStage_Streaming].name = "render_markdown_file_streaming";
+    stages[BenchStage_Streaming].item_name = "bytes";
+
+    Memory_Arena arena;
+    zero_struct(arena);
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        u64 start_time, start_allocations;
+
+        Mapped_File file = map_entire_file(filepath);
+        result->source_size = file.contents.count;
+
+        Bench_Stage* stage = &stages[BenchStage_Tokenize];
+        bench_stage_begin(stage, &start_time, &start_allocations);
+        Tokenizer tokenizer;
+        zero_struct(tokenizer);
+        tokenizer.base = file.contents.data;
+        tokenizer.curr = tokenizer.base;
+        tokenizer.end = tokenizer.base + file.contents.count;
+        u64 token_count = 0;
+        while (next_token(&tokenizer).symbol) {
+            token_count++;
+        }
+        bench_stage_end(stage, start_time, start_allocations);
+        stage->bytes = file.contents.count;
+        stage->items = token_count;
+        unmap_file(&file);
+
+        stage = &stages[BenchStage_Parse];
+        Bench_Capture capture;
+        bench_capture_begin(&capture);
+        bench_stage_begin(stage, &start_time, &start_allocations);
+        Dom dom = read_markdown_file_ex(filepath, &arena);
+        bench_stage_end(stage, start_time, start_allocations);
+        string diagnostics = bench_capture_end(&capture);
+        u64 node_count = count_dom_nodes(dom.seq.first);
+        stage->bytes = result->source_size;
+        stage->items = node_count;
+
+        stage = &stages[BenchStage_Render];
+        bench_stage_begin(stage, &start_time, &start_allocations);
+        string html = generate_html_from_dom(&dom);
+        bench_stage_end(stage, start_time, start_allocations);
+        stage->bytes = html.count;
+        stage->items = node_count;
+
+        // NOTE(Alexander): bytes is the size of the minified html, compare with the pretty printed
+        stage = &stages[BenchStage_Render_Minified];
+        bench_stage_begin(stage, &start_time, &start_allocations);
+        string minified_html = generate_html_from_dom_ex(&dom, true);
+        bench_stage_end(stage, start_time, start_allocations);
+        stage->bytes = minified_html.count;
+        stage->items = node_count;
+        free(minified_html.data);
+
+        string args[3];
+        args[0] = string_lit("assets/style.css");
+        args[1] = string_lit("assets/script.js");
+        args[2] = html;
+
+        string names[3];
+        names[0] = string_lit("stylesheet");
+        names[1] = string_lit("script");
+        names[2] = string_lit("content");
+
+        stage = &stages[BenchStage_Template];
+        bench_stage_begin(stage, &start_time, &start_allocations);
+        string page = template_process_string_ex(template_source, array_count(args), args, names);
+        bench_stage_end(stage, start_time, start_allocations);
+        stage->bytes = page.count;
+        stage->items = page.count;
+
+        stage = &stages[BenchStage_Compact];
+        Temporary_Memory compact_memory = begin_temporary_memory(&arena);
+        bench_stage_begin(stage, &start_time, &start_allocations);
+        Compact_Dom compact_dom = compact_dom_from_dom(&dom, &arena);
+        bench_stage_end(stage, start_time, start_allocations);
+        stage->bytes = result->source_size;
+        stage->items = compact_dom.node_count;
+        result->dom_size = node_count*sizeof(Dom_Node);
+        result->compact_dom_size = compact_dom.node_count*sizeof(Compact_Dom_Node) + compact_dom.extra.count;
+
+        stage = &stages[BenchStage_Render_Compact];
+        bench_stage_begin(stage, &start_time, &start_allocations);
+        string compact_html = generate_html_from_compact_dom(&compact_dom);
+        bench_stage_end(stage, start_time, start_allocations);
+        stage->bytes = compact_html.count;
+        stage->items = compact_dom.node_count;
+        if (html.count != compact_html.count || memcmp(html.data, compact_html.data, html.count) != 0) {
+            printf("Compact dom html differs from the dom html for `%s`!\n", filepath);
+        }
+        end_temporary_memory(compact_memory);
+
+        // NOTE(Alexander): the corpus split at blank lines into documents, like a batch from a database
+        stage = &stages[BenchStage_Batch];
+        file = map_entire_file(filepath);
+        int buffer_count = 0;
+        string* buffers = (string*) malloc((file.contents.count / BENCH_BATCH_BUFFER_SIZE + 1)*sizeof(string));
+        for (char* curr = file.contents.data, *end = curr + file.contents.count; curr < end;) {
+            char* split = curr + min((umm) (end - curr), BENCH_BATCH_BUFFER_SIZE);
+            while (split < end && !(split[-1] == '\n' && split[0] == '\n')) split++;
+            buffers[buffer_count].data = curr;
+            buffers[buffer_count].count = split - curr;
+            buffer_count++;
+            curr = split;
+        }
+        string* batch_html = (string*) calloc(max(buffer_count, 1), sizeof(string));
+        bench_stage_begin(stage, &start_time, &start_allocations);
+        render_markdown_buffers(buffers, batch_html, buffer_count, 0, false);
+        bench_stage_end(stage, start_time, start_allocations);
+        stage->bytes = result->source_size;
+        stage->items = buffer_count;
+        for (int i = 0; i < buffer_count; i++) {
+            free(batch_html[i].data);
+        }
+        free(batch_html);
+        free(buffers);
+        unmap_file(&file);
+
+        stage = &stages[BenchStage_Streaming];
+        Memory_Arena stream_arena;
+        zero_struct(stream_arena);
+        Output_Sink stream_sink = output_sink_arena(&stream_arena);
+        bench_capture_begin(&capture);
+        bench_stage_begin(stage, &start_time, &start_allocations);
+        render_markdown_file_streaming(filepath, &stream_sink);
+        bench_stage_end(stage, start_time, start_allocations);
+        string stream_diagnostics = bench_capture_end(&capture);
+        string stream_html = convert_memory_arena_to_string(&stream_arena);
+        stage->bytes = result->source_size;
+        stage->items = result->source_size;
+        if (html.count != stream_html.count || memcmp(html.data, stream_html.data, html.count) != 0) {
+            printf("Streamed html differs from the dom html for `%s`!\n", filepath);
+        }
+        if (!string_equals(diagnostics, stream_diagnostics)) {
+            printf("Streamed diagnostics differ from the dom diagnostics for `%s`:\n%.*s", filepath,
+                   (int) min(stream_diagnostics.count, (umm) 1024), stream_diagnostics.data);
+        }
+        free(stream_diagnostics.data);
+        free(diagnostics.data);
+        free(stream_html.data);
+        arena_clear(&stream_arena);
+
+        free(compact_html.data);
+        free(page.data);
+        free(html.data);
+        free_dom_sources(&dom);
+        arena_reset(&arena);
+    }
+
+    arena_clear(&arena);
+}
+
+// NOTE(Alexander): parses a quarter size corpus of the same shape and compares the time per byte
+// with the full size corpus that was already benchmarked.
+f64
+measure_parse_scaling(Bench_Result* result, Corpus_Options options, int iterations) {
+    options.size /= 4;
+    options.random_state = 0x9e3779b9u + options.shape;
+    string corpus = generate_corpus(&options);
+
+    char filepath[256];
+    snprintf(filepath, sizeof(filepath), BENCH_CORPUS_DIR "/%s_quarter.md", corpus_shape_names[options.shape]);
+    bool written = write_entire_file(filepath, corpus);
+    free(corpus.data);
+    if (!written) {
+        return 0.0;
+    }
+
+    Memory_Arena arena;
+    zero_struct(arena);
+    u64 best_ns = 0;
+    u64 source_size = 0;
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        u64 start_time = platform_get_time_ns();
+        Dom dom = read_markdown_file_ex(filepath, &arena);
+        u64 elapsed = platform_get_time_ns() - start_time;
+        if (iteration == 0 || elapsed < best_ns) {
+            best_ns = elapsed;
+        }
+        source_size = dom.sources ? dom.sources->file.contents.count : 0;
+        free_dom_sources(&dom);
+        arena_reset(&arena);
+    }
+    arena_clear(&arena);
+
+    Bench_Stage* parse = &result->stages[BenchStage_Parse];
+    if (best_ns == 0 || source_size == 0 || result->source_size == 0) {
+        return 0.0;
+    }
+    return ((f64) parse->best_ns / (f64) result->source_size) / ((f64) best_ns / (f64) source_size);
+}
+
+inline f64
+bench_per_second(u64 count, u64 ns) {
+    return ns > 0 ? (f64) count * 1e9 / (f64) ns : 0.0;
+}
+
+void
+print_bench_result(Bench_Result* result) {
+    printf("\n%s (%.2f MB, dom %.2f MB, compact dom %.2f MB)\n", corpus_shape_names[result->shape],
+           (f64) result->source_size / 1e6, (f64) result->dom_size / 1e6, (f64) result->compact_dom_size / 1e6);
+    printf("  %-24s %10s %10s %10s %16s %12s\n", "stage", "best ms", "mean ms", "MB/s", "items/s", "allocs");
+    for (int i = 0; i < BenchStage_Count; i++) {
+        Bench_Stage* stage = &result->stages[i];
+        char items[64];
+        snprintf(items, sizeof(items), "%.2fM %s", bench_per_second(stage->items, stage->best_ns) / 1e6,
+                 stage->item_name);
+        printf("  %-24s %10.3f %10.3f %10.1f %16s %12llu\n", stage->name,
+               (f64) stage->best_ns / 1e6, (f64) stage->total_ns / 1e6 / stage->iterations,
+               bench_per_second(stage->bytes, stage->best_ns) / 1e6, items,
+               (unsigned long long) stage->allocations);
+    }
+
+    if (result->parse_scaling > 0.0) {
+        printf("  parse time per byte at 4x the size: %.2fx (max %.2fx)\n", 
+               result->parse_scaling, BENCH_MAX_PARSE_SCALING);
+    }
+}
+
+bool
+write_bench_results(cstring filepath, Bench_Result* results, int count, Corpus_Options* options) {
+    FILE* file = fopen(filepath, "wb");
+    if (!file) {
+        printf("Failed to open `%s` for writing!\n", filepath);
+        return false;
+    }
+
+    fprintf(file, "{\n  \"version\": 1,\n  \"size\": %llu,\n  \"list_depth\": %d,\n  \"results\": [\n",
+            (unsigned long long) options->size, options->list_depth);
+    for (int i = 0; i < count; i++) {
+        Bench_Result* result = &results[i];
+        fprintf(file, "    {\n      \"shape\": \"%s\",\n      \"source_bytes\": %llu,\n      \"dom_bytes\": %llu,\n"
+                "      \"compact_dom_bytes\": %llu,\n      \"parse_scaling\": %.3f,\n      \"stages\": [\n",
+                corpus_shape_names[result->shape], (unsigned long long) result->source_size,
+                (unsigned long long) result->dom_size, (unsigned long long) result->compact_dom_size,
+                result->parse_scaling);
+        for (int j = 0; j < BenchStage_Count; j++) {
+            Bench_Stage* stage = &result->stages[j];
+            fprintf(file, "        { \"stage\": \"%s\", \"iterations\": %d, \"best_ns\": %llu, \"mean_ns\": %llu, "
+                    "\"bytes\": %llu, \"mb_per_second\": %.3f, \"%s\": %llu, \"%s_per_second\": %.1f, "
+                    "\"allocations\": %llu }%s\n",
+                    stage->name, stage->iterations, (unsigned long long) stage->best_ns,
+                    (unsigned long long) (stage->total_ns / stage->iterations),
+                    (unsigned long long) stage->bytes, bench_per_second(stage->bytes, stage->best_ns) / 1e6,
+                    stage->item_name, (unsigned long long) stage->items,
+                    stage->item_name, bench_per_second(stage->items, stage->best_ns),
+                    (unsigned long long) stage->allocations, j + 1 < BenchStage_Count ? "," : "");
+        }
+        fprintf(file, "      ]\n    }%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+int
+main(int argc, char* argv[]) {
+    Corpus_Options options;
+    zero_struct(options);
+    options.size = 4*1024*1024;
+    options.list_depth = 8;
+    options.paragraph_lines = 6;
+    options.partial_count = 32;
+
+    int shape = -1; // NOTE(Alexander): all shapes
+    int iterations = 5;
+    cstring output_path = "bench_results.json";
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        cstring option = argv[i];
+        cstring value = argv[i + 1];
+        if (strcmp(option, "-shape") == 0) {
+            for (int j = 0; j < CorpusShape_Count; j++) {
+                if (strcmp(value, corpus_shape_names[j]) == 0) shape = j;
+            }
+        } else if (strcmp(option, "-size") == 0) {
+            options.size = (umm) atoi(value) * 1024;
+        } else if (strcmp(option, "-depth") == 0) {
+            options.list_depth = max(atoi(value), 1);
+        } else if (strcmp(option, "-iterations") == 0) {
+            iterations = max(atoi(value), 1);
+        } else if (strcmp(option, "-out") == 0) {
+            output_path = value;
+        } else {
+            printf("Unknown option `%s`\n", option);
+            return 1;
+        }
+    }
+
+    Mapped_File template_file = map_entire_file("base_template.html");
+    string template_source = template_file.contents;
+    if (!template_source.data) {
+        template_source = string_lit("<html><head><link href=\"${stylesheet}\"></head><body>${content}<script src=\"${script}\"></script></body></html>");
+    }
+
+    platform_create_parent_directories(BENCH_CORPUS_DIR "/");
+    if (!corpus_write_partials(&options)) {
+        return 1;
+    }
+
+    Bench_Result results[CorpusShape_Count];
+    zero_struct(results);
+    int result_count = 0;
+    bool failed = false;
+
+    for (int i = 0; i < CorpusShape_Count; i++) {
+        if (shape >= 0 && shape != i) continue;
+
+        options.shape = (Corpus_Shape) i;
+        options.random_state = 0x9e3779b9u + i;
+        string corpus = generate_corpus(&options);
+
+        char filepath[256];
+        snprintf(filepath, sizeof(filepath), BENCH_CORPUS_DIR "/%s.md", corpus_shape_names[i]);
+        bool written = write_entire_file(filepath, corpus);
+        free(corpus.data);
+        if (!written) {
+            return 1;
+        }
+
+        Bench_Result* result = &results[result_count++];
+        result->shape = options.shape;
+        run_benchmark(result, filepath, template_source, iterations);
+        if (options.shape > CorpusShape_Mixed) {
+            if (!check_corpus_headings(filepath)) {
+                failed = true;
+            }
+            result->parse_scaling = measure_parse_scaling(result, options, iterations);
+            if (result->parse_scaling > BENCH_MAX_PARSE_SCALING) {
+                printf("Parsing `%s` doesn't scale linearly!\n", filepath);
+                failed = true;
+            }
+        }
+        print_bench_result(result);
+    }
+
+    include_cache_clear();
+    highlight_cache_clear();
+    unmap_file(&template_file);
+    bool written = write_bench_results(output_path, results, result_count, &options);
+    return written && !failed ? 0 : 1;
+}
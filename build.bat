@@ -16,5 +16,6 @@ set linker_flags=-incremental:no -opt:ref -OUT:generator.exe
 
 rem Compile
 cl %compiler_flags% ../demo.c -link %linker_flags%
+cl %compiler_flags% -O2 ../bench.c -link -incremental:no -opt:ref -OUT:bench.exe
 
 popd
\ No newline at end of file
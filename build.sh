@@ -1,7 +1,10 @@
 #!/bin/bash
 
 code="$PWD"
-opts=-g
+opts="-g -std=gnu99 -fgnu89-inline -pthread"
+mkdir -p build
 cd build > /dev/null
-g++ $opts $code/build.bat -o generator.exe
+gcc $opts $code/demo.c -o generator
+gcc $opts -O2 $code/bench.c -o bench
+gcc $opts -O2 -DGENERATOR_PROFILE=1 $code/demo.c -o generator_profile
 cd $code > /dev/null
@@ -11,9 +11,92 @@ typedef union {
     
 } Template_Parameters;
 
+// NOTE(Alexander): names of the Template_Parameters used by ${name} placeholders in the template
+static cstring template_parameter_names[] = { "stylesheet", "script", "content" };
+
+void
+init_template_parameter_names(Template_Parameters* names) {
+    for (int i = 0; i < (int) array_count(names->data); i++) {
+        names->data[i] = string_lit(template_parameter_names[i]);
+    }
+}
+
 
 int
 main(int argc, char* argv[]) {
+    if (argc >= 3) {
+        // NOTE(Alexander): build an entire site, e.g. generator content public [manifest | -watch | -serve port]
+        // [-gzip] [-hardlink | -reflink] [-fingerprint] [-minify] [-if-changed] [-search]
+        Template_Parameters params;
+        params.stylesheet_path = string_lit("/assets/style.css");
+        params.script_path = string_lit("/assets/script.js");
+        zero_struct(params.content);
+        
+        Template_Parameters names;
+        init_template_parameter_names(&names);
+        
+        Site_Config config;
+        zero_struct(config);
+        config.source_dir = argv[1];
+        config.output_dir = argv[2];
+        config.template_args = params.data;
+        config.template_arg_names = names.data;
+        config.template_argc = array_count(params.data);
+        config.content_arg_index = 2;
+        
+        for (; argc > 3 && argv[argc - 1][0] == '-'; argc--) {
+            cstring option = argv[argc - 1];
+            if (strcmp(option, "-gzip") == 0) {
+                config.precompress = true;
+            } else if (strcmp(option, "-hardlink") == 0) {
+                config.asset_copy_mode = FileCopy_Hardlink;
+            } else if (strcmp(option, "-reflink") == 0) {
+                config.asset_copy_mode = FileCopy_Reflink;
+            } else if (strcmp(option, "-fingerprint") == 0) {
+                config.fingerprint_assets = true;
+            } else if (strcmp(option, "-minify") == 0) {
+                config.minify_html = true;
+            } else if (strcmp(option, "-if-changed") == 0) {
+                config.write_if_changed = true;
+            } else if (strcmp(option, "-search") == 0) {
+                config.search_index = true;
+            } else {
+                break;
+            }
+        }
+        
+        if (argc >= 4 && strcmp(argv[3], "-watch") == 0) {
+            return watch_site(&config, "base_template.html", 0) ? 0 : 1;
+        }
+        
+        if (argc >= 4 && strcmp(argv[3], "-serve") == 0) {
+            // NOTE(Alexander): preview on localhost, rebuilt pages are served from memory
+            Preview_Server server;
+            if (!preview_server_start(&server, config.output_dir, argc >= 5 ? atoi(argv[4]) : 8000)) {
+                return 1;
+            }
+            config.page_callback = preview_server_page_callback;
+            config.page_callback_data = &server;
+            bool result = watch_site(&config, "base_template.html", 0);
+            preview_server_stop(&server);
+            return result ? 0 : 1;
+        }
+        
+        config.template_path = "base_template.html";
+        config.manifest_path = argc >= 4 ? argv[3] : 0;
+        
+        Site_Build_Stats stats = build_site(&config);
+        printf("Built %u pages and copied %u assets, %u skipped, %u unchanged, %u written, %u compressed, %u failed\n", 
+               stats.page_count, stats.asset_count, stats.skipped_count, stats.unchanged_count, 
+               stats.written_count, stats.compressed_count, stats.failed_count);
+        
+#if GENERATOR_PROFILE
+        profile_write_summary("profile.json");
+        profile_write_chrome_trace("trace.json");
+#endif
+        return stats.failed_count > 0;
+    }
+    
     char* filename = "hello_world.md";
     Dom dom = read_markdown_file(filename);
     string html = generate_html_from_dom(&dom);
@@ -24,8 +107,12 @@ main(int argc, char* argv[]) {
     params.script_path = string_lit("assets/script.js");
     params.content = html;
     
-    string template_html = read_entire_file("base_template.html");
-    string result = template_process_string(template_html, array_count(params.data), params.data);
+    Template_Parameters names;
+    init_template_parameter_names(&names);
+    
+    Mapped_File template_file = map_entire_file("base_template.html");
+    string result = template_process_string_ex(template_file.contents, array_count(params.data), 
+                                               params.data, names.data);
     printf("Generated:\n%.*s\n", (int) result.count, result.data);
     write_entire_file("generated.html", result);
 }
\ No newline at end of file
@@ -4,10 +4,51 @@
 #include "stdio.h"
 #include "stdlib.h"
 #include "stdint.h"
+#include "string.h"
+#include "stdarg.h"
+
+#if _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#if __linux__
+#include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#endif
+#endif
 
 #define array_count(array) (sizeof(array) / sizeof((array)[0]))
 #define zero_struct(s) (memset(&s, 0, sizeof(s)))
 
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
 #if BUILD_DEBUG
 void
 __assert(const char* expression, const char* file, int line) {
@@ -95,6 +136,164 @@ string_equals(string a, string b) {
     return string_compare(a, b) == 0;
 }
 
+// NOTE(Alexander): stronger 64-bit hash for file contents, processes 8 bytes at a time
+// and can be computed incrementally, used to detect if files have changed between builds.
+#define CONTENT_HASH_MULTIPLIER 0xc6a4a7935bd1e995ull
+
+typedef struct {
+    u64 hash;
+    u64 count;
+    u8 tail[8];
+    u32 tail_count;
+} Content_Hash;
+
+inline u64
+content_hash_mix(u64 hash, u64 k) {
+    k *= CONTENT_HASH_MULTIPLIER;
+    k ^= k >> 47;
+    k *= CONTENT_HASH_MULTIPLIER;
+    hash ^= k;
+    hash *= CONTENT_HASH_MULTIPLIER;
+    return hash;
+}
+
+inline void
+content_hash_begin(Content_Hash* state) {
+    zero_struct(*state);
+    state->hash = 0x9e3779b97f4a7c15ull;
+}
+
+void
+content_hash_update(Content_Hash* state, void* data, umm count) {
+    u8* curr = (u8*) data;
+    u8* end = curr + count;
+    state->count += count;
+    
+    if (state->tail_count > 0) {
+        while (curr < end && state->tail_count < 8) {
+            state->tail[state->tail_count++] = *curr++;
+        }
+        if (state->tail_count < 8) {
+            return;
+        }
+        
+        u64 k;
+        memcpy(&k, state->tail, 8);
+        state->hash = content_hash_mix(state->hash, k);
+        state->tail_count = 0;
+    }
+    
+    while (end - curr >= 8) {
+        u64 k;
+        memcpy(&k, curr, 8);
+        state->hash = content_hash_mix(state->hash, k);
+        curr += 8;
+    }
+    
+    while (curr < end) {
+        state->tail[state->tail_count++] = *curr++;
+    }
+}
+
+u64
+content_hash_end(Content_Hash* state) {
+    u64 hash = state->hash;
+    if (state->tail_count > 0) {
+        u64 k = 0;
+        memcpy(&k, state->tail, state->tail_count);
+        hash = content_hash_mix(hash, k);
+    }
+    
+    hash = content_hash_mix(hash, state->count);
+    hash ^= hash >> 47;
+    hash *= CONTENT_HASH_MULTIPLIER;
+    hash ^= hash >> 47;
+    return hash;
+}
+
+u64
+string_content_hash(string str) {
+    Content_Hash state;
+    content_hash_begin(&state);
+    content_hash_update(&state, str.data, str.count);
+    return content_hash_end(&state);
+}
+
+// NOTE(Alexander): open addressing hash map from string to pointer, using string_hash.
+// The keys are not copied so they have to outlive the map.
+typedef struct {
+    string key;
+    u64 hash;
+    void* value;
+} String_Map_Entry;
+
+typedef struct {
+    String_Map_Entry* entries;
+    u32 count;
+    u32 capacity; // NOTE(Alexander): always power of two
+} String_Map;
+
+inline bool
+string_map_key_equals(String_Map_Entry* entry, string key, u64 hash) {
+    return entry->hash == hash && entry->key.count == key.count && 
+        memcmp(entry->key.data, key.data, key.count) == 0;
+}
+
+String_Map_Entry*
+string_map_find_entry(String_Map* map, string key, u64 hash) {
+    u32 mask = map->capacity - 1;
+    for (u32 i = (u32) hash & mask;; i = (i + 1) & mask) {
+        String_Map_Entry* entry = &map->entries[i];
+        if (!entry->key.data || string_map_key_equals(entry, key, hash)) {
+            return entry;
+        }
+    }
+}
+
+void*
+string_map_get(String_Map* map, string key) {
+    if (map->count == 0) {
+        return 0;
+    }
+    
+    String_Map_Entry* entry = string_map_find_entry(map, key, string_hash(key));
+    return entry->key.data ? entry->value : 0;
+}
+
+void
+string_map_put(String_Map* map, string key, void* value) {
+    if ((map->count + 1)*4 > map->capacity*3) {
+        String_Map old_map = *map;
+        map->capacity = map->capacity ? map->capacity * 2 : 64;
+        map->entries = (String_Map_Entry*) calloc(map->capacity, sizeof(String_Map_Entry));
+        map->count = 0;
+        
+        for (u32 i = 0; i < old_map.capacity; i++) {
+            String_Map_Entry* entry = &old_map.entries[i];
+            if (entry->key.data) {
+                *string_map_find_entry(map, entry->key, entry->hash) = *entry;
+                map->count++;
+            }
+        }
+        free(old_map.entries);
+    }
+    
+    u64 hash = string_hash(key);
+    String_Map_Entry* entry = string_map_find_entry(map, key, hash);
+    if (!entry->key.data) {
+        entry->key = key;
+        entry->hash = hash;
+        map->count++;
+    }
+    entry->value = value;
+}
+
+inline void
+string_map_free(String_Map* map) {
+    free(map->entries);
+    zero_struct(*map);
+}
+
 typedef struct {
     char* data;
     umm size;
@@ -160,938 +359,8188 @@ string_builder_to_string_nocopy(String_Builder* sb) {
     return result;
 }
 
-string
-read_entire_file(cstring filepath) {
-    string result;
-    zero_struct(result);
-    
-    FILE* file;
-    fopen_s(&file, filepath, "rb");
-    if (!file) {
-        printf("File `%s` was not found!", filepath);
-        return result;
-    }
-    
-    fseek(file, 0, SEEK_END);
-    umm file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    
-    result.data = malloc(file_size);
-    result.count = file_size;
-    fread(result.data, result.count, 1, file);
-    fclose(file);
-    return result;
-}
+// NOTE(Alexander): minimal platform layer, threads, mutexes, atomics and directories
+#if _WIN32
+typedef HANDLE Thread;
+typedef SRWLOCK Mutex;
+#define MUTEX_INITIALIZER SRWLOCK_INIT
+#else
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+#define MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#endif
 
-bool
-write_entire_file(cstring filepath, string contents) {
-    FILE* file = fopen(filepath, "wb+");
-    if (!file) {
-        printf("Failed to open `%s` for writing!\n", filepath);
-        return false;
-    }
-    fwrite(contents.data, contents.count, 1, file);
-    fclose(file);
-    
-    return true;
+typedef void Thread_Proc(void* data);
+
+typedef struct {
+    Thread_Proc* proc;
+    void* data;
+} Thread_Startup;
+
+#if _WIN32
+DWORD WINAPI
+win32_thread_proc(LPVOID param) {
+    Thread_Startup startup = *(Thread_Startup*) param;
+    free(param);
+    startup.proc(startup.data);
+    return 0;
+}
+#else
+void*
+posix_thread_proc(void* param) {
+    Thread_Startup startup = *(Thread_Startup*) param;
+    free(param);
+    startup.proc(startup.data);
+    return 0;
 }
+#endif
 
-// TODO(Alexander): OS probably has a better option 
 bool
-copy_file(cstring src_filepath, cstring dst_filepath) {
-    string contents = read_entire_file(src_filepath);
-    if (!contents.data) {
-        return false;
+platform_create_thread(Thread* thread, Thread_Proc* proc, void* data) {
+    Thread_Startup* startup = (Thread_Startup*) malloc(sizeof(Thread_Startup));
+    startup->proc = proc;
+    startup->data = data;
+#if _WIN32
+    *thread = CreateThread(0, 0, win32_thread_proc, startup, 0, 0);
+    bool result = *thread != 0;
+#else
+    bool result = pthread_create(thread, 0, posix_thread_proc, startup) == 0;
+#endif
+    if (!result) {
+        free(startup);
     }
-    bool result = write_entire_file(dst_filepath, contents);
-    free(contents.data);
     return result;
 }
 
-typedef struct {
-    string text;
-    char symbol;
-    int number;
-    bool whitespace;
-    bool new_line;
-} Token;
+void
+platform_join_thread(Thread* thread) {
+#if _WIN32
+    WaitForSingleObject(*thread, INFINITE);
+    CloseHandle(*thread);
+#else
+    pthread_join(*thread, 0);
+#endif
+}
 
-typedef struct {
-    char* base;
-    char* curr;
-    char* end;
-    Token peeked;
-} Tokenizer;
+inline void
+platform_yield_thread(void) {
+#if _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
 
-inline bool 
-is_digit(char c) {
-    return c >= '0' && c <= '9';
+int
+platform_processor_count(void) {
+#if _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int result = (int) info.dwNumberOfProcessors;
+#else
+    int result = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return result > 0 ? result : 1;
 }
 
-inline bool
-is_end_of_line(char c) {
-    return c == '\n' || c == '\r';
+// NOTE(Alexander): monotonic wall clock in nanoseconds
+u64
+platform_get_time_ns(void) {
+#if _WIN32
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    u64 seconds = (u64) (counter.QuadPart / frequency.QuadPart);
+    u64 remainder = (u64) (counter.QuadPart % frequency.QuadPart);
+    return seconds*1000000000ull + remainder*1000000000ull / (u64) frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64) ts.tv_sec*1000000000ull + (u64) ts.tv_nsec;
+#endif
 }
 
-inline bool
-is_whitespace(char c) {
-    return c == ' ' || c == '\t' || c == '\v' || c == '\f' || is_end_of_line(c);
+inline void
+mutex_init(Mutex* mutex) {
+#if _WIN32
+    InitializeSRWLock(mutex);
+#else
+    pthread_mutex_init(mutex, 0);
+#endif
 }
 
-inline bool
-is_whitespace_no_new_line(char c) {
-    return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+inline void
+mutex_destroy(Mutex* mutex) {
+#if !_WIN32
+    pthread_mutex_destroy(mutex);
+#endif
 }
 
-inline bool
-is_special_character(char c) {
-    return c == '*'
-        || c == '#'
-        || c == '$'
-        || c == '@'
-        || c == ':'
-        || c == '/'
-        || c == '"'
-        || c == '`'
-        || c == '.'
-        || c == ','
-        || c == '_'
-        || c == '+'
-        || c == '-'
-        || c == '[' 
-        || c == ']'
-        || c == '('
-        || c == ')'
-        || c == '{'
-        || c == '}'
-        || c == '<'
-        || c == '>';
+inline void
+mutex_lock(Mutex* mutex) {
+#if _WIN32
+    AcquireSRWLockExclusive(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
 }
 
-Token
-next_token(Tokenizer* t) {
-    Token result;
-    
-    if (t->peeked.symbol) {
-        result = t->peeked;
-        t->peeked.symbol = 0;
-        return result;
+inline void
+mutex_unlock(Mutex* mutex) {
+#if _WIN32
+    ReleaseSRWLockExclusive(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+// NOTE(Alexander): atomics return the new value
+#if _WIN32
+#define atomic_add_u32(dest, value) ((u32) InterlockedAdd((volatile LONG*) (dest), (LONG) (value)))
+#define atomic_load_u32(dest) ((u32) InterlockedOr((volatile LONG*) (dest), 0))
+// NOTE(Alexander): aligned pointer loads are atomic and volatile loads have acquire semantics with msvc
+#define atomic_load_pointer(dest) ((void*) *(void* volatile*) (dest))
+#define atomic_store_pointer(dest, value) InterlockedExchangePointer((void* volatile*) (dest), (void*) (value))
+#else
+#define atomic_add_u32(dest, value) __atomic_add_fetch((dest), (value), __ATOMIC_SEQ_CST)
+#define atomic_load_u32(dest) __atomic_load_n((dest), __ATOMIC_SEQ_CST)
+#define atomic_load_pointer(dest) ((void*) __atomic_load_n((dest), __ATOMIC_ACQUIRE))
+#define atomic_store_pointer(dest, value) __atomic_store_n((dest), (value), __ATOMIC_RELEASE)
+#endif
+
+// NOTE(Alexander): writes str as a quoted and escaped json string
+void
+write_json_string(FILE* file, cstring str) {
+    fputc('"', file);
+    for (; *str; str++) {
+        char c = *str;
+        if (c == '"' || c == '\\') {
+            fputc('\\', file);
+            fputc(c, file);
+        } else if ((u8) c < 0x20) {
+            fprintf(file, "\\u%04x", (u8) c);
+        } else {
+            fputc(c, file);
+        }
     }
+    fputc('"', file);
+}
+
+// NOTE(Alexander): optional build instrumentation, define GENERATOR_PROFILE before including
+// generator.h to enable it, otherwise the PROFILE_ macros expand to nothing. Each thread records
+// its timed blocks and running counters, a timed block stores the counters accumulated while open.
+// The results can be exported as a json summary or a chrome trace (chrome://tracing, perfetto).
+#if GENERATOR_PROFILE
+
+typedef enum {
+    ProfileStage_Page,
+    ProfileStage_Asset,
+    ProfileStage_Read,
+    ProfileStage_Parse,
+    ProfileStage_Include,
+    ProfileStage_Render,
+    ProfileStage_Template,
+    ProfileStage_Write,
+    ProfileStage_Compress,
+    ProfileStage_Hash,
+    ProfileStage_Index,
     
-    zero_struct(result);
-    result.number = -1;
-    result.symbol = *t->curr;
-    result.text.data = t->curr;
+    ProfileStage_Count,
+} Profile_Stage;
+
+static cstring profile_stage_names[] = {
+    "page", "asset", "read", "parse", "include", "render", "template", "write", "compress", "hash", "index"
+};
+
+typedef enum {
+    ProfileCounter_Bytes_Read,
+    ProfileCounter_Tokens,
+    ProfileCounter_Dom_Nodes,
+    ProfileCounter_Arena_Blocks,
+    ProfileCounter_Bytes_Written,
     
-    if (t->curr == t->end) {
-        result.symbol = 0;
-        result.new_line = true;
-        result.whitespace = true;
-        return result;
-    }
+    ProfileCounter_Count,
+} Profile_Counter;
+
+static cstring profile_counter_names[] = {
+    "bytes_read", "tokens", "dom_nodes", "arena_blocks", "bytes_written"
+};
+
+typedef struct {
+    Profile_Stage stage;
+    char label[80];
+    u64 begin_time;
+    u64 end_time;
+    u64 child_time;
+    u64 counters[ProfileCounter_Count];
+    u64 child_counters[ProfileCounter_Count];
+} Profile_Event;
+
+#define PROFILE_MAX_DEPTH 64
+
+typedef struct Profile_Thread Profile_Thread;
+struct Profile_Thread {
+    u32 index;
+    u64 counters[ProfileCounter_Count];
     
-    char c = *t->curr++;
-    if (is_special_character(c)) {
-        while (t->curr < t->end && *t->curr == c) {
-            t->curr++;
-        }
-    } else if (is_end_of_line(c)) {
-        if (c == '\r' && *t->curr == '\n') t->curr++; // crlf
-        result.new_line = true;
-        result.whitespace = true;
-    } else if (is_whitespace_no_new_line(c)) {
-        result.whitespace = true;
-        while (t->curr < t->end && is_whitespace_no_new_line(*t->curr)) {
-            t->curr++;
-        }
-    } else if (is_digit(c)) {
-        result.number = c - '0';
-        while (t->curr < t->end && is_digit(*t->curr)) {
-            c = *t->curr++;
-            result.number = result.number * 10 + c - '0';
-        }
-    } else {
-        while (t->curr < t->end && !is_whitespace(*t->curr) && !is_special_character(*t->curr)) {
-            t->curr++;
-        }
-    }
+    Profile_Event* events;
+    int event_count;
+    int event_capacity;
     
-    result.text.count = (int) (t->curr - result.text.data);
+    // NOTE(Alexander): indices of the currently open events
+    int open_events[PROFILE_MAX_DEPTH];
+    int open_count;
     
-    return result;
-}
+    Profile_Thread* next;
+};
 
-Token
-peek_token(Tokenizer* t) {
-    if (!t->peeked.symbol) {
-        t->peeked = next_token(t);
-    }
-    return t->peeked;
-}
+typedef struct {
+    Mutex mutex;
+    Profile_Thread* first_thread;
+    u32 thread_count;
+    u64 start_time;
+} Profiler;
 
-string
-parse_enclosed_string(Tokenizer* t, char open, char close) {
-    string result;
-    zero_struct(result);
+static Profiler global_profiler = { MUTEX_INITIALIZER };
+
+#if _WIN32
+static __declspec(thread) Profile_Thread* profile_current_thread;
+#else
+static __thread Profile_Thread* profile_current_thread;
+#endif
+
+Profile_Thread*
+profile_register_thread(void) {
+    Profiler* profiler = &global_profiler;
+    Profile_Thread* thread = (Profile_Thread*) calloc(1, sizeof(Profile_Thread));
     
-    if (open != 0) {
-        Token token = peek_token(t);
-        if (token.symbol != open) {
-            return result;
-        }
-        next_token(t);
+    mutex_lock(&profiler->mutex);
+    if (!profiler->first_thread) {
+        profiler->start_time = platform_get_time_ns();
     }
+    thread->index = profiler->thread_count++;
+    thread->next = profiler->first_thread;
+    profiler->first_thread = thread;
+    mutex_unlock(&profiler->mutex);
     
-    Token token = next_token(t);
-    result.data = token.text.data;
-    result.count = 0;
+    profile_current_thread = thread;
+    return thread;
+}
+
+inline Profile_Thread*
+profile_get_thread(void) {
+    Profile_Thread* thread = profile_current_thread;
+    return thread ? thread : profile_register_thread();
+}
+
+inline void
+profile_count(Profile_Counter counter, u64 amount) {
+    profile_get_thread()->counters[counter] += amount;
+}
+
+void
+profile_begin(Profile_Stage stage, cstring label) {
+    Profile_Thread* thread = profile_get_thread();
+    if (thread->open_count >= PROFILE_MAX_DEPTH) {
+        thread->open_count++; // NOTE(Alexander): too deep, only keep track of the nesting
+        return;
+    }
     
-    while (token.symbol != close) {
-        result.count += token.text.count;
-        token = next_token(t);
+    if (thread->event_count == thread->event_capacity) {
+        thread->event_capacity = thread->event_capacity ? thread->event_capacity*2 : 256;
+        thread->events = (Profile_Event*) realloc(thread->events, thread->event_capacity*sizeof(Profile_Event));
     }
     
-    return result;
+    Profile_Event* event = &thread->events[thread->event_count];
+    zero_struct(*event);
+    event->stage = stage;
+    if (label) {
+        snprintf(event->label, sizeof(event->label), "%s", label);
+    }
+    memcpy(event->counters, thread->counters, sizeof(thread->counters));
+    thread->open_events[thread->open_count++] = thread->event_count++;
+    event->begin_time = platform_get_time_ns();
 }
 
-typedef enum {
-    CodeBlockLanguage_None,
-    CodeBlockLanguage_C
-} Code_Block_Language;
-
-typedef enum {
-    Dom_None,
-    Dom_Root,
-    Dom_Line_Break,
-    Dom_Inline_Text,
-    Dom_Paragraph,
-    Dom_Heading,
-    Dom_Unordered_List,
-    Dom_Ordered_List,
-    Dom_List_Item,
-    Dom_Image,
-    Dom_Link,
-    Dom_Date,
-    Dom_Code_Block,
-} Dom_Node_Type;
+void
+profile_end(void) {
+    u64 end_time = platform_get_time_ns();
+    Profile_Thread* thread = profile_get_thread();
+    assert(thread->open_count > 0);
+    if (thread->open_count-- > PROFILE_MAX_DEPTH) {
+        return;
+    }
+    
+    Profile_Event* event = &thread->events[thread->open_events[thread->open_count]];
+    event->end_time = end_time;
+    for (int i = 0; i < ProfileCounter_Count; i++) {
+        event->counters[i] = thread->counters[i] - event->counters[i];
+    }
+    
+    if (thread->open_count > 0) {
+        Profile_Event* parent = &thread->events[thread->open_events[thread->open_count - 1]];
+        parent->child_time += event->end_time - event->begin_time;
+        for (int i = 0; i < ProfileCounter_Count; i++) {
+            parent->child_counters[i] += event->counters[i];
+        }
+    }
+}
 
-typedef enum {
-    TextStyle_None = 0,
-    TextStyle_Italics = 1<<0,
-    TextStyle_Bold = 1<<1,
-    TextStyle_Code = 1<<2,
-} Text_Style;
+// NOTE(Alexander): discards all the recorded events, must not be called while other threads are profiling
+void
+profile_reset(void) {
+    Profiler* profiler = &global_profiler;
+    mutex_lock(&profiler->mutex);
+    for (Profile_Thread* thread = profiler->first_thread; thread; thread = thread->next) {
+        thread->event_count = 0;
+        thread->open_count = 0;
+    }
+    profiler->start_time = platform_get_time_ns();
+    mutex_unlock(&profiler->mutex);
+}
 
-// Forward declare
-typedef struct Dom_Node Dom_Node;
 
-typedef struct {
-    Dom_Node* first;
-    Dom_Node* last;
-} Dom_Sequence;
+// NOTE(Alexander): writes the events in the chrome trace_event format, the counters are stored
+// as args on each complete event, call after the build is done.
+bool
+profile_write_chrome_trace(cstring filepath) {
+    FILE* file = fopen(filepath, "wb");
+    if (!file) {
+        printf("Failed to open `%s` for writing!\n", filepath);
+        return false;
+    }
+    
+    Profiler* profiler = &global_profiler;
+    mutex_lock(&profiler->mutex);
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+    for (Profile_Thread* thread = profiler->first_thread; thread; thread = thread->next) {
+        for (int i = 0; i < thread->event_count; i++) {
+            Profile_Event* event = &thread->events[i];
+            if (event->end_time < event->begin_time) {
+                continue; // NOTE(Alexander): still open
+            }
+            
+            fprintf(file, "%s\n{\"name\":", first ? "" : ",");
+            write_json_string(file, event->label[0] ? event->label : profile_stage_names[event->stage]);
+            fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+                    profile_stage_names[event->stage], thread->index,
+                    (f64) (event->begin_time - profiler->start_time) / 1000.0,
+                    (f64) (event->end_time - event->begin_time) / 1000.0);
+            for (int j = 0; j < ProfileCounter_Count; j++) {
+                fprintf(file, "%s\"%s\":%llu", j ? "," : "", profile_counter_names[j], 
+                        (unsigned long long) event->counters[j]);
+            }
+            fprintf(file, "}}");
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    mutex_unlock(&profiler->mutex);
+    
+    fclose(file);
+    return true;
+}
 
-struct Dom_Node {
-    Dom_Node_Type type;
+// NOTE(Alexander): writes the total and self (excluding nested blocks) time and counters
+// of each stage, followed by the inclusive timings of every page.
+bool
+profile_write_summary(cstring filepath) {
+    FILE* file = fopen(filepath, "wb");
+    if (!file) {
+        printf("Failed to open `%s` for writing!\n", filepath);
+        return false;
+    }
     
-    string text;
-    Text_Style text_style;
+    typedef struct {
+        u64 count;
+        u64 total_time;
+        u64 self_time;
+        u64 max_time;
+        u64 self_counters[ProfileCounter_Count];
+    } Stage_Summary;
     
-    Dom_Node* next;
-    int depth;
+    Stage_Summary stages[ProfileStage_Count];
+    u64 counters[ProfileCounter_Count];
+    memset(stages, 0, sizeof(stages));
+    memset(counters, 0, sizeof(counters));
     
-    union {
-        struct {
-            Dom_Sequence seq;
-        } paragraph;
-        
-        struct {
-            int level;
-        } heading;
-        
-        struct {
-            Dom_Sequence seq;
-        } unordered_list;
-        
-        struct {
-            Dom_Sequence seq;
-        } ordered_list;
-        
-        struct {
-            Dom_Sequence seq;
-        } list_item;
+    Profiler* profiler = &global_profiler;
+    mutex_lock(&profiler->mutex);
+    for (Profile_Thread* thread = profiler->first_thread; thread; thread = thread->next) {
+        for (int i = 0; i < thread->event_count; i++) {
+            Profile_Event* event = &thread->events[i];
+            if (event->end_time < event->begin_time) {
+                continue;
+            }
+            
+            Stage_Summary* stage = &stages[event->stage];
+            u64 duration = event->end_time - event->begin_time;
+            stage->count++;
+            stage->total_time += duration;
+            stage->self_time += duration - event->child_time;
+            stage->max_time = max(stage->max_time, duration);
+            for (int j = 0; j < ProfileCounter_Count; j++) {
+                stage->self_counters[j] += event->counters[j] - event->child_counters[j];
+            }
+        }
         
-        struct {
-            string source;
-        } image;
+        for (int j = 0; j < ProfileCounter_Count; j++) {
+            counters[j] += thread->counters[j];
+        }
+    }
+    
+    fprintf(file, "{\n  \"threads\": %u,\n  \"counters\": {", profiler->thread_count);
+    for (int j = 0; j < ProfileCounter_Count; j++) {
+        fprintf(file, "%s \"%s\": %llu", j ? "," : "", profile_counter_names[j], (unsigned long long) counters[j]);
+    }
+    fprintf(file, " },\n  \"stages\": {\n");
+    for (int i = 0; i < ProfileStage_Count; i++) {
+        Stage_Summary* stage = &stages[i];
+        fprintf(file, "    \"%s\": { \"count\": %llu, \"total_ns\": %llu, \"self_ns\": %llu, \"max_ns\": %llu",
+                profile_stage_names[i], (unsigned long long) stage->count, (unsigned long long) stage->total_time,
+                (unsigned long long) stage->self_time, (unsigned long long) stage->max_time);
+        for (int j = 0; j < ProfileCounter_Count; j++) {
+            fprintf(file, ", \"self_%s\": %llu", profile_counter_names[j], 
+                    (unsigned long long) stage->self_counters[j]);
+        }
+        fprintf(file, " }%s\n", i + 1 < ProfileStage_Count ? "," : "");
+    }
+    
+    fprintf(file, "  },\n  \"pages\": [");
+    bool first = true;
+    for (Profile_Thread* thread = profiler->first_thread; thread; thread = thread->next) {
+        for (int i = 0; i < thread->event_count; i++) {
+            Profile_Event* event = &thread->events[i];
+            if (event->stage != ProfileStage_Page || event->end_time < event->begin_time) {
+                continue;
+            }
+            
+            fprintf(file, "%s\n    { \"page\": ", first ? "" : ",");
+            write_json_string(file, event->label);
+            fprintf(file, ", \"thread\": %u, \"duration_ns\": %llu", thread->index, 
+                    (unsigned long long) (event->end_time - event->begin_time));
+            for (int j = 0; j < ProfileCounter_Count; j++) {
+                fprintf(file, ", \"%s\": %llu", profile_counter_names[j], (unsigned long long) event->counters[j]);
+            }
+            fprintf(file, " }");
+            first = false;
+        }
+    }
+    fprintf(file, "\n  ]\n}\n");
+    mutex_unlock(&profiler->mutex);
+    
+    fclose(file);
+    return true;
+}
+
+#define PROFILE_BEGIN(stage, label) profile_begin(ProfileStage_##stage, label)
+#define PROFILE_END() profile_end()
+#define PROFILE_COUNT(counter, amount) profile_count(ProfileCounter_##counter, (u64) (amount))
+#else
+#define PROFILE_BEGIN(stage, label)
+#define PROFILE_END()
+#define PROFILE_COUNT(counter, amount)
+#endif
+
+typedef enum {
+    FileType_None,
+    FileType_File,
+    FileType_Directory,
+} File_Type;
+
+typedef void Directory_Visitor(void* data, cstring path, File_Type type);
+
+// NOTE(Alexander): calls visitor for every file and directory inside path, not recursive
+bool
+platform_visit_directory(cstring path, Directory_Visitor* visitor, void* data) {
+    char filepath[4096];
+#if _WIN32
+    snprintf(filepath, sizeof(filepath), "%s\\*", path);
+    WIN32_FIND_DATAA find_data;
+    HANDLE handle = FindFirstFileA(filepath, &find_data);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    
+    do {
+        cstring name = find_data.cFileName;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
         
-        struct {
-            string source;
-        } link;
+        snprintf(filepath, sizeof(filepath), "%s/%s", path, name);
+        bool is_directory = (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        visitor(data, filepath, is_directory ? FileType_Directory : FileType_File);
+    } while (FindNextFileA(handle, &find_data));
+    FindClose(handle);
+#else
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return false;
+    }
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != 0) {
+        cstring name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
         
-        struct {
-            int year;
-            int month;
-            int day;
-        } date;
+        snprintf(filepath, sizeof(filepath), "%s/%s", path, name);
+        File_Type type = FileType_None;
+        struct stat st;
+        if (stat(filepath, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) type = FileType_Directory;
+            else if (S_ISREG(st.st_mode)) type = FileType_File;
+        }
         
-        struct {
-            Code_Block_Language language;
-        } code_block;
-    };
-};
+        if (type != FileType_None) {
+            visitor(data, filepath, type);
+        }
+    }
+    closedir(dir);
+#endif
+    return true;
+}
 
 typedef struct {
-    Dom_Sequence seq;
-} Dom;
+    bool exists;
+    u64 size;
+    u64 modified_time; // NOTE(Alexander): in platform specific units, only use to compare
+} File_Info;
 
-typedef struct Memory_Block_Header Memory_Block_Header;
-struct Memory_Block_Header {
-    Memory_Block_Header* prev;
-    Memory_Block_Header* next;
-    
-    // NOTE(Alexander): sizes included the header
-    umm size;
-    umm size_used;
-};
+File_Info
+platform_get_file_info(cstring filepath) {
+    File_Info result;
+    zero_struct(result);
+#if _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (GetFileAttributesExA(filepath, GetFileExInfoStandard, &data)) {
+        result.exists = true;
+        result.size = ((u64) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+        result.modified_time = ((u64) data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+    }
+#else
+    struct stat st;
+    if (stat(filepath, &st) == 0) {
+        result.exists = true;
+        result.size = (u64) st.st_size;
+        result.modified_time = (u64) st.st_mtim.tv_sec*1000000000ull + (u64) st.st_mtim.tv_nsec;
+    }
+#endif
+    return result;
+}
 
-typedef struct {
-    char* base;
-    umm size;
-    umm curr_used;
-    umm prev_used;
-    umm min_block_size;
-} Memory_Arena;
+// NOTE(Alexander): returns -1 on failure, the file is truncated if it already exists
+int
+platform_open_file_for_writing(cstring filepath) {
+#if _WIN32
+    return _open(filepath, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+}
 
-#define ARENA_DEFAULT_BLOCK_SIZE 10240; // 10 kB
+inline void
+platform_close_file(int fd) {
+#if _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
 
-// NOTE(Alexander): align has to be a power of two.
-inline umm
-align_forward(umm address, umm align) {
-    umm modulo = address & (align - 1);
-    if (modulo != 0) {
-        address += align - modulo;
+bool
+platform_write_file(int fd, void* data, umm count) {
+    char* curr = (char*) data;
+    while (count > 0) {
+#if _WIN32
+        int written = _write(fd, curr, (unsigned int) min(count, 1u << 30));
+#else
+        ssize_t written = write(fd, curr, count);
+        if (written < 0 && errno == EINTR) continue;
+#endif
+        if (written <= 0) {
+            return false;
+        }
+        PROFILE_COUNT(Bytes_Written, written);
+        curr += written;
+        count -= (umm) written;
     }
-    return address;
+    return true;
 }
 
-void*
-arena_push_size(Memory_Arena* arena, umm size, umm align) {
-    umm current = (umm) (arena->base + arena->curr_used);
-    umm offset = align_forward(current, align) - (umm) arena->base;
+// NOTE(Alexander): writes all the buffers in order, using writev on posix
+bool
+platform_write_file_gather(int fd, string* buffers, int count) {
+#if _WIN32
+    for (int i = 0; i < count; i++) {
+        if (!platform_write_file(fd, buffers[i].data, buffers[i].count)) {
+            return false;
+        }
+    }
+#else
+    struct iovec iov[256];
+    int index = 0;
+    umm offset = 0; // NOTE(Alexander): bytes of buffers[index] already written
     
-    if (offset + size > arena->size) {
-        if (arena->min_block_size == 0) {
-            arena->min_block_size = ARENA_DEFAULT_BLOCK_SIZE;
+    while (index < count) {
+        int iov_count = 0;
+        for (int i = index; i < count && iov_count < (int) array_count(iov); i++) {
+            umm skip = i == index ? offset : 0;
+            iov[iov_count].iov_base = buffers[i].data + skip;
+            iov[iov_count].iov_len = buffers[i].count - skip;
+            iov_count++;
         }
         
-        void* block = calloc(1, arena->min_block_size);
-        Memory_Block_Header* header = (Memory_Block_Header*) block;
-        header->size = arena->min_block_size;
-        
-        if (arena->base) {
-            Memory_Block_Header* prev_header = (Memory_Block_Header*) block;
-            prev_header->size_used = arena->curr_used;
-            prev_header->next = header;
-            header->prev = prev_header;
+        ssize_t written = writev(fd, iov, iov_count);
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0) {
+            return false;
         }
+        PROFILE_COUNT(Bytes_Written, written);
         
-        arena->base = block;
-        arena->curr_used = sizeof(Memory_Block_Header);
-        arena->prev_used = arena->curr_used;
-        arena->size = arena->min_block_size;
-        
-        current = (umm) arena->base + arena->curr_used;
-        offset = align_forward(current, align) - (umm) arena->base;
+        // NOTE(Alexander): advance past the written bytes, writev may write partially
+        umm remaining = (umm) written;
+        while (index < count && remaining >= buffers[index].count - offset) {
+            remaining -= buffers[index].count - offset;
+            offset = 0;
+            index++;
+        }
+        offset += remaining;
+    }
+#endif
+    return true;
+}
+
+// NOTE(Alexander): resolves the absolute canonical path, returns false if the file doesn't exist
+bool
+platform_get_full_path(cstring filepath, char* buffer, umm buffer_size) {
+#if _WIN32
+    if (!_fullpath(buffer, filepath, buffer_size)) {
+        return false;
+    }
+    return GetFileAttributesA(buffer) != INVALID_FILE_ATTRIBUTES;
+#else
+    char* path = realpath(filepath, 0);
+    if (!path) {
+        return false;
     }
     
-    void* result = arena->base + offset;
-    arena->prev_used = arena->curr_used;
-    arena->curr_used = offset + size;
-    
-    Memory_Block_Header* header = (Memory_Block_Header*) arena->base;
-    header->size_used = offset + size;
-    
+    umm count = strlen(path);
+    bool result = count < buffer_size;
+    if (result) {
+        memcpy(buffer, path, count + 1);
+    }
+    free(path);
     return result;
+#endif
 }
 
-#define arena_push_struct(arena, type) (type*) arena_push_size(arena, sizeof(type), 16)
+// NOTE(Alexander): creates all the parent directories of filepath, like mkdir -p
+void
+platform_create_parent_directories(cstring filepath) {
+    char path[4096];
+    umm count = strlen(filepath);
+    if (count >= sizeof(path)) return;
+    memcpy(path, filepath, count + 1);
+    
+    for (umm i = 1; i < count; i++) {
+        if (path[i] == '/' || path[i] == '\\') {
+            char c = path[i];
+            path[i] = 0;
+#if _WIN32
+            _mkdir(path);
+#else
+            mkdir(path, 0755);
+#endif
+            path[i] = c;
+        }
+    }
+}
 
-inline void
-arena_push_string(Memory_Arena* arena, string str) {
-    void* ptr = arena_push_size(arena, str.count, 1);
-    memcpy(ptr, str.data, str.count);
+// NOTE(Alexander): sets the modification time, in the same units as File_Info.modified_time
+bool
+platform_set_modified_time(cstring filepath, u64 modified_time) {
+#if _WIN32
+    HANDLE file = CreateFileA(filepath, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, 
+                              OPEN_EXISTING, 0, 0);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    FILETIME time;
+    time.dwLowDateTime = (DWORD) modified_time;
+    time.dwHighDateTime = (DWORD) (modified_time >> 32);
+    bool result = SetFileTime(file, 0, 0, &time) != 0;
+    CloseHandle(file);
+    return result;
+#else
+    struct timespec times[2];
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = (time_t) (modified_time / 1000000000ull);
+    times[1].tv_nsec = (long) (modified_time % 1000000000ull);
+    return utimensat(AT_FDCWD, filepath, times, 0) == 0;
+#endif
 }
 
-inline void
-arena_push_cstring(Memory_Arena* arena, cstring data) {
-    umm count = strlen(data);
-    void* ptr = arena_push_size(arena, count, 1);
-    memcpy(ptr, data, count);
+// NOTE(Alexander): hard links dst to src, replacing dst, fails e.g. across file systems
+bool
+platform_link_file(cstring src_filepath, cstring dst_filepath) {
+#if _WIN32
+    DeleteFileA(dst_filepath);
+    return CreateHardLinkA(dst_filepath, src_filepath, 0) != 0;
+#else
+    unlink(dst_filepath);
+    return link(src_filepath, dst_filepath) == 0;
+#endif
 }
 
-void
-arena_push_new_line(Memory_Arena* arena, int trailing_spaces) {
-    char* buf = (char*) arena_push_size(arena, trailing_spaces + 1, 1);
-    *buf++ = '\n';
-    for (int i = 0; i < trailing_spaces; i++) *buf++ = ' ';
+// NOTE(Alexander): replaces dst with src in one step, readers see either the old or the new file
+bool
+platform_rename_file(cstring src_filepath, cstring dst_filepath) {
+#if _WIN32
+    return MoveFileExA(src_filepath, dst_filepath, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(src_filepath, dst_filepath) == 0;
+#endif
 }
 
-inline Dom_Node*
+// NOTE(Alexander): unique name next to filepath (same file system, so it can be renamed over it)
+static volatile u32 temporary_file_counter;
+
+void
+temporary_file_path(char* buffer, umm buffer_size, cstring filepath) {
+#if _WIN32
+    u32 process_id = (u32) GetCurrentProcessId();
+#else
+    u32 process_id = (u32) getpid();
+#endif
+    snprintf(buffer, buffer_size, "%s.tmp%u-%u", filepath, process_id, 
+             atomic_add_u32(&temporary_file_counter, 1));
+}
+
+#if !_WIN32 && !defined(FICLONE)
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+// NOTE(Alexander): copies the file without reading it into user space, dst is replaced (never
+// written through, it may be a hard link) and gets the modification time of src. If reflink is set
+// copy on write file systems (btrfs, xfs) share the data blocks, otherwise copy_file_range is used
+// falling back to sendfile and finally read/write.
+bool
+platform_copy_file(cstring src_filepath, cstring dst_filepath, bool reflink) {
+#if _WIN32
+    DeleteFileA(dst_filepath);
+    return CopyFileA(src_filepath, dst_filepath, FALSE) != 0;
+#else
+    int src_fd = open(src_filepath, O_RDONLY);
+    if (src_fd < 0) {
+        printf("File `%s` was not found!\n", src_filepath);
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(src_fd, &st) != 0) {
+        close(src_fd);
+        return false;
+    }
+    
+    unlink(dst_filepath);
+    int dst_fd = open(dst_filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dst_fd < 0) {
+        printf("Failed to open `%s` for writing!\n", dst_filepath);
+        close(src_fd);
+        return false;
+    }
+    
+    bool result = reflink && ioctl(dst_fd, FICLONE, src_fd) == 0;
+    if (!result) {
+        u64 remaining = (u64) st.st_size;
+        bool use_copy_file_range = true;
+        bool use_sendfile = true;
+        char buffer[64*1024];
+        
+        while (remaining > 0) {
+            ssize_t copied = -1;
+#ifdef SYS_copy_file_range
+            if (use_copy_file_range) {
+                copied = (ssize_t) syscall(SYS_copy_file_range, src_fd, 0, dst_fd, 0, (size_t) remaining, 0);
+                if (copied < 0 && errno == EINTR) continue;
+                use_copy_file_range = copied >= 0;
+            }
+#endif
+            if (copied < 0 && use_sendfile) {
+                copied = sendfile(dst_fd, src_fd, 0, (size_t) min(remaining, 1u << 30));
+                if (copied < 0 && errno == EINTR) continue;
+                use_sendfile = copied >= 0;
+            }
+            if (copied < 0) {
+                copied = read(src_fd, buffer, (size_t) min(remaining, sizeof(buffer)));
+                if (copied < 0 && errno == EINTR) continue;
+                if (copied > 0 && !platform_write_file(dst_fd, buffer, (umm) copied)) {
+                    break;
+                }
+            }
+            
+            if (copied <= 0) {
+                break; // NOTE(Alexander): failed or the file shrank while copying
+            }
+            remaining -= (u64) copied;
+        }
+        result = remaining == 0;
+    }
+    
+    if (result) {
+        PROFILE_COUNT(Bytes_Written, st.st_size);
+        struct timespec times[2];
+        times[0] = st.st_atim;
+        times[1] = st.st_mtim;
+        futimens(dst_fd, times);
+    }
+    
+    close(dst_fd);
+    close(src_fd);
+    return result;
+#endif
+}
+
+string
+read_entire_file(cstring filepath) {
+    string result;
+    zero_struct(result);
+    
+    FILE* file = fopen(filepath, "rb");
+    if (!file) {
+        printf("File `%s` was not found!", filepath);
+        return result;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    umm file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    
+    result.data = malloc(file_size);
+    result.count = file_size;
+    fread(result.data, result.count, 1, file);
+    fclose(file);
+    PROFILE_COUNT(Bytes_Read, result.count);
+    return result;
+}
+
+// NOTE(Alexander): read only view of an entire file, regular files are memory mapped so
+// no copy is made, pipes and other special files falls back to reading into the heap.
+typedef struct {
+    string contents;
+    bool is_mapped;
+} Mapped_File;
+
+Mapped_File
+map_entire_file(cstring filepath) {
+    Mapped_File result;
+    zero_struct(result);
+    
+#if _WIN32
+    HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 
+                              FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file == INVALID_HANDLE_VALUE) {
+        printf("File `%s` was not found!", filepath);
+        return result;
+    }
+    
+    LARGE_INTEGER file_size;
+    if (GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        if (mapping) {
+            result.contents.data = (char*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+        
+        if (result.contents.data) {
+            result.contents.count = (umm) file_size.QuadPart;
+            result.is_mapped = true;
+            PROFILE_COUNT(Bytes_Read, result.contents.count);
+            CloseHandle(file);
+            return result;
+        }
+    }
+    
+    String_Builder sb;
+    zero_struct(sb);
+    for (;;) {
+        string_builder_ensure_capacity(&sb, 64*1024);
+        DWORD bytes_read = 0;
+        if (!ReadFile(file, sb.data + sb.curr_used, (DWORD) (sb.size - sb.curr_used), &bytes_read, 0) || 
+            bytes_read == 0) {
+            break;
+        }
+        sb.curr_used += bytes_read;
+    }
+    CloseHandle(file);
+#else
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        printf("File `%s` was not found!", filepath);
+        return result;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* data = mmap(0, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, (size_t) st.st_size, MADV_SEQUENTIAL);
+            result.contents.data = (char*) data;
+            result.contents.count = (umm) st.st_size;
+            result.is_mapped = true;
+            PROFILE_COUNT(Bytes_Read, result.contents.count);
+            close(fd);
+            return result;
+        }
+    }
+    
+    String_Builder sb;
+    zero_struct(sb);
+    for (;;) {
+        string_builder_ensure_capacity(&sb, 64*1024);
+        ssize_t bytes_read = read(fd, sb.data + sb.curr_used, sb.size - sb.curr_used);
+        if (bytes_read < 0 && errno == EINTR) continue;
+        if (bytes_read <= 0) break;
+        sb.curr_used += (umm) bytes_read;
+    }
+    close(fd);
+#endif
+    
+    result.contents = string_builder_to_string_nocopy(&sb);
+    PROFILE_COUNT(Bytes_Read, result.contents.count);
+    return result;
+}
+
+void
+unmap_file(Mapped_File* file) {
+    if (file->is_mapped) {
+#if _WIN32
+        UnmapViewOfFile(file->contents.data);
+#else
+        munmap(file->contents.data, file->contents.count);
+#endif
+    } else {
+        free(file->contents.data);
+    }
+    zero_struct(*file);
+}
+
+bool
+write_entire_file(cstring filepath, string contents) {
+    FILE* file = fopen(filepath, "wb+");
+    if (!file) {
+        printf("Failed to open `%s` for writing!\n", filepath);
+        return false;
+    }
+    fwrite(contents.data, contents.count, 1, file);
+    fclose(file);
+    PROFILE_COUNT(Bytes_Written, contents.count);
+    
+    return true;
+}
+
+typedef enum {
+    WriteResult_Failed,
+    WriteResult_Written,
+    WriteResult_Unchanged,
+} Write_Result;
+
+// NOTE(Alexander): writes the buffers unless filepath already has the same contents (compared by size
+// first), so unchanged files keep their modification time. Otherwise they're written to a temporary
+// file that is renamed over filepath, readers (e.g. a server or an upload) never see a partial file.
+Write_Result
+write_file_if_changed_gather(cstring filepath, string* buffers, int count) {
+    umm size = 0;
+    for (int i = 0; i < count; i++) {
+        size += buffers[i].count;
+    }
+    
+    File_Info info = platform_get_file_info(filepath);
+    if (info.exists && info.size == size) {
+        Mapped_File existing = map_entire_file(filepath);
+        bool same = existing.contents.count == size;
+        char* curr = existing.contents.data;
+        for (int i = 0; i < count && same; i++) {
+            same = memcmp(curr, buffers[i].data, buffers[i].count) == 0;
+            curr += buffers[i].count;
+        }
+        unmap_file(&existing);
+        if (same) {
+            return WriteResult_Unchanged;
+        }
+    }
+    
+    char temp_path[4096 + 32];
+    temporary_file_path(temp_path, sizeof(temp_path), filepath);
+    int fd = platform_open_file_for_writing(temp_path);
+    if (fd < 0) {
+        printf("Failed to open `%s` for writing!\n", temp_path);
+        return WriteResult_Failed;
+    }
+    
+    bool result = platform_write_file_gather(fd, buffers, count);
+    platform_close_file(fd);
+    if (result && platform_rename_file(temp_path, filepath)) {
+        return WriteResult_Written;
+    }
+    
+    printf("Failed to write `%s`!\n", filepath);
+    remove(temp_path);
+    return WriteResult_Failed;
+}
+
+inline Write_Result
+write_entire_file_if_changed(cstring filepath, string contents) {
+    return write_file_if_changed_gather(filepath, &contents, 1);
+}
+
+bool
+copy_file(cstring src_filepath, cstring dst_filepath) {
+    return platform_copy_file(src_filepath, dst_filepath, false);
+}
+
+typedef enum {
+    FileCopy_Copy,
+    FileCopy_Reflink, // NOTE(Alexander): falls back to copying if not supported
+    FileCopy_Hardlink, // NOTE(Alexander): falls back to copying, e.g. across file systems
+} File_Copy_Mode;
+
+typedef enum {
+    CopyResult_Failed,
+    CopyResult_Copied,
+    CopyResult_Unchanged,
+} Copy_Result;
+
+// NOTE(Alexander): copies src to dst unless dst is already up to date. It is if the size and
+// modification time matches, or if only the modification time differs but the content hash matches
+// (the time is then updated so the next check is cheap). Copies keep the modification time of src
+// and are made to a temporary file that replaces dst in one step.
+Copy_Result
+copy_file_ex(cstring src_filepath, cstring dst_filepath, File_Copy_Mode mode) {
+    File_Info src_info = platform_get_file_info(src_filepath);
+    if (!src_info.exists) {
+        printf("File `%s` was not found!\n", src_filepath);
+        return CopyResult_Failed;
+    }
+    
+    File_Info dst_info = platform_get_file_info(dst_filepath);
+    if (dst_info.exists && dst_info.size == src_info.size) {
+        if (dst_info.modified_time == src_info.modified_time) {
+            return CopyResult_Unchanged;
+        }
+        
+        if (mode != FileCopy_Hardlink) {
+            Mapped_File src = map_entire_file(src_filepath);
+            Mapped_File dst = map_entire_file(dst_filepath);
+            bool same = (src.contents.count == dst.contents.count &&
+                         string_content_hash(src.contents) == string_content_hash(dst.contents));
+            unmap_file(&src);
+            unmap_file(&dst);
+            if (same && platform_set_modified_time(dst_filepath, src_info.modified_time)) {
+                return CopyResult_Unchanged;
+            }
+        }
+    }
+    
+    char temp_path[4096 + 32];
+    temporary_file_path(temp_path, sizeof(temp_path), dst_filepath);
+    bool copied = ((mode == FileCopy_Hardlink && platform_link_file(src_filepath, temp_path)) ||
+                   platform_copy_file(src_filepath, temp_path, mode == FileCopy_Reflink));
+    if (copied && platform_rename_file(temp_path, dst_filepath)) {
+        return CopyResult_Copied;
+    }
+    remove(temp_path);
+    return CopyResult_Failed;
+}
+
+typedef struct {
+    string text;
+    char symbol;
+    int number;
+    bool whitespace;
+    bool new_line;
+} Token;
+
+// Forward declare
+typedef struct Dom Dom;
+
+// NOTE(Alexander): the result of the last search for a closing bracket, every search starting
+// in [begin, found] stops at the same place, either the bracket, the new line before a blank line
+// or the end, see parse_enclosed_string.
+typedef struct {
+    char* begin;
+    char* found;
+} Enclosed_Scan;
+
+// NOTE(Alexander): lists nested deeper than this are parsed as part of the innermost list
+#define MARKDOWN_MAX_LIST_DEPTH 32
+
+typedef struct Tokenizer {
+    char* base;
+    char* curr;
+    char* end;
+    Token peeked;
+    
+    Enclosed_Scan enclosed_scans[2]; // NOTE(Alexander): ']' and ')'
+    int list_depth;
+    
+    // NOTE(Alexander): set once anything looked for more input than there is, e.g. the end of input
+    // token or an unclosed bracket, the parse from there on may change if the input is extended.
+    bool reached_end;
+    
+    Dom* dom; // NOTE(Alexander): the document being parsed, if any
+    
+    // NOTE(Alexander): canonical path of the source, if any, included files are expanded against it
+    // to detect cyclic includes unless they're deferred, see include_expand.
+    cstring filepath;
+    bool defer_includes;
+    
+    // NOTE(Alexander): diagnostics for the text before this were already printed by an earlier parse
+    char* quiet_end;
+} Tokenizer;
+
+// NOTE(Alexander): character classes used by the tokenizer, everything else is plain text
+enum {
+    CharClass_Text = 0,
+    CharClass_Special = 1<<0,
+    CharClass_Whitespace = 1<<1,
+    CharClass_New_Line = 1<<2,
+    CharClass_Digit = 1<<3,
+};
+
+static const u8 char_class_table[256] = {
+    ['*'] = CharClass_Special, ['#'] = CharClass_Special, ['$'] = CharClass_Special,
+    ['@'] = CharClass_Special, [':'] = CharClass_Special, ['/'] = CharClass_Special,
+    ['"'] = CharClass_Special, ['`'] = CharClass_Special, ['.'] = CharClass_Special,
+    [','] = CharClass_Special, ['_'] = CharClass_Special, ['+'] = CharClass_Special,
+    ['-'] = CharClass_Special, ['['] = CharClass_Special, [']'] = CharClass_Special,
+    ['('] = CharClass_Special, [')'] = CharClass_Special, ['{'] = CharClass_Special,
+    ['}'] = CharClass_Special, ['<'] = CharClass_Special, ['>'] = CharClass_Special,
+    
+    [' '] = CharClass_Whitespace, ['\t'] = CharClass_Whitespace, 
+    ['\v'] = CharClass_Whitespace, ['\f'] = CharClass_Whitespace,
+    ['\n'] = CharClass_New_Line, ['\r'] = CharClass_New_Line,
+    
+    ['0'] = CharClass_Digit, ['1'] = CharClass_Digit, ['2'] = CharClass_Digit, ['3'] = CharClass_Digit,
+    ['4'] = CharClass_Digit, ['5'] = CharClass_Digit, ['6'] = CharClass_Digit, ['7'] = CharClass_Digit,
+    ['8'] = CharClass_Digit, ['9'] = CharClass_Digit,
+};
+
+#define char_class(c) (char_class_table[(u8) (c)])
+
+inline bool 
+is_digit(char c) {
+    return (char_class(c) & CharClass_Digit) != 0;
+}
+
+inline bool
+is_end_of_line(char c) {
+    return (char_class(c) & CharClass_New_Line) != 0;
+}
+
+inline bool
+is_whitespace(char c) {
+    return (char_class(c) & (CharClass_Whitespace | CharClass_New_Line)) != 0;
+}
+
+inline bool
+is_whitespace_no_new_line(char c) {
+    return (char_class(c) & CharClass_Whitespace) != 0;
+}
+
+inline bool
+is_special_character(char c) {
+    return (char_class(c) & CharClass_Special) != 0;
+}
+
+// NOTE(Alexander): scanning runs of text and whitespace is the hottest loop when parsing,
+// on x64 the runs are skipped 16 (SSE2) or 32 (AVX2) bytes at a time, selected at runtime.
+// The SIMD versions only skip bytes that are obviously text (letters, digits and utf-8),
+// anything else is classified by the table so the result is identical to the scalar version.
+typedef char* Scan_Proc(char* curr, char* end);
+
+#define TEXT_RUN_STOP (CharClass_Special | CharClass_Whitespace | CharClass_New_Line)
+
+char*
+scan_text_run_scalar(char* curr, char* end) {
+    while (curr < end && !(char_class(*curr) & TEXT_RUN_STOP)) {
+        curr++;
+    }
+    return curr;
+}
+
+char*
+scan_whitespace_run_scalar(char* curr, char* end) {
+    while (curr < end && char_class(*curr) == CharClass_Whitespace) {
+        curr++;
+    }
+    return curr;
+}
+
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(GENERATOR_NO_SIMD)
+#define GENERATOR_SIMD_X64 1
+#include <immintrin.h>
+#if _MSC_VER
+#include <intrin.h>
+#define GENERATOR_TARGET_AVX2
+#else
+#define GENERATOR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+inline u32
+bit_scan_forward_u32(u32 value) {
+#if _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return (u32) index;
+#else
+    return (u32) __builtin_ctz(value);
+#endif
+}
+
+// NOTE(Alexander): signed compare trick for unsigned ranges, x in [lo, hi] is mapped to
+// [-128, -128 + hi - lo] by adding 128 - lo, then compared with a single signed less than.
+#define SSE2_IN_RANGE(x, lo, hi) _mm_cmplt_epi8(_mm_add_epi8(x, _mm_set1_epi8((char) (128 - (lo)))), \
+                                                _mm_set1_epi8((char) (-128 + (hi) - (lo) + 1)))
+#define AVX2_IN_RANGE(x, lo, hi) _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (-128 + (hi) - (lo) + 1)), \
+                                                   _mm256_add_epi8(x, _mm256_set1_epi8((char) (128 - (lo)))))
+
+char*
+scan_text_run_sse2(char* curr, char* end) {
+    while (end - curr >= 16) {
+        __m128i x = _mm_loadu_si128((__m128i*) curr);
+        __m128i text = _mm_or_si128(_mm_or_si128(SSE2_IN_RANGE(x, 'a', 'z'), SSE2_IN_RANGE(x, 'A', 'Z')),
+                                    SSE2_IN_RANGE(x, '0', '9'));
+        u32 mask = (u32) (_mm_movemask_epi8(text) | _mm_movemask_epi8(x)); // NOTE(Alexander): utf-8
+        if (mask == 0xFFFF) {
+            curr += 16;
+            continue;
+        }
+        
+        curr += bit_scan_forward_u32(~mask);
+        if (char_class(*curr) & TEXT_RUN_STOP) {
+            return curr;
+        }
+        curr++;
+    }
+    return scan_text_run_scalar(curr, end);
+}
+
+char*
+scan_whitespace_run_sse2(char* curr, char* end) {
+    while (end - curr >= 16) {
+        __m128i x = _mm_loadu_si128((__m128i*) curr);
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), 
+                                     _mm_cmpeq_epi8(x, _mm_set1_epi8('\t')));
+        u32 mask = (u32) _mm_movemask_epi8(space);
+        if (mask == 0xFFFF) {
+            curr += 16;
+            continue;
+        }
+        
+        curr += bit_scan_forward_u32(~mask);
+        if (char_class(*curr) != CharClass_Whitespace) {
+            return curr;
+        }
+        curr++;
+    }
+    return scan_whitespace_run_scalar(curr, end);
+}
+
+GENERATOR_TARGET_AVX2 char*
+scan_text_run_avx2(char* curr, char* end) {
+    while (end - curr >= 32) {
+        __m256i x = _mm256_loadu_si256((__m256i*) curr);
+        __m256i text = _mm256_or_si256(_mm256_or_si256(AVX2_IN_RANGE(x, 'a', 'z'), AVX2_IN_RANGE(x, 'A', 'Z')),
+                                       _mm256_or_si256(AVX2_IN_RANGE(x, '0', '9'), x));
+        u32 mask = (u32) _mm256_movemask_epi8(text);
+        if (mask == 0xFFFFFFFF) {
+            curr += 32;
+            continue;
+        }
+        
+        curr += bit_scan_forward_u32(~mask);
+        if (char_class(*curr) & TEXT_RUN_STOP) {
+            return curr;
+        }
+        curr++;
+    }
+    return scan_text_run_sse2(curr, end);
+}
+
+GENERATOR_TARGET_AVX2 char*
+scan_whitespace_run_avx2(char* curr, char* end) {
+    while (end - curr >= 32) {
+        __m256i x = _mm256_loadu_si256((__m256i*) curr);
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), 
+                                        _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t')));
+        u32 mask = (u32) _mm256_movemask_epi8(space);
+        if (mask == 0xFFFFFFFF) {
+            curr += 32;
+            continue;
+        }
+        
+        curr += bit_scan_forward_u32(~mask);
+        if (char_class(*curr) != CharClass_Whitespace) {
+            return curr;
+        }
+        curr++;
+    }
+    return scan_whitespace_run_sse2(curr, end);
+}
+
+bool
+cpu_supports_avx2(void) {
+#if _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool os_uses_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28));
+    if (!os_uses_avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+char* scan_text_run_select(char* curr, char* end);
+char* scan_whitespace_run_select(char* curr, char* end);
+
+// NOTE(Alexander): the tokenizer calls these through atomic loads, they're replaced once on first use
+static Scan_Proc* scan_text_run_proc = scan_text_run_select;
+static Scan_Proc* scan_whitespace_run_proc = scan_whitespace_run_select;
+static volatile u32 scan_procs_selected;
+static Mutex scan_procs_mutex = MUTEX_INITIALIZER;
+
+#define scan_text_run(curr, end) ((Scan_Proc*) atomic_load_pointer(&scan_text_run_proc))(curr, end)
+#define scan_whitespace_run(curr, end) ((Scan_Proc*) atomic_load_pointer(&scan_whitespace_run_proc))(curr, end)
+
+void
+tokenizer_select_scan_procs(void) {
+#if GENERATOR_SIMD_X64
+    if (cpu_supports_avx2()) {
+        atomic_store_pointer(&scan_text_run_proc, scan_text_run_avx2);
+        atomic_store_pointer(&scan_whitespace_run_proc, scan_whitespace_run_avx2);
+    } else {
+        atomic_store_pointer(&scan_text_run_proc, scan_text_run_sse2);
+        atomic_store_pointer(&scan_whitespace_run_proc, scan_whitespace_run_sse2);
+    }
+#else
+    atomic_store_pointer(&scan_text_run_proc, scan_text_run_scalar);
+    atomic_store_pointer(&scan_whitespace_run_proc, scan_whitespace_run_scalar);
+#endif
+}
+
+// NOTE(Alexander): the best implementation is picked once by the first thread, the others wait on the mutex
+inline void
+tokenizer_ensure_scan_procs(void) {
+    if (atomic_load_u32(&scan_procs_selected)) {
+        return;
+    }
+    
+    mutex_lock(&scan_procs_mutex);
+    if (!scan_procs_selected) {
+        tokenizer_select_scan_procs();
+        atomic_add_u32(&scan_procs_selected, 1);
+    }
+    mutex_unlock(&scan_procs_mutex);
+}
+
+char*
+scan_text_run_select(char* curr, char* end) {
+    tokenizer_ensure_scan_procs();
+    return scan_text_run(curr, end);
+}
+
+char*
+scan_whitespace_run_select(char* curr, char* end) {
+    tokenizer_ensure_scan_procs();
+    return scan_whitespace_run(curr, end);
+}
+
+Token
+next_token(Tokenizer* t) {
+    Token result;
+    
+    if (t->peeked.symbol) {
+        result = t->peeked;
+        t->peeked.symbol = 0;
+        return result;
+    }
+    
+    zero_struct(result);
+    result.number = -1;
+    result.text.data = t->curr;
+    
+    if (t->curr == t->end) {
+        result.symbol = 0;
+        result.new_line = true;
+        result.whitespace = true;
+        t->reached_end = true;
+        return result;
+    }
+    result.symbol = *t->curr;
+    PROFILE_COUNT(Tokens, 1);
+    
+    char c = *t->curr++;
+    switch (char_class(c)) {
+        case CharClass_Special: {
+            while (t->curr < t->end && *t->curr == c) {
+                t->curr++;
+            }
+        } break;
+        
+        case CharClass_New_Line: {
+            if (c == '\r' && t->curr < t->end && *t->curr == '\n') t->curr++; // crlf
+            result.new_line = true;
+            result.whitespace = true;
+        } break;
+        
+        case CharClass_Whitespace: {
+            result.whitespace = true;
+            t->curr = scan_whitespace_run(t->curr, t->end);
+        } break;
+        
+        case CharClass_Digit: {
+            result.number = c - '0';
+            while (t->curr < t->end && is_digit(*t->curr)) {
+                c = *t->curr++;
+                result.number = result.number * 10 + c - '0';
+            }
+        } break;
+        
+        default: {
+            t->curr = scan_text_run(t->curr, t->end);
+        } break;
+    }
+    
+    result.text.count = (int) (t->curr - result.text.data);
+    
+    return result;
+}
+
+Token
+peek_token(Tokenizer* t) {
+    if (!t->peeked.symbol) {
+        t->peeked = next_token(t);
+    }
+    return t->peeked;
+}
+
+// NOTE(Alexander): rewinds to a saved position, the enclosed scans are kept since they're still valid
+inline void
+tokenizer_rewind(Tokenizer* t, Tokenizer* saved) {
+    t->curr = saved->curr;
+    t->peeked = saved->peeked;
+}
+
+// NOTE(Alexander): finds the closing symbol, stopping at the new line before a blank line so an
+// unclosed bracket never looks further than the end of its paragraph. Each byte is looked at once,
+// the search stops at whichever of the closing symbol or the new line comes first.
+char*
+find_enclosed_end(char* curr, char* end, char close) {
+    for (;;) {
+        while (curr < end && *curr != close && *curr != '\n') {
+            curr++;
+        }
+        if (curr == end || *curr == close) {
+            return curr;
+        }
+        
+        char* line_end = curr;
+        char* next = line_end + 1;
+        while (next < end && (*next == ' ' || *next == '\t' || *next == '\r')) {
+            next++;
+        }
+        if (next == end || *next == '\n') {
+            return next == end ? end : line_end;
+        }
+        curr = next;
+    }
+}
+
+// NOTE(Alexander): returns the text up to the closing symbol (either ']' or ')') and skips past it,
+// returns an empty string without consuming anything if it's not closed before the end of the
+// paragraph, the open bracket is then kept as text by the caller.
+// A closing symbol always starts a token so it's found by a plain byte scan, the last search is remembered
+// so rewinding and trying again from any later open bracket doesn't scan the same text twice.
+string
+parse_enclosed_string(Tokenizer* t, char open, char close) {
+    string result;
+    zero_struct(result);
+    assert(close == ']' || close == ')');
+    
+    if (open != 0) {
+        Token token = peek_token(t);
+        if (token.symbol != open) {
+            return result;
+        }
+        next_token(t);
+    }
+    
+    char* begin = t->peeked.symbol ? t->peeked.text.data : t->curr;
+    Enclosed_Scan* scan = &t->enclosed_scans[close == ')'];
+    if (!(scan->begin && begin >= scan->begin && begin <= scan->found)) {
+        scan->begin = begin;
+        scan->found = find_enclosed_end(begin, t->end, close);
+    }
+    
+    if (scan->found == t->end || *scan->found != close) {
+        t->reached_end |= scan->found == t->end;
+        return result;
+    }
+    
+    result.data = begin;
+    result.count = scan->found - begin;
+    t->peeked.symbol = 0;
+    t->curr = scan->found;
+    while (t->curr < t->end && *t->curr == close) {
+        t->curr++;
+    }
+    return result;
+}
+
+typedef enum {
+    CodeBlockLanguage_None,
+    CodeBlockLanguage_C,
+    
+    CodeBlockLanguage_Count,
+} Code_Block_Language;
+
+typedef enum {
+    Dom_None,
+    Dom_Root,
+    Dom_Line_Break,
+    Dom_Inline_Text,
+    Dom_Paragraph,
+    Dom_Heading,
+    Dom_Unordered_List,
+    Dom_Ordered_List,
+    Dom_List_Item,
+    Dom_Image,
+    Dom_Link,
+    Dom_Date,
+    Dom_Code_Block,
+    Dom_Include,
+} Dom_Node_Type;
+
+typedef enum {
+    TextStyle_None = 0,
+    TextStyle_Italics = 1<<0,
+    TextStyle_Bold = 1<<1,
+    TextStyle_Code = 1<<2,
+} Text_Style;
+
+// Forward declare
+typedef struct Dom_Node Dom_Node;
+
+typedef struct {
+    Dom_Node* first;
+    Dom_Node* last;
+} Dom_Sequence;
+
+struct Dom_Node {
+    Dom_Node_Type type;
+    
+    string text;
+    Text_Style text_style;
+    
+    Dom_Node* next;
+    int depth;
+    
+    union {
+        struct {
+            Dom_Sequence seq;
+        } paragraph;
+        
+        struct {
+            int level;
+        } heading;
+        
+        struct {
+            Dom_Sequence seq;
+        } unordered_list;
+        
+        struct {
+            Dom_Sequence seq;
+        } ordered_list;
+        
+        struct {
+            Dom_Sequence seq;
+        } list_item;
+        
+        struct {
+            string source;
+        } image;
+        
+        struct {
+            string source;
+        } link;
+        
+        struct {
+            int year;
+            int month;
+            int day;
+        } date;
+        
+        struct {
+            Code_Block_Language language;
+        } code_block;
+        
+        struct {
+            cstring filename; // NOTE(Alexander): as written in the @include
+            Dom_Sequence seq; // NOTE(Alexander): shared, owned by the include cache
+        } include;
+    };
+};
+
+typedef struct Dom_Dependency Dom_Dependency;
+struct Dom_Dependency {
+    cstring filename;
+    Dom_Dependency* next;
+};
+
+typedef struct Dom_Source Dom_Source;
+struct Dom_Source {
+    Mapped_File file;
+    Dom_Source* next;
+};
+
+struct Dom {
+    Dom_Sequence seq;
+    
+    // NOTE(Alexander): files pulled in through @include, including nested includes once expanded
+    Dom_Dependency* dependencies;
+    
+    // NOTE(Alexander): the nodes points directly into these, see free_dom_sources
+    Dom_Source* sources;
+};
+
+// NOTE(Alexander): releases the source files, has to be called before the arena is cleared
+void
+free_dom_sources(Dom* dom) {
+    for (Dom_Source* source = dom->sources; source; source = source->next) {
+        unmap_file(&source->file);
+    }
+    dom->sources = 0;
+}
+
+typedef struct Memory_Block_Header Memory_Block_Header;
+struct Memory_Block_Header {
+    Memory_Block_Header* prev;
+    Memory_Block_Header* next;
+    
+    // NOTE(Alexander): sizes included the header
+    umm size;
+    umm size_used;
+};
+
+typedef struct {
+    char* base;
+    umm size;
+    umm curr_used;
+    umm prev_used;
+    umm min_block_size;
+    umm next_block_size; // NOTE(Alexander): grows geometrically up to ARENA_MAX_BLOCK_SIZE
+    u32 block_count;
+} Memory_Arena;
+
+#define ARENA_DEFAULT_BLOCK_SIZE 10240 // 10 kB
+#define ARENA_MAX_BLOCK_SIZE (4*1024*1024) // 4 MB
+
+// NOTE(Alexander): align has to be a power of two.
+inline umm
+align_forward(umm address, umm align) {
+    umm modulo = address & (align - 1);
+    if (modulo != 0) {
+        address += align - modulo;
+    }
+    return address;
+}
+
+// NOTE(Alexander): moves to the next block, blocks kept from arena_reset or temporary memory
+// are reused if they are large enough, otherwise a new block is inserted after the current one.
+void
+arena_next_block(Memory_Arena* arena, umm min_size) {
+    umm required_size = sizeof(Memory_Block_Header) + min_size;
+    Memory_Block_Header* current = (Memory_Block_Header*) arena->base;
+    Memory_Block_Header* next = current ? current->next : 0;
+    
+    if (!next || next->size < required_size) {
+        if (arena->min_block_size == 0) {
+            arena->min_block_size = ARENA_DEFAULT_BLOCK_SIZE;
+        }
+        if (arena->next_block_size < arena->min_block_size) {
+            arena->next_block_size = arena->min_block_size;
+        }
+        
+        umm block_size = arena->next_block_size;
+        if (required_size > block_size) {
+            // NOTE(Alexander): oversized allocations gets their own block
+            block_size = required_size;
+        } else if (arena->next_block_size < ARENA_MAX_BLOCK_SIZE) {
+            arena->next_block_size *= 2;
+        }
+        
+        // NOTE(Alexander): not zeroed, see arena_push_size_zero
+        Memory_Block_Header* block = (Memory_Block_Header*) malloc(block_size);
+        block->size = block_size;
+        block->size_used = sizeof(Memory_Block_Header);
+        block->prev = current;
+        block->next = next;
+        if (current) current->next = block;
+        if (next) next->prev = block;
+        arena->block_count++;
+        PROFILE_COUNT(Arena_Blocks, 1);
+        next = block;
+    }
+    
+    arena->base = (char*) next;
+    arena->size = next->size;
+    arena->curr_used = sizeof(Memory_Block_Header);
+    arena->prev_used = arena->curr_used;
+    next->size_used = arena->curr_used;
+}
+
+void*
+arena_push_size(Memory_Arena* arena, umm size, umm align) {
+    umm current = (umm) (arena->base + arena->curr_used);
+    umm offset = align_forward(current, align) - (umm) arena->base;
+    
+    if (!arena->base || offset + size > arena->size) {
+        arena_next_block(arena, size + align);
+        
+        current = (umm) arena->base + arena->curr_used;
+        offset = align_forward(current, align) - (umm) arena->base;
+    }
+    
+    void* result = arena->base + offset;
+    arena->prev_used = arena->curr_used;
+    arena->curr_used = offset + size;
+    
+    Memory_Block_Header* header = (Memory_Block_Header*) arena->base;
+    header->size_used = offset + size;
+    
+    return result;
+}
+
+inline void*
+arena_push_size_zero(Memory_Arena* arena, umm size, umm align) {
+    void* result = arena_push_size(arena, size, align);
+    memset(result, 0, size);
+    return result;
+}
+
+#define arena_push_struct(arena, type) (type*) arena_push_size_zero(arena, sizeof(type), 16)
+#define arena_push_array(arena, type, count) (type*) arena_push_size_zero(arena, sizeof(type)*(count), 16)
+
+// NOTE(Alexander): rewinds the arena to the beginning, all the blocks are kept for reuse
+void
+arena_reset(Memory_Arena* arena) {
+    Memory_Block_Header* header = (Memory_Block_Header*) arena->base;
+    if (!header) {
+        return;
+    }
+    
+    while (header->prev) {
+        header = header->prev;
+    }
+    
+    arena->base = (char*) header;
+    arena->size = header->size;
+    arena->curr_used = sizeof(Memory_Block_Header);
+    arena->prev_used = arena->curr_used;
+    header->size_used = arena->curr_used;
+}
+
+typedef struct {
+    Memory_Arena* arena;
+    char* base;
+    umm curr_used;
+} Temporary_Memory;
+
+inline Temporary_Memory
+begin_temporary_memory(Memory_Arena* arena) {
+    Temporary_Memory result;
+    result.arena = arena;
+    result.base = arena->base;
+    result.curr_used = arena->curr_used;
+    return result;
+}
+
+// NOTE(Alexander): frees everything pushed since begin_temporary_memory, blocks are kept for reuse
+void
+end_temporary_memory(Temporary_Memory temp) {
+    Memory_Arena* arena = temp.arena;
+    if (!temp.base) {
+        arena_reset(arena);
+        return;
+    }
+    
+    Memory_Block_Header* header = (Memory_Block_Header*) temp.base;
+    arena->base = temp.base;
+    arena->size = header->size;
+    arena->curr_used = temp.curr_used;
+    arena->prev_used = temp.curr_used;
+    header->size_used = temp.curr_used;
+}
+
+// NOTE(Alexander): frees all the memory blocks, the arena can be reused afterwards
+void
+arena_clear(Memory_Arena* arena) {
+    Memory_Block_Header* header = (Memory_Block_Header*) arena->base;
+    while (header && header->prev) {
+        header = header->prev;
+    }
+    
+    while (header) {
+        Memory_Block_Header* next = header->next;
+        free(header);
+        header = next;
+    }
+    
+    umm min_block_size = arena->min_block_size;
+    zero_struct(*arena);
+    arena->min_block_size = min_block_size;
+}
+
+// NOTE(Alexander): formats a null terminated string allocated on the arena
+cstring
+arena_push_format(Memory_Arena* arena, cstring format, ...) {
+    va_list args;
+    va_start(args, format);
+    int count = vsnprintf(0, 0, format, args);
+    va_end(args);
+    
+    char* result = (char*) arena_push_size(arena, count + 1, 1);
+    va_start(args, format);
+    vsnprintf(result, count + 1, format, args);
+    va_end(args);
+    return (cstring) result;
+}
+
+inline void
+arena_push_string(Memory_Arena* arena, string str) {
+    void* ptr = arena_push_size(arena, str.count, 1);
+    memcpy(ptr, str.data, str.count);
+}
+
+inline void
+arena_push_cstring(Memory_Arena* arena, cstring data) {
+    umm count = strlen(data);
+    void* ptr = arena_push_size(arena, count, 1);
+    memcpy(ptr, data, count);
+}
+
+void
+arena_push_new_line(Memory_Arena* arena, int trailing_spaces) {
+    char* buf = (char*) arena_push_size(arena, trailing_spaces + 1, 1);
+    *buf++ = '\n';
+    for (int i = 0; i < trailing_spaces; i++) *buf++ = ' ';
+}
+
+inline Dom_Node*
 arena_push_dom_node(Memory_Arena* arena, Dom_Node* parent_node) {
     Dom_Node* node = arena_push_struct(arena, Dom_Node);
+    PROFILE_COUNT(Dom_Nodes, 1);
     if (parent_node) {
         node->text_style = parent_node->text_style;
         parent_node->next = node;
     }
-    return node;
+    return node;
+}
+
+inline bool
+is_unordered_list_symbol(char c) {
+    return c == '*' || c == '+' || c == '-';
+}
+
+// NOTE(Alexander): parses a chain of nodes, returns the last node
+Dom_Sequence
+parse_markdown_text_line(Tokenizer* t, Memory_Arena* arena, Token token)  {
+    Dom_Sequence result;
+    
+    result.first = arena_push_dom_node(arena, 0);
+    result.last = result.first;
+    
+    Dom_Node* node = result.first;
+    node->type = Dom_Inline_Text;
+    node->text.data = token.text.data;
+    node->text.count = 0;
+    
+    for (;;) {
+        if (!token.symbol) {
+            break;
+        }
+        
+        if (token.new_line) {
+            node->text.count += token.text.count;
+            break;
+        }
+        
+        if (token.symbol == '*' || token.symbol == '`') {
+            node = arena_push_dom_node(arena, node);
+            node->type = Dom_Inline_Text;
+            
+            if (token.symbol == '*') {
+                if (token.text.count == 1 || token.text.count > 2) {
+                    node->text_style ^= TextStyle_Italics;
+                }
+                if (token.text.count >= 2) {
+                    node->text_style ^= TextStyle_Bold;
+                }
+            } else {
+                node->text_style ^= TextStyle_Code;
+            }
+            
+            token = next_token(t);
+            node->text.data = token.text.data;
+            node->text.count = 0;
+        } else if (token.symbol == '[') {
+            Tokenizer saved = *t;
+            string text = parse_enclosed_string(t, 0, ']');
+            string src = parse_enclosed_string(t, '(', ')');
+            
+            if (text.count == 0 || src.count == 0) {
+                // NOTE(Alexander): not a link, the bracket is kept as text
+                tokenizer_rewind(t, &saved);
+            } else {
+                node = arena_push_dom_node(arena, node);
+                node->type = Dom_Link;
+                node->text = text;
+                node->link.source = src;
+                
+                token = next_token(t);
+                node = arena_push_dom_node(arena, node);
+                node->type = Dom_Inline_Text;
+                node->text.data = token.text.data;
+                node->text.count = 0;
+                continue;
+            }
+        } else if (token.text.count >= 4) {
+            if (memcmp("http", token.text.data, 4) == 0) {
+                if (token.text.count == 4 || (token.text.count == 5 && token.text.data[4] == 's')) {
+                    Tokenizer temp_t = *t;
+                    next_token(&temp_t);
+                    bool success = next_token(&temp_t).symbol != ':';
+                    success &= next_token(&temp_t).symbol != '/';
+                    success &= next_token(&temp_t).symbol != '/';
+                    success &= !next_token(&temp_t).whitespace;
+                    t->reached_end |= temp_t.reached_end;
+                    
+                    if (success) {
+                        string link;
+                        link.data = token.text.data;
+                        link.count = 0;
+                        
+                        // NOTE(Alexander): not complete parser for URLs, they are way to complicated
+                        while (!token.whitespace) {
+                            if ((token.symbol == ',' || token.symbol == '.') && peek_token(t).whitespace) {
+                                break;
+                            }
+                            
+                            link.count += token.text.count;
+                            token = next_token(t);
+                        }
+                        
+                        node = arena_push_dom_node(arena, node);
+                        node->type = Dom_Link;
+                        node->text = link;
+                        node->link.source = link;
+                        
+                        node = arena_push_dom_node(arena, node);
+                        node->type = Dom_Inline_Text;
+                        node->text.data = token.text.data;
+                        node->text.count = 0;
+                        continue;
+                    }
+                } 
+            }
+        }
+        
+        node->text.count += token.text.count;
+        token = next_token(t);
+    }
+    
+    result.last = node;
+    return result;
+}
+
+Dom_Sequence
+parse_markdown_list(Tokenizer* t, Memory_Arena* arena, Token line_start, int curr_indent) {
+    Dom_Sequence result;
+    result.first = arena_push_dom_node(arena, 0);
+    result.last = result.first;
+    
+    if (line_start.number > 0 && peek_token(t).symbol == '.') {
+        next_token(t);
+    }
+    
+    Dom_Node* node = result.first;
+    node->type = Dom_List_Item;
+    node->list_item.seq = parse_markdown_text_line(t, arena, next_token(t));
+    
+    node = arena_push_dom_node(arena, node);
+    
+    for (;;) {
+        Token token = peek_token(t);
+        if (token.new_line) {
+            break;
+        }
+        
+        if (line_start.number > 0) {
+            line_start.number++;
+        }
+        
+        int indent = 0;
+        if (token.whitespace) {
+            indent = (int) token.text.count; // TODO(Alexander): tabs counts as 1 unit
+            next_token(t);
+            token = peek_token(t);
+        }
+        
+        // NOTE(Alexander): either symbol +, -, * (unordered is correct) or 1. 2. etc. (ordered is correct)
+        bool correct_line_start = token.symbol == line_start.symbol 
+            || (line_start.number > 0 && token.number == line_start.number);
+        
+        if (indent < curr_indent || !correct_line_start) {
+            break;
+        }
+        
+        if (indent > curr_indent && t->list_depth < MARKDOWN_MAX_LIST_DEPTH) {
+            next_token(t);
+            node = arena_push_dom_node(arena, node);
+            
+            t->list_depth++;
+            if (token.number > 0) {
+                node->type = Dom_Ordered_List;
+                node->ordered_list.seq = parse_markdown_list(t, arena, token, indent);
+            } else if (is_unordered_list_symbol(token.symbol)) {
+                node->type = Dom_Unordered_List;
+                node->unordered_list.seq = parse_markdown_list(t, arena, token, indent);
+            }
+            t->list_depth--;
+            
+            token = peek_token(t);
+            correct_line_start = token.symbol == line_start.symbol 
+                || (line_start.number > 0 && token.number == line_start.number);
+            token = peek_token(t);
+            if (!correct_line_start) {
+                break;
+            }
+        }
+        
+        token = next_token(t);
+        if (line_start.number > 0 && peek_token(t).symbol == '.') {
+            next_token(t);
+        }
+        
+        node = arena_push_dom_node(arena, node);
+        node->type = Dom_List_Item;
+        node->list_item.seq = parse_markdown_text_line(t, arena, next_token(t));
+    }
+    
+    result.last = node;
+    return result;
+}
+
+// Forward declare
+Dom read_markdown_file_ex(cstring filename, Memory_Arena* arena);
+Dom read_markdown_file_internal(cstring filename, Memory_Arena* arena, bool defer_includes);
+
+// NOTE(Alexander): process wide cache of parsed @include files keyed by their canonical path,
+// entries are revalidated against the file size and modification time on every lookup.
+// The cached dom is unexpanded, its own @include nodes are left empty and are expanded by every
+// page that includes it (see include_expand), so each nested file is revalidated on its own and
+// the result doesn't depend on which page parsed the file first.
+// Pages reference the cached nodes through Dom_Include nodes, so replaced entries are
+// kept alive until include_cache_free_retired is called once no page of the build is left.
+typedef struct Include_Cache_Entry Include_Cache_Entry;
+struct Include_Cache_Entry {
+    cstring filepath;
+    u64 size;
+    u64 modified_time;
+    Memory_Arena arena;
+    Dom dom;
+    Include_Cache_Entry* next_retired;
+};
+
+typedef struct {
+    Mutex mutex;
+    String_Map entries;
+    Memory_Arena keys; // NOTE(Alexander): the map keys, entries are freed once they're retired
+    Include_Cache_Entry* retired;
+} Include_Cache;
+
+static Include_Cache global_include_cache = { MUTEX_INITIALIZER };
+
+void
+include_cache_free_entry(Include_Cache_Entry* entry) {
+    free_dom_sources(&entry->dom);
+    arena_clear(&entry->arena);
+    free(entry);
+}
+
+void
+include_cache_free_retired(void) {
+    Include_Cache* cache = &global_include_cache;
+    mutex_lock(&cache->mutex);
+    while (cache->retired) {
+        Include_Cache_Entry* entry = cache->retired;
+        cache->retired = entry->next_retired;
+        include_cache_free_entry(entry);
+    }
+    mutex_unlock(&cache->mutex);
+}
+
+void
+include_cache_clear(void) {
+    Include_Cache* cache = &global_include_cache;
+    mutex_lock(&cache->mutex);
+    for (u32 i = 0; i < cache->entries.capacity; i++) {
+        Include_Cache_Entry* entry = (Include_Cache_Entry*) cache->entries.entries[i].value;
+        if (entry) {
+            include_cache_free_entry(entry);
+        }
+    }
+    string_map_free(&cache->entries);
+    arena_clear(&cache->keys);
+    mutex_unlock(&cache->mutex);
+    
+    include_cache_free_retired();
+}
+
+// NOTE(Alexander): the mutex has to be held, the key is only copied the first time the file is cached
+void
+include_cache_put(Include_Cache* cache, Include_Cache_Entry* entry) {
+    string key = string_lit(entry->filepath);
+    if (cache->entries.count == 0 || !string_map_find_entry(&cache->entries, key, string_hash(key))->key.data) {
+        key = string_lit(arena_push_format(&cache->keys, "%s", entry->filepath));
+    }
+    string_map_put(&cache->entries, key, entry);
+}
+
+// NOTE(Alexander): forces the next lookup of the file to parse it again, even if the size and
+// modification time are unchanged, filepath has to be the canonical path.
+void
+include_cache_invalidate(cstring filepath) {
+    Include_Cache* cache = &global_include_cache;
+    mutex_lock(&cache->mutex);
+    Include_Cache_Entry* entry = (Include_Cache_Entry*) string_map_get(&cache->entries, string_lit(filepath));
+    if (entry) {
+        entry->next_retired = cache->retired;
+        cache->retired = entry;
+        string_map_put(&cache->entries, string_lit(filepath), 0);
+    }
+    mutex_unlock(&cache->mutex);
+}
+
+// NOTE(Alexander): filepath has to be the canonical path, the returned dom is unexpanded
+Include_Cache_Entry*
+include_cache_get(cstring filepath) {
+    File_Info info = platform_get_file_info(filepath);
+    Include_Cache* cache = &global_include_cache;
+    mutex_lock(&cache->mutex);
+    Include_Cache_Entry* entry = (Include_Cache_Entry*) string_map_get(&cache->entries, string_lit(filepath));
+    mutex_unlock(&cache->mutex);
+    if (entry && entry->size == info.size && entry->modified_time == info.modified_time) {
+        return entry;
+    }
+    
+    // NOTE(Alexander): parse outside the lock so other files can be looked up meanwhile
+    Include_Cache_Entry* new_entry = (Include_Cache_Entry*) calloc(1, sizeof(Include_Cache_Entry));
+    new_entry->size = info.size;
+    new_entry->modified_time = info.modified_time;
+    new_entry->filepath = arena_push_format(&new_entry->arena, "%s", filepath);
+    new_entry->dom = read_markdown_file_internal(new_entry->filepath, &new_entry->arena, true);
+    
+    mutex_lock(&cache->mutex);
+    entry = (Include_Cache_Entry*) string_map_get(&cache->entries, string_lit(filepath));
+    if (entry && entry->size == new_entry->size && entry->modified_time == new_entry->modified_time) {
+        // NOTE(Alexander): another thread got there first
+        include_cache_free_entry(new_entry);
+    } else {
+        if (entry) {
+            entry->next_retired = cache->retired;
+            cache->retired = entry;
+        }
+        entry = new_entry;
+        include_cache_put(cache, entry);
+    }
+    mutex_unlock(&cache->mutex);
+    
+    return entry;
+}
+
+// NOTE(Alexander): the files that are currently being expanded, innermost first
+typedef struct Include_Chain Include_Chain;
+struct Include_Chain {
+    cstring filepath;
+    Include_Chain* parent;
+};
+
+// NOTE(Alexander): points an include node at the cached dom of its file. Cached doms are shared so
+// their own include nodes are never expanded in place, if the file includes other files its top-level
+// nodes are copied into the arena instead and the copied include nodes are expanded recursively,
+// nested dependencies are added to dom. Includes already in the chain are cyclic and left empty.
+void
+include_expand(Dom_Node* node, Memory_Arena* arena, Dom* dom, Include_Chain* chain, bool quiet) {
+    char filepath[4096];
+    if (!platform_get_full_path(node->include.filename, filepath, sizeof(filepath))) {
+        if (!quiet) {
+            printf("File `%s` was not found!\n", node->include.filename);
+        }
+        return;
+    }
+    
+    for (Include_Chain* it = chain; it; it = it->parent) {
+        if (it->filepath && strcmp(it->filepath, filepath) == 0) {
+            if (!quiet) {
+                printf("Cyclic @include of `%s` was ignored!\n", node->include.filename);
+            }
+            return;
+        }
+    }
+    
+    Include_Cache_Entry* entry = include_cache_get(filepath);
+    if (!entry->dom.dependencies) {
+        node->include.seq = entry->dom.seq;
+        return;
+    }
+    
+    Include_Chain link;
+    link.filepath = entry->filepath;
+    link.parent = chain;
+    
+    Dom_Node* last = 0;
+    for (Dom_Node* it = entry->dom.seq.first; it; it = it->next) {
+        Dom_Node* copy = arena_push_dom_node(arena, last);
+        *copy = *it;
+        copy->next = 0;
+        if (!last) {
+            node->include.seq.first = copy;
+        }
+        last = copy;
+        
+        if (copy->type == Dom_Include) {
+            if (dom) {
+                Dom_Dependency* dependency = arena_push_struct(arena, Dom_Dependency);
+                dependency->filename = copy->include.filename;
+                dependency->next = dom->dependencies;
+                dom->dependencies = dependency;
+            }
+            include_expand(copy, arena, dom, &link, quiet);
+        }
+    }
+    node->include.seq.last = last;
+}
+
+// NOTE(Alexander): the info string after the opening fence selects the highlighted language
+Code_Block_Language
+parse_code_block_language(string info) {
+    static cstring c_names[] = { "c", "h", "cpp", "c++", "cc" };
+    for (int i = 0; i < array_count(c_names); i++) {
+        string name = string_lit(c_names[i]);
+        if (info.count == name.count && memcmp(info.data, name.data, name.count) == 0) {
+            return CodeBlockLanguage_C;
+        }
+    }
+    return CodeBlockLanguage_None;
+}
+
+// NOTE(Alexander): fenced code block, the body is everything up to a line starting with at least
+// as many backticks as the opening fence (or the end of input) and points directly into the source.
+// Candidate fences are found with memchr so the body is never tokenized.
+Dom_Node*
+parse_markdown_code_block(Tokenizer* t, Memory_Arena* arena, Token fence) {
+    char* curr = t->peeked.symbol ? t->peeked.text.data : t->curr;
+    t->peeked.symbol = 0;
+    
+    string info;
+    info.data = curr;
+    while (curr < t->end && !is_end_of_line(*curr)) curr++;
+    info.count = curr - info.data;
+    while (info.count > 0 && is_whitespace(info.data[0])) {
+        info.data++;
+        info.count--;
+    }
+    while (info.count > 0 && is_whitespace(info.data[info.count - 1])) info.count--;
+    
+    if (curr < t->end && *curr == '\r') curr++;
+    if (curr < t->end && *curr == '\n') curr++;
+    
+    char* body = curr;
+    char* body_end = t->end;
+    char* next = t->end;
+    while (curr < t->end) {
+        char* found = (char*) memchr(curr, '`', t->end - curr);
+        if (!found) {
+            break;
+        }
+        
+        char* line = found;
+        while (line > curr && is_whitespace_no_new_line(line[-1])) line--;
+        char* run_end = found;
+        while (run_end < t->end && *run_end == '`') run_end++;
+        curr = run_end;
+        
+        if ((line == body || is_end_of_line(line[-1])) && run_end - found >= fence.text.count) {
+            char* line_end = run_end;
+            while (line_end < t->end && is_whitespace_no_new_line(*line_end)) line_end++;
+            if (line_end == t->end || is_end_of_line(*line_end)) {
+                body_end = line;
+                next = line_end;
+                if (next < t->end && *next == '\r') next++;
+                if (next < t->end && *next == '\n') next++;
+                break;
+            }
+        }
+    }
+    t->curr = next;
+    t->reached_end |= next == t->end;
+    
+    Dom_Node* node = arena_push_dom_node(arena, 0);
+    node->type = Dom_Code_Block;
+    node->text.data = body;
+    node->text.count = body_end - body;
+    node->code_block.language = parse_code_block_language(info);
+    return node;
+}
+
+// NOTE(Alexander): returns null and rewinds if it's not a valid macro
+Dom_Node*
+parse_markdown_macro(Tokenizer* t, Memory_Arena* arena) {
+    Tokenizer saved = *t;
+    Token token = next_token(t);
+    
+    // TODO(alexander): probably not how we should detect macro definitions
+    const string include_literal = string_lit("include");
+    
+    bool quiet = token.text.data < t->quiet_end;
+    if (!string_equals(token.text, include_literal) || !peek_token(t).whitespace) {
+        if (!quiet) {
+            printf("Parsed unexpected macro: %.*s\n", (int) token.text.count, token.text.data);
+        }
+        tokenizer_rewind(t, &saved);
+        return 0;
+    }
+    next_token(t);
+    
+    string filename;
+    zero_struct(filename);
+    if (next_token(t).symbol == '"' && peek_token(t).symbol != '"') {
+        token = next_token(t);
+        filename.data = token.text.data;
+        while (token.symbol != '"' && !token.new_line) {
+            filename.count += token.text.count;
+            token = next_token(t);
+        }
+        
+        if (token.symbol == '"') {
+            next_token(t);
+        } else {
+            filename.count = 0;
+        }
+    }
+    
+    if (filename.count == 0) {
+        if (!quiet) {
+            printf("Invalid @include declaration, expected @include \"filename\"\n");
+        }
+        tokenizer_rewind(t, &saved);
+        return 0;
+    }
+    
+    Dom_Node* node = arena_push_dom_node(arena, 0);
+    node->type = Dom_Include;
+    node->include.filename = arena_push_format(arena, "%.*s", (int) filename.count, filename.data);
+    
+    if (t->dom) {
+        Dom_Dependency* dependency = arena_push_struct(arena, Dom_Dependency);
+        dependency->filename = node->include.filename;
+        dependency->next = t->dom->dependencies;
+        t->dom->dependencies = dependency;
+    }
+    
+    if (!t->defer_includes) {
+        Include_Chain chain;
+        chain.filepath = t->filepath;
+        chain.parent = 0;
+        
+        PROFILE_BEGIN(Include, node->include.filename);
+        include_expand(node, arena, t->dom, &chain, quiet);
+        PROFILE_END();
+    }
+    return node;
+}
+
+// NOTE(Alexander): returns null and rewinds if it's not a valid image
+Dom_Node*
+parse_markdown_image(Tokenizer* t, Memory_Arena* arena) {
+    Tokenizer saved = *t;
+    string alt = parse_enclosed_string(t, '[', ']');
+    string src = parse_enclosed_string(t, '(', ')');
+    if (src.count == 0 || alt.count == 0) {
+        tokenizer_rewind(t, &saved);
+        return 0;
+    }
+    
+    Dom_Node* node = arena_push_dom_node(arena, 0);
+    node->type = Dom_Image;
+    node->image.source = src;
+    node->text = alt;
+    return node;
+}
+
+Dom_Sequence
+parse_markdown_line(Tokenizer* t, Memory_Arena* arena, Dom_Node* prev_node) {
+    Dom_Sequence result;
+    zero_struct(result);
+    
+    Token token = next_token(t);
+    for (;;) {
+        if (!token.symbol) {
+            return result;
+        }
+        
+        if (token.whitespace) {
+            token = next_token(t);
+            continue;
+        }
+        
+        break;
+    }
+    
+    int indent = 0;
+    if (token.whitespace) {
+        indent = (int) token.text.count; // TODO(Alexander): tabs count as one indentation unit
+        token = next_token(t);
+    }
+    
+    // NOTE(Alexander): remove emacs -*- encoding: utf-8 -*- crap
+    if (token.symbol == '-' && peek_token(t).symbol == '*') {
+        Tokenizer temp_t = *t;
+        next_token(&temp_t);
+        Token temp_token = next_token(&temp_t);
+        if (temp_token.symbol == '-') {
+            temp_token = next_token(&temp_t);
+            while (!temp_token.new_line) {
+                temp_token = next_token(&temp_t);
+            }
+            *t = temp_t;
+            token = next_token(t);
+        }
+        t->reached_end |= temp_t.reached_end;
+    }
+    
+    // NOTE(Alexander): macros and images that fail to parse are kept as paragraph text
+    Dom_Node* parsed_node = 0;
+    if (indent == 0 && token.symbol == '@' && token.text.count == 1 && !peek_token(t).whitespace) {
+        parsed_node = parse_markdown_macro(t, arena);
+    } else if (token.symbol == '!' && peek_token(t).symbol == '[') {
+        parsed_node = parse_markdown_image(t, arena);
+    }
+    
+    if (parsed_node) {
+        result.first = parsed_node;
+        
+    } else if (indent == 0 && token.symbol == '#' && peek_token(t).whitespace) {
+        next_token(t);
+        Token begin = next_token(t);
+        Token end = begin;
+        while (!end.new_line) {
+            end = next_token(t);
+        }
+        
+        Dom_Node* node = arena_push_dom_node(arena, 0);
+        node->type = Dom_Heading;
+        node->text.data = begin.text.data;
+        node->text.count = (umm) (end.text.data - begin.text.data);
+        node->heading.level = (int) token.text.count;
+        result.first = node;
+        
+    } else if (is_unordered_list_symbol(token.symbol) && peek_token(t).whitespace) {
+        Dom_Node* node = arena_push_dom_node(arena, 0);
+        node->type = Dom_Unordered_List;
+        node->unordered_list.seq = parse_markdown_list(t, arena, token, indent);
+        result.first = node;
+        
+    } else if (token.number >= 0 && peek_token(t).symbol == '.') {
+        Dom_Node* node = arena_push_dom_node(arena, 0);
+        node->type = Dom_Ordered_List;
+        node->ordered_list.seq = parse_markdown_list(t, arena, token, indent);
+        result.first = node;
+        
+    } else if (token.symbol == '`' && token.text.count >= 3) {
+        result.first = parse_markdown_code_block(t, arena, token);
+        
+    } else {
+        if (!token.new_line && prev_node->type == Dom_Paragraph) {
+            // Join the two sequence of nodes into single paragraph node
+            Dom_Sequence next_seq = parse_markdown_text_line(t, arena, token);
+            result.first = prev_node;
+            result.first->paragraph.seq.last->next = next_seq.first;
+            result.first->paragraph.seq.last = next_seq.last;
+        } else {
+            Dom_Node* node = arena_push_dom_node(arena, 0);
+            node->type = Dom_Paragraph;
+            node->paragraph.seq = parse_markdown_text_line(t, arena, token);
+            result.first = node;
+        }
+    }
+    
+    if (result.last == 0) {
+        result.last = result.first;
+    }
+    
+    return result;
+}
+
+// NOTE(Alexander): filepath is the canonical path of the source, if any, to detect cyclic includes
+void
+parse_markdown_internal(Dom* result, string source, Memory_Arena* arena, cstring filepath, bool defer_includes) {
+    Tokenizer tokenizer;
+    zero_struct(tokenizer);
+    
+    Tokenizer* t = &tokenizer;
+    t->base = source.data;
+    t->curr = t->base;
+    t->end = t->curr + source.count;
+    t->dom = result;
+    t->filepath = filepath;
+    t->defer_includes = defer_includes;
+    
+    Dom_Node* root = arena_push_dom_node(arena, 0);
+    root->type = Dom_Root;
+    result->seq.first = root;
+    Dom_Node* curr_node = root;
+    
+    while (true) {
+        Dom_Sequence nodes = parse_markdown_line(t, arena, curr_node);
+        if (!nodes.first || nodes.first->type == Dom_None) {
+            break;
+        }
+        
+        if (nodes.first != curr_node) {
+            curr_node->next = nodes.first;
+            curr_node = nodes.last;
+        }
+    }
+    result->seq.last = curr_node;
+}
+
+Dom
+read_markdown_file_internal(cstring filename, Memory_Arena* arena, bool defer_includes) {
+    Dom result;
+    zero_struct(result);
+    
+    PROFILE_BEGIN(Read, filename);
+    Mapped_File file = map_entire_file(filename);
+    PROFILE_END();
+    if (!file.contents.data) {
+        return result;
+    }
+    
+    PROFILE_BEGIN(Parse, filename);
+    result.sources = arena_push_struct(arena, Dom_Source);
+    result.sources->file = file;
+    
+    char filepath[4096];
+    bool has_filepath = platform_get_full_path(filename, filepath, sizeof(filepath));
+    parse_markdown_internal(&result, file.contents, arena, has_filepath ? filepath : 0, defer_includes);
+    PROFILE_END();
+    
+    return result;
+}
+
+// NOTE(Alexander): parses markdown from memory, e.g. loaded from a database. The nodes point directly
+// into source so it has to outlive the dom, @include is resolved from the working directory.
+Dom
+parse_markdown_buffer(string source, Memory_Arena* arena) {
+    Dom result;
+    zero_struct(result);
+    
+    PROFILE_BEGIN(Parse, 0);
+    parse_markdown_internal(&result, source, arena, 0, false);
+    PROFILE_END();
+    
+    return result;
+}
+
+Dom
+read_markdown_file_ex(cstring filename, Memory_Arena* arena) {
+    return read_markdown_file_internal(filename, arena, false);
+}
+
+inline Dom
+read_markdown_file(cstring filename) {
+    Memory_Arena arena;
+    zero_struct(arena);
+    return read_markdown_file_ex(filename, &arena);
+}
+
+// NOTE(Alexander): output sink for generated html, arena sinks append directly to the arena,
+// file and callback sinks buffer up to a fixed size buffer and flush when it's full.
+typedef void Output_Sink_Callback(void* user_data, char* data, umm count);
+
+// NOTE(Alexander): optionally rewrites image and link targets while rendering, returns the url to
+// write, either url itself or a string written to buffer.
+typedef string Url_Rewrite_Callback(void* user_data, string url, char* buffer, umm buffer_size);
+
+typedef enum {
+    OutputSink_Arena,
+    OutputSink_File,
+    OutputSink_Callback,
+} Output_Sink_Type;
+
+typedef struct {
+    Output_Sink_Type type;
+    
+    char* buffer;
+    umm buffer_size;
+    umm buffer_used;
+    
+    Memory_Arena* arena;
+    int fd;
+    Output_Sink_Callback* callback;
+    void* user_data;
+    
+    umm bytes_written;
+    bool failed;
+    
+    Url_Rewrite_Callback* rewrite_url;
+    void* rewrite_url_data;
+    
+    // NOTE(Alexander): renders the html without indentation and with the whitespace in the text
+    // collapsed. A space is only pushed (pending_space) once it's followed by more inline content and
+    // after_space is set when any following whitespace is insignificant.
+    bool minify;
+    bool after_space;
+    bool pending_space;
+} Output_Sink;
+
+#define OUTPUT_SINK_DEFAULT_BUFFER_SIZE (64*1024)
+
+inline Output_Sink
+output_sink_arena(Memory_Arena* arena) {
+    Output_Sink result;
+    zero_struct(result);
+    result.type = OutputSink_Arena;
+    result.arena = arena;
+    return result;
+}
+
+// NOTE(Alexander): the buffer is owned by the caller, e.g. on the stack
+inline Output_Sink
+output_sink_file(int fd, char* buffer, umm buffer_size) {
+    Output_Sink result;
+    zero_struct(result);
+    result.type = OutputSink_File;
+    result.fd = fd;
+    result.buffer = buffer;
+    result.buffer_size = buffer_size;
+    return result;
+}
+
+inline Output_Sink
+output_sink_callback(Output_Sink_Callback* callback, void* user_data, char* buffer, umm buffer_size) {
+    Output_Sink result;
+    zero_struct(result);
+    result.type = OutputSink_Callback;
+    result.callback = callback;
+    result.user_data = user_data;
+    result.buffer = buffer;
+    result.buffer_size = buffer_size;
+    return result;
+}
+
+void
+sink_write_unbuffered(Output_Sink* sink, char* data, umm count) {
+    if (count == 0) {
+        return;
+    }
+    
+    switch (sink->type) {
+        case OutputSink_Arena: {
+            void* dest = arena_push_size(sink->arena, count, 1);
+            memcpy(dest, data, count);
+        } break;
+        
+        case OutputSink_File: {
+            if (!sink->failed && !platform_write_file(sink->fd, data, count)) {
+                sink->failed = true;
+            }
+        } break;
+        
+        case OutputSink_Callback: {
+            sink->callback(sink->user_data, data, count);
+        } break;
+    }
+    sink->bytes_written += count;
+}
+
+void
+sink_flush(Output_Sink* sink) {
+    sink_write_unbuffered(sink, sink->buffer, sink->buffer_used);
+    sink->buffer_used = 0;
+}
+
+void
+sink_push_string(Output_Sink* sink, string str) {
+    if (str.count == 0) {
+        return;
+    }
+    
+    if (sink->buffer_used + str.count > sink->buffer_size) {
+        sink_flush(sink);
+        if (str.count >= sink->buffer_size) {
+            // NOTE(Alexander): large strings are written directly, avoiding the extra copy
+            sink_write_unbuffered(sink, str.data, str.count);
+            return;
+        }
+    }
+    
+    memcpy(sink->buffer + sink->buffer_used, str.data, str.count);
+    sink->buffer_used += str.count;
+}
+
+inline void
+sink_push_cstring(Output_Sink* sink, cstring str) {
+    sink_push_string(sink, string_lit(str));
+}
+
+void
+sink_push_url(Output_Sink* sink, string url) {
+    char buffer[4096];
+    if (sink->rewrite_url) {
+        url = sink->rewrite_url(sink->rewrite_url_data, url, buffer, sizeof(buffer));
+    }
+    sink_push_string(sink, url);
+}
+
+void
+sink_push_new_line(Output_Sink* sink, int trailing_spaces) {
+    if (sink->minify) {
+        // NOTE(Alexander): only used between block elements, where whitespace is insignificant
+        sink->after_space = true;
+        sink->pending_space = false;
+        return;
+    }
+    
+    char buffer[65];
+    buffer[0] = '\n';
+    memset(buffer + 1, ' ', sizeof(buffer) - 1);
+    
+    string str;
+    str.data = buffer;
+    str.count = 1 + min(trailing_spaces, 64);
+    sink_push_string(sink, str);
+    trailing_spaces -= (int) str.count - 1;
+    
+    while (trailing_spaces > 0) {
+        str.data = buffer + 1;
+        str.count = min(trailing_spaces, 64);
+        sink_push_string(sink, str);
+        trailing_spaces -= (int) str.count;
+    }
+}
+
+// NOTE(Alexander): whitespace between inline elements, collapsed into a single space when minifying
+void
+sink_push_inline_new_line(Output_Sink* sink, int trailing_spaces) {
+    if (sink->minify) {
+        sink->pending_space |= !sink->after_space;
+    } else {
+        sink_push_new_line(sink, trailing_spaces);
+    }
+}
+
+// NOTE(Alexander): called before inline content that whitespace can't be moved past, e.g. images
+inline void
+sink_push_pending_space(Output_Sink* sink) {
+    if (sink->pending_space) {
+        sink_push_cstring(sink, " ");
+        sink->pending_space = false;
+        sink->after_space = true;
+    }
+}
+
+// NOTE(Alexander): finds the first run of two or more whitespace characters. On x64 the whitespace
+// bytes of two overlapping 16 byte loads are compared exactly (' ' and '\t' to '\r', the same as the
+// table), the last window overlaps the previous one so there's no tail. Shorter text, or without SIMD,
+// is checked by the table into a mask of whitespace bytes without branching on every byte.
+char*
+find_whitespace_pair(char* curr, char* end) {
+#if GENERATOR_SIMD_X64
+    if (end - curr >= 17) {
+        char* last = end - 17;
+        for (;;) {
+            if (curr > last) {
+                curr = last;
+            }
+            
+            __m128i x = _mm_loadu_si128((__m128i*) curr);
+            __m128i y = _mm_loadu_si128((__m128i*) (curr + 1));
+            __m128i x_space = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), SSE2_IN_RANGE(x, '\t', '\r'));
+            __m128i y_space = _mm_or_si128(_mm_cmpeq_epi8(y, _mm_set1_epi8(' ')), SSE2_IN_RANGE(y, '\t', '\r'));
+            u32 mask = (u32) _mm_movemask_epi8(_mm_and_si128(x_space, y_space));
+            if (mask) {
+                return curr + bit_scan_forward_u32(mask);
+            }
+            if (curr == last) {
+                return end;
+            }
+            curr += 16;
+        }
+    }
+#endif
+    
+    while (end - curr >= 2) {
+        umm count = min(end - curr, 17);
+        u32 mask = 0;
+        for (umm i = 0; i < count; i++) {
+            mask |= (u32) is_whitespace(curr[i]) << i;
+        }
+        
+        mask &= mask >> 1;
+        if (mask) {
+            while (!(mask & 1)) {
+                mask >>= 1;
+                curr++;
+            }
+            return curr;
+        }
+        curr += count - 1;
+    }
+    return end;
+}
+
+// NOTE(Alexander): pushes the text of a node, runs of whitespace are collapsed into a single space
+// when minifying and dropped entirely if the previous text already ended with whitespace. Single
+// whitespace characters (e.g. the new line ending each line of a paragraph) are kept as is, so text
+// without longer runs is pushed in one piece.
+void
+sink_push_text(Output_Sink* sink, string text) {
+    if (!sink->minify) {
+        sink_push_string(sink, text);
+        return;
+    }
+    
+    char* curr = text.data;
+    char* end = curr + text.count;
+    while (curr < end) {
+        if (is_whitespace(*curr) && (sink->after_space || sink->pending_space || 
+                                     (curr + 1 < end && is_whitespace(curr[1])))) {
+            while (curr < end && is_whitespace(*curr)) curr++;
+            sink->pending_space |= !sink->after_space;
+            continue;
+        }
+        
+        // NOTE(Alexander): the pending space is usually the last space of the skipped run, then it's
+        // pushed together with the chunk instead of on its own
+        string chunk;
+        chunk.data = curr;
+        if (sink->pending_space && curr > text.data && curr[-1] == ' ') {
+            chunk.data--;
+            sink->pending_space = false;
+        } else {
+            sink_push_pending_space(sink);
+        }
+        curr = find_whitespace_pair(curr + 1, end);
+        chunk.count = curr - chunk.data;
+        sink_push_string(sink, chunk);
+        sink->after_space = is_whitespace(curr[-1]);
+    }
+}
+
+// NOTE(Alexander): pushes text with the html special characters escaped
+void
+sink_push_escaped_html(Output_Sink* sink, string text) {
+    char* begin = text.data;
+    char* end = text.data + text.count;
+    for (char* curr = begin; curr < end; curr++) {
+        cstring entity;
+        switch (*curr) {
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '&': entity = "&amp;"; break;
+            case '"': entity = "&quot;"; break;
+            default: continue;
+        }
+        
+        string run;
+        run.data = begin;
+        run.count = curr - begin;
+        sink_push_string(sink, run);
+        sink_push_cstring(sink, entity);
+        begin = curr + 1;
+    }
+    
+    string run;
+    run.data = begin;
+    run.count = end - begin;
+    sink_push_string(sink, run);
+}
+
+// NOTE(Alexander): table driven C syntax highlighter, emits <span class="..."> around keywords (kw),
+// types (ty), numbers (num), strings and characters (str), comments (com) and preprocessor
+// directives (pp). Everything else is escaped and passed through.
+enum {
+    CChar_Other,
+    CChar_Identifier,
+    CChar_Digit,
+    CChar_Quote,
+    CChar_Slash,
+    CChar_Hash,
+};
+
+static u8 c_char_class_table[256];
+
+static cstring c_keywords[] = {
+    "auto", "break", "case", "const", "continue", "default", "do", "else", "enum", "extern", "for",
+    "goto", "if", "inline", "register", "restrict", "return", "sizeof", "static", "struct", "switch",
+    "typedef", "union", "volatile", "while", "true", "false", "NULL", "class", "namespace", "template",
+    "public", "private", "protected", "new", "delete", "nullptr", "using", "operator", "virtual",
+};
+
+static cstring c_types[] = {
+    "void", "char", "short", "int", "long", "float", "double", "signed", "unsigned", "bool", "_Bool",
+    "size_t", "ptrdiff_t", "int8_t", "int16_t", "int32_t", "int64_t", "uint8_t", "uint16_t",
+    "uint32_t", "uint64_t", "u8", "u16", "u32", "u64", "s8", "s16", "s32", "s64", "f32", "f64",
+    "umm", "smm", "string", "cstring", "FILE",
+};
+
+typedef struct {
+    string word;
+    cstring span_class;
+} C_Word;
+
+#define C_WORD_TABLE_SIZE 256 // NOTE(Alexander): power of two, at least twice the keywords and types
+
+static C_Word c_word_table[C_WORD_TABLE_SIZE];
+static volatile u32 c_highlight_tables_initialized;
+static Mutex c_highlight_tables_mutex = MUTEX_INITIALIZER;
+
+void
+c_word_table_insert(cstring word, cstring span_class) {
+    string key = string_lit(word);
+    for (u32 i = (u32) string_hash(key);; i++) {
+        C_Word* entry = &c_word_table[i & (C_WORD_TABLE_SIZE - 1)];
+        if (!entry->word.data) {
+            entry->word = key;
+            entry->span_class = span_class;
+            return;
+        }
+        if (string_equals(entry->word, key)) {
+            return;
+        }
+    }
+}
+
+void
+c_highlight_init_tables(void) {
+    for (int c = 'a'; c <= 'z'; c++) c_char_class_table[c] = CChar_Identifier;
+    for (int c = 'A'; c <= 'Z'; c++) c_char_class_table[c] = CChar_Identifier;
+    for (int c = '0'; c <= '9'; c++) c_char_class_table[c] = CChar_Digit;
+    c_char_class_table['_'] = CChar_Identifier;
+    c_char_class_table['"'] = CChar_Quote;
+    c_char_class_table['\''] = CChar_Quote;
+    c_char_class_table['/'] = CChar_Slash;
+    c_char_class_table['#'] = CChar_Hash;
+    
+    for (int i = 0; i < array_count(c_keywords); i++) c_word_table_insert(c_keywords[i], "kw");
+    for (int i = 0; i < array_count(c_types); i++) c_word_table_insert(c_types[i], "ty");
+}
+
+// NOTE(Alexander): the tables are built once by the first thread, the others wait on the mutex
+inline void
+c_highlight_ensure_tables(void) {
+    if (atomic_load_u32(&c_highlight_tables_initialized)) {
+        return;
+    }
+    
+    mutex_lock(&c_highlight_tables_mutex);
+    if (!c_highlight_tables_initialized) {
+        c_highlight_init_tables();
+        atomic_add_u32(&c_highlight_tables_initialized, 1);
+    }
+    mutex_unlock(&c_highlight_tables_mutex);
+}
+
+cstring
+c_word_span_class(string word) {
+    for (u32 i = (u32) string_hash(word);; i++) {
+        C_Word* entry = &c_word_table[i & (C_WORD_TABLE_SIZE - 1)];
+        if (!entry->word.data) {
+            return 0;
+        }
+        if (string_equals(entry->word, word)) {
+            return entry->span_class;
+        }
+    }
+}
+
+inline void
+sink_push_span(Output_Sink* sink, cstring span_class, char* begin, char* end) {
+    string text;
+    text.data = begin;
+    text.count = end - begin;
+    sink_push_cstring(sink, "<span class=\"");
+    sink_push_cstring(sink, span_class);
+    sink_push_cstring(sink, "\">");
+    sink_push_escaped_html(sink, text);
+    sink_push_cstring(sink, "</span>");
+}
+
+void
+highlight_c_to_sink(Output_Sink* sink, string source) {
+    c_highlight_ensure_tables();
+    
+    char* curr = source.data;
+    char* end = source.data + source.count;
+    char* plain = curr; // NOTE(Alexander): start of the text not highlighted yet
+    bool line_start = true;
+    
+    while (curr < end) {
+        char* begin = curr;
+        cstring span_class = 0;
+        
+        switch (c_char_class_table[(u8) *curr]) {
+            case CChar_Identifier: {
+                while (curr < end && c_char_class_table[(u8) *curr] >= CChar_Identifier && 
+                       c_char_class_table[(u8) *curr] <= CChar_Digit) {
+                    curr++;
+                }
+                string word;
+                word.data = begin;
+                word.count = curr - begin;
+                span_class = c_word_span_class(word);
+            } break;
+            
+            case CChar_Digit: {
+                // NOTE(Alexander): also covers hex, suffixes and exponents, e.g. 0xFFu and 1.5e3f
+                while (curr < end && (c_char_class_table[(u8) *curr] == CChar_Identifier ||
+                                      c_char_class_table[(u8) *curr] == CChar_Digit || *curr == '.')) {
+                    curr++;
+                }
+                span_class = "num";
+            } break;
+            
+            case CChar_Quote: {
+                char quote = *curr++;
+                while (curr < end && *curr != quote && !is_end_of_line(*curr)) {
+                    if (*curr == '\\' && curr + 1 < end) curr++;
+                    curr++;
+                }
+                if (curr < end && *curr == quote) curr++;
+                span_class = "str";
+            } break;
+            
+            case CChar_Slash: {
+                curr++;
+                if (curr < end && *curr == '/') {
+                    while (curr < end && !is_end_of_line(*curr)) curr++;
+                    span_class = "com";
+                } else if (curr < end && *curr == '*') {
+                    curr++;
+                    while (curr < end && !(curr[0] == '*' && curr + 1 < end && curr[1] == '/')) curr++;
+                    curr = min(curr + 2, end);
+                    span_class = "com";
+                }
+            } break;
+            
+            case CChar_Hash: {
+                curr++;
+                if (line_start) {
+                    while (curr < end && is_whitespace_no_new_line(*curr)) curr++;
+                    while (curr < end && c_char_class_table[(u8) *curr] == CChar_Identifier) curr++;
+                    span_class = "pp";
+                }
+            } break;
+            
+            default: {
+                curr++;
+            } break;
+        }
+        
+        if (span_class) {
+            string text;
+            text.data = plain;
+            text.count = begin - plain;
+            sink_push_escaped_html(sink, text);
+            sink_push_span(sink, span_class, begin, curr);
+            plain = curr;
+        }
+        
+        if (is_end_of_line(curr[-1])) {
+            line_start = true;
+        } else if (!is_whitespace_no_new_line(curr[-1])) {
+            line_start = false;
+        }
+    }
+    
+    string text;
+    text.data = plain;
+    text.count = end - plain;
+    sink_push_escaped_html(sink, text);
+}
+
+// NOTE(Alexander): process wide cache of highlighted code blocks, the same snippets tend to show up
+// on many pages. Only highlighted languages are cached, there is one map per language keyed by the
+// content hash of the block (the key points at hash in the entry). Entries live until
+// highlight_cache_clear is called at the end of every site build, no page may be rendered while it
+// runs. Once the cache holds HIGHLIGHT_CACHE_MAX_SIZE bytes new blocks aren't cached anymore.
+#define HIGHLIGHT_CACHE_MAX_SIZE (16*1024*1024)
+
+typedef struct {
+    u64 hash;
+    string html;
+} Highlight_Cache_Entry;
+
+typedef struct {
+    Mutex mutex;
+    String_Map entries[CodeBlockLanguage_Count];
+    umm size;
+} Highlight_Cache;
+
+static Highlight_Cache global_highlight_cache = { MUTEX_INITIALIZER };
+
+void
+highlight_cache_clear(void) {
+    Highlight_Cache* cache = &global_highlight_cache;
+    mutex_lock(&cache->mutex);
+    for (int language = 0; language < CodeBlockLanguage_Count; language++) {
+        String_Map* entries = &cache->entries[language];
+        for (u32 i = 0; i < entries->capacity; i++) {
+            Highlight_Cache_Entry* entry = (Highlight_Cache_Entry*) entries->entries[i].value;
+            if (entry) {
+                free(entry->html.data);
+                free(entry);
+            }
+        }
+        string_map_free(entries);
+    }
+    cache->size = 0;
+    mutex_unlock(&cache->mutex);
+}
+
+void
+highlight_cache_sink_callback(void* user_data, char* data, umm count) {
+    string str;
+    str.data = data;
+    str.count = count;
+    string_builder_push_string((String_Builder*) user_data, str);
+}
+
+inline void
+highlight_code_uncached(Output_Sink* sink, string code, Code_Block_Language language) {
+    if (language == CodeBlockLanguage_C) {
+        highlight_c_to_sink(sink, code);
+    } else {
+        sink_push_escaped_html(sink, code);
+    }
+}
+
+// NOTE(Alexander): pushes the highlighted html of the code, code in other languages is only escaped
+void
+highlight_code_to_sink(Output_Sink* sink, string code, Code_Block_Language language) {
+    if (language == CodeBlockLanguage_None) {
+        sink_push_escaped_html(sink, code);
+        return;
+    }
+    
+    Highlight_Cache* cache = &global_highlight_cache;
+    String_Map* entries = &cache->entries[language];
+    u64 hash = string_content_hash(code);
+    string key;
+    key.data = (char*) &hash;
+    key.count = sizeof(hash);
+    
+    mutex_lock(&cache->mutex);
+    Highlight_Cache_Entry* entry = (Highlight_Cache_Entry*) string_map_get(entries, key);
+    bool full = cache->size >= HIGHLIGHT_CACHE_MAX_SIZE;
+    mutex_unlock(&cache->mutex);
+    if (entry) {
+        sink_push_string(sink, entry->html);
+        return;
+    }
+    if (full) {
+        highlight_code_uncached(sink, code, language);
+        return;
+    }
+    
+    // NOTE(Alexander): highlight outside the lock
+    Highlight_Cache_Entry* new_entry = (Highlight_Cache_Entry*) malloc(sizeof(Highlight_Cache_Entry));
+    new_entry->hash = hash;
+    
+    char buffer[4096];
+    String_Builder sb;
+    zero_struct(sb);
+    string_builder_alloc(&sb, code.count + code.count/2 + 64);
+    Output_Sink cache_sink = output_sink_callback(highlight_cache_sink_callback, &sb, buffer, sizeof(buffer));
+    highlight_code_uncached(&cache_sink, code, language);
+    sink_flush(&cache_sink);
+    new_entry->html = string_builder_to_string_nocopy(&sb);
+    sink_push_string(sink, new_entry->html);
+    
+    mutex_lock(&cache->mutex);
+    if (string_map_get(entries, key) || cache->size >= HIGHLIGHT_CACHE_MAX_SIZE) {
+        // NOTE(Alexander): another thread got there first or filled the cache
+        free(new_entry->html.data);
+        free(new_entry);
+    } else {
+        key.data = (char*) &new_entry->hash;
+        string_map_put(entries, key, new_entry);
+        cache->size += sizeof(Highlight_Cache_Entry) + new_entry->html.count;
+    }
+    mutex_unlock(&cache->mutex);
+}
+
+void
+sink_push_code_block(Output_Sink* sink, string code, Code_Block_Language language, int depth) {
+    sink_push_new_line(sink, depth);
+    if (language == CodeBlockLanguage_C) {
+        sink_push_cstring(sink, "<pre><code class=\"language-c\">");
+    } else {
+        sink_push_cstring(sink, "<pre><code>");
+    }
+    highlight_code_to_sink(sink, code, language);
+    sink_push_cstring(sink, "</code></pre>");
+    sink->after_space = false;
+}
+
+void
+push_generated_html_from_dom_node(Output_Sink* sink, Dom_Node* node, int depth) {
+    while (node) {
+        switch (node->type) {
+            case Dom_Heading: {
+                if (node->heading.level > 6) node->heading.level = 6;
+                char level = '0' + (char) node->heading.level;
+                char open[] = "<h0>";
+                char close[] = "</h0>";
+                *(open + 2) = level;
+                *(close + 3) = level;
+                
+                sink_push_new_line(sink, depth);
+                sink_push_cstring(sink, open);
+                sink_push_text(sink, node->text);
+                sink_push_cstring(sink, close);
+            } break;
+            
+            case Dom_Paragraph: {
+                sink_push_new_line(sink, depth);
+                sink_push_cstring(sink, "<p>");
+                push_generated_html_from_dom_node(sink, node->paragraph.seq.first, depth + 2);
+                sink_push_cstring(sink, "</p>");
+            } break;
+            
+            case Dom_Unordered_List: {
+                sink_push_new_line(sink, depth);
+                sink_push_cstring(sink, "<ul>");
+                push_generated_html_from_dom_node(sink, node->unordered_list.seq.first, depth + 2);
+                sink_push_cstring(sink, "</ul>");
+            } break;
+            
+            case Dom_Ordered_List: {
+                sink_push_new_line(sink, depth);
+                sink_push_cstring(sink, "<ol>");
+                push_generated_html_from_dom_node(sink, node->unordered_list.seq.first, depth + 2);
+                sink_push_cstring(sink, "</ol>");
+            } break;
+            
+            case Dom_List_Item: {
+                sink_push_new_line(sink, depth);
+                sink_push_cstring(sink, "<li>");
+                push_generated_html_from_dom_node(sink, node->list_item.seq.first, depth + 2);
+                sink_push_cstring(sink, "</li>");
+            } break;
+            
+            case Dom_Image: {
+                sink_push_pending_space(sink);
+                sink_push_cstring(sink, "<img alt=\"");
+                sink_push_string(sink, node->text);
+                sink_push_cstring(sink, "\" src=\"");
+                sink_push_url(sink, node->image.source);
+                sink_push_cstring(sink, "\" width=\"100%\"/>");
+                sink->after_space = false;
+            } break;
+            
+            case Dom_Link: {
+                sink_push_pending_space(sink);
+                sink_push_cstring(sink, "<a href=\"");
+                sink_push_url(sink, node->link.source);
+                sink_push_cstring(sink, "\">");
+                sink_push_text(sink, node->text);
+                sink_push_cstring(sink, "</a>");
+                sink_push_inline_new_line(sink, depth);
+            } break;
+            
+            case Dom_Include: {
+                push_generated_html_from_dom_node(sink, node->include.seq.first, depth);
+            } break;
+            
+            case Dom_Code_Block: {
+                sink_push_code_block(sink, node->text, node->code_block.language, depth);
+            } break;
+            
+            case Dom_Line_Break: {
+                sink_push_cstring(sink, "<br>");
+                sink->pending_space = false;
+                sink->after_space = true;
+            } break;
+            
+            case Dom_Inline_Text: {
+                if (node->text_style) {
+                    sink_push_pending_space(sink);
+                }
+                if (node->text_style & TextStyle_Bold) {
+                    sink_push_cstring(sink, "<strong>");
+                }
+                if (node->text_style & TextStyle_Italics) {
+                    sink_push_cstring(sink, "<em>");
+                }
+                if (node->text_style & TextStyle_Code) {
+                    sink_push_cstring(sink, "<code>");
+                }
+                sink_push_text(sink, node->text);
+                if (node->text_style & TextStyle_Italics) {
+                    sink_push_cstring(sink, "</em>");
+                }
+                if (node->text_style & TextStyle_Bold) {
+                    sink_push_cstring(sink, "</strong>");
+                }
+                if (node->text_style & TextStyle_Code) {
+                    sink_push_cstring(sink, "</code>");
+                }
+            } break;
+            
+            default: break; // NOTE(Alexander): dates aren't rendered
+        }
+        
+        node = node->next;
+    }
+}
+
+string
+convert_memory_arena_to_string(Memory_Arena* arena) {
+    string result;
+    zero_struct(result);
+    
+    Memory_Block_Header* header = (Memory_Block_Header*) arena->base;
+    Memory_Block_Header* first_header = header;
+    while (header) {
+        first_header = header;
+        result.count += header->size_used - sizeof(Memory_Block_Header);
+        header = header->prev;
+    }
+    
+    if (result.count > 0) {
+        result.data = (char*) malloc(result.count + 1);
+        
+        char* dest = result.data;
+        
+        header = first_header;
+        while (header) {
+            umm size = header->size_used - sizeof(Memory_Block_Header);
+            memcpy(dest, header + 1, size);
+            dest += size;
+            
+            // NOTE(Alexander): blocks after the current one are only kept for reuse
+            if (header == (Memory_Block_Header*) arena->base) break;
+            header = header->next;
+        }
+        
+        *dest = 0;
+    }
+    
+    return result;
+}
+
+// NOTE(Alexander): streams the html into the sink and flushes it
+void
+generate_html_from_dom_to_sink(Dom* dom, Output_Sink* sink) {
+    PROFILE_BEGIN(Render, 0);
+    push_generated_html_from_dom_node(sink, dom->seq.first, 0);
+    sink_flush(sink);
+    PROFILE_END();
+}
+
+// NOTE(Alexander): minify renders compact html for production, the default is pretty printed
+string
+generate_html_from_dom_ex(Dom* dom, bool minify) {
+    Memory_Arena html_buffer;
+    zero_struct(html_buffer);
+    
+    // NOTE(Alexander): the html is gathered in the buffer and pushed to the arena in large pieces,
+    // instead of one arena push for every tag and piece of text
+    char buffer[OUTPUT_SINK_DEFAULT_BUFFER_SIZE];
+    Output_Sink sink = output_sink_arena(&html_buffer);
+    sink.buffer = buffer;
+    sink.buffer_size = sizeof(buffer);
+    sink.minify = minify;
+    generate_html_from_dom_to_sink(dom, &sink);
+    string result = convert_memory_arena_to_string(&html_buffer);
+    arena_clear(&html_buffer);
+    return result;
+}
+
+inline string
+generate_html_from_dom(Dom* dom) {
+    return generate_html_from_dom_ex(dom, false);
+}
+
+// NOTE(Alexander): compact alternative to the linked Dom, the nodes are stored in pre-order in a
+// single array so the children of a node directly follows it and containers only store the index
+// one past their last descendant. Text is stored as u32 offset and count into the source file,
+// text from anywhere else (e.g. included files) is copied into extra and addressed from source.count.
+typedef struct {
+    u8 type; // NOTE(Alexander): Dom_Node_Type
+    u8 text_style;
+    u8 level;
+    u8 unused;
+    u32 text_offset;
+    u32 text_count;
+    
+    union {
+        u32 end; // NOTE(Alexander): paragraphs, lists, list items and includes
+        
+        struct {
+            u32 offset;
+            u32 count;
+        } source; // NOTE(Alexander): images and links
+        
+        struct {
+            u16 year;
+            u8 month;
+            u8 day;
+        } date;
+        
+        u32 language;
+    };
+} Compact_Dom_Node;
+
+typedef struct {
+    Compact_Dom_Node* nodes;
+    u32 node_count;
+    u32 max_depth;
+    
+    string source; // NOTE(Alexander): not owned, the dom sources have to outlive the compact dom
+    string extra;
+} Compact_Dom;
+
+inline string
+compact_dom_text(Compact_Dom* dom, u32 offset, u32 count) {
+    string result;
+    if (offset < dom->source.count) {
+        result.data = dom->source.data + offset;
+    } else {
+        result.data = dom->extra.data + (offset - dom->source.count);
+    }
+    result.count = count;
+    return result;
+}
+
+inline bool
+is_dom_container(Dom_Node_Type type) {
+    return (type == Dom_Paragraph || type == Dom_Unordered_List || type == Dom_Ordered_List ||
+            type == Dom_List_Item || type == Dom_Include);
+}
+
+inline Dom_Node*
+dom_node_first_child(Dom_Node* node) {
+    switch (node->type) {
+        case Dom_Paragraph: return node->paragraph.seq.first;
+        case Dom_Unordered_List: return node->unordered_list.seq.first;
+        case Dom_Ordered_List: return node->ordered_list.seq.first;
+        case Dom_List_Item: return node->list_item.seq.first;
+        case Dom_Include: return node->include.seq.first;
+        default: return 0;
+    }
+}
+
+inline bool
+compact_dom_is_in_source(string source, string text) {
+    return text.data >= source.data && text.data + text.count <= source.data + source.count;
+}
+
+void
+compact_dom_measure(Compact_Dom* dom, Dom_Node* node, u32 depth) {
+    for (; node; node = node->next) {
+        dom->node_count++;
+        dom->max_depth = max(dom->max_depth, depth);
+        
+        if (!compact_dom_is_in_source(dom->source, node->text)) {
+            dom->extra.count += node->text.count;
+        }
+        if ((node->type == Dom_Image || node->type == Dom_Link) && 
+            !compact_dom_is_in_source(dom->source, node->link.source)) {
+            dom->extra.count += node->link.source.count;
+        }
+        
+        if (is_dom_container(node->type)) {
+            compact_dom_measure(dom, dom_node_first_child(node), depth + 1);
+        }
+    }
+}
+
+void
+compact_dom_push_text(Compact_Dom* dom, string text, umm* extra_used, u32* offset, u32* count) {
+    assert(text.count <= 0xFFFFFFFFu);
+    *count = (u32) text.count;
+    if (text.count == 0) {
+        *offset = 0;
+    } else if (compact_dom_is_in_source(dom->source, text)) {
+        *offset = (u32) (text.data - dom->source.data);
+    } else {
+        memcpy(dom->extra.data + *extra_used, text.data, text.count);
+        *offset = (u32) (dom->source.count + *extra_used);
+        *extra_used += text.count;
+    }
+}
+
+void
+compact_dom_push_nodes(Compact_Dom* dom, Dom_Node* node, umm* extra_used) {
+    for (; node; node = node->next) {
+        Compact_Dom_Node* dest = &dom->nodes[dom->node_count++];
+        memset(dest, 0, sizeof(Compact_Dom_Node));
+        dest->type = (u8) node->type;
+        dest->text_style = (u8) node->text_style;
+        compact_dom_push_text(dom, node->text, extra_used, &dest->text_offset, &dest->text_count);
+        
+        switch (node->type) {
+            case Dom_Heading: {
+                dest->level = (u8) min(max(node->heading.level, 0), 6);
+            } break;
+            
+            case Dom_Image:
+            case Dom_Link: {
+                compact_dom_push_text(dom, node->link.source, extra_used, 
+                                      &dest->source.offset, &dest->source.count);
+            } break;
+            
+            case Dom_Date: {
+                dest->date.year = (u16) node->date.year;
+                dest->date.month = (u8) node->date.month;
+                dest->date.day = (u8) node->date.day;
+            } break;
+            
+            case Dom_Code_Block: {
+                dest->language = (u32) node->code_block.language;
+            } break;
+            
+            default: {
+                if (is_dom_container(node->type)) {
+                    compact_dom_push_nodes(dom, dom_node_first_child(node), extra_used);
+                    dest->end = dom->node_count;
+                }
+            } break;
+        }
+    }
+}
+
+// NOTE(Alexander): the nodes are allocated on the arena in one block, the text still points
+// into the dom sources so free_dom_sources must not be called before the compact dom is done.
+Compact_Dom
+compact_dom_from_dom(Dom* dom, Memory_Arena* arena) {
+    Compact_Dom result;
+    zero_struct(result);
+    if (dom->sources) {
+        result.source = dom->sources->file.contents;
+    }
+    assert(result.source.count <= 0xFFFFFFFFu);
+    
+    compact_dom_measure(&result, dom->seq.first, 0);
+    assert(result.source.count + result.extra.count <= 0xFFFFFFFFu);
+    
+    result.nodes = (Compact_Dom_Node*) arena_push_size(arena, result.node_count*sizeof(Compact_Dom_Node), 8);
+    result.extra.data = (char*) arena_push_size(arena, result.extra.count, 1);
+    
+    umm extra_used = 0;
+    result.node_count = 0;
+    compact_dom_push_nodes(&result, dom->seq.first, &extra_used);
+    return result;
+}
+
+// NOTE(Alexander): produces the same html as push_generated_html_from_dom_node, but walks the
+// nodes linearly and keeps the open containers on an explicit stack instead of recursing.
+void
+generate_html_from_compact_dom_to_sink(Compact_Dom* dom, Output_Sink* sink) {
+    PROFILE_BEGIN(Render, 0);
+    
+    u32 fixed_stack[64];
+    u32* open = fixed_stack;
+    if (dom->max_depth >= array_count(fixed_stack)) {
+        open = (u32*) malloc((dom->max_depth + 1)*sizeof(u32));
+    }
+    u32 open_count = 0;
+    int depth = 0;
+    
+    for (u32 i = 0; i <= dom->node_count; i++) {
+        while (open_count > 0 && dom->nodes[open[open_count - 1]].end <= i) {
+            Compact_Dom_Node* parent = &dom->nodes[open[--open_count]];
+            switch (parent->type) {
+                case Dom_Paragraph: sink_push_cstring(sink, "</p>"); break;
+                case Dom_Unordered_List: sink_push_cstring(sink, "</ul>"); break;
+                case Dom_Ordered_List: sink_push_cstring(sink, "</ol>"); break;
+                case Dom_List_Item: sink_push_cstring(sink, "</li>"); break;
+            }
+            if (parent->type != Dom_Include) {
+                depth -= 2;
+            }
+        }
+        
+        if (i == dom->node_count) {
+            break;
+        }
+        
+        Compact_Dom_Node* node = &dom->nodes[i];
+        string text = compact_dom_text(dom, node->text_offset, node->text_count);
+        switch (node->type) {
+            case Dom_Heading: {
+                char level = '0' + (char) node->level;
+                char open_tag[] = "<h0>";
+                char close_tag[] = "</h0>";
+                *(open_tag + 2) = level;
+                *(close_tag + 3) = level;
+                
+                sink_push_new_line(sink, depth);
+                sink_push_cstring(sink, open_tag);
+                sink_push_text(sink, text);
+                sink_push_cstring(sink, close_tag);
+            } break;
+            
+            case Dom_Paragraph:
+            case Dom_Unordered_List:
+            case Dom_Ordered_List:
+            case Dom_List_Item: {
+                sink_push_new_line(sink, depth);
+                switch (node->type) {
+                    case Dom_Paragraph: sink_push_cstring(sink, "<p>"); break;
+                    case Dom_Unordered_List: sink_push_cstring(sink, "<ul>"); break;
+                    case Dom_Ordered_List: sink_push_cstring(sink, "<ol>"); break;
+                    default: sink_push_cstring(sink, "<li>"); break;
+                }
+                depth += 2;
+                open[open_count++] = i;
+            } break;
+            
+            case Dom_Include: {
+                open[open_count++] = i;
+            } break;
+            
+            case Dom_Image: {
+                sink_push_pending_space(sink);
+                sink_push_cstring(sink, "<img alt=\"");
+                sink_push_string(sink, text);
+                sink_push_cstring(sink, "\" src=\"");
+                sink_push_url(sink, compact_dom_text(dom, node->source.offset, node->source.count));
+                sink_push_cstring(sink, "\" width=\"100%\"/>");
+                sink->after_space = false;
+            } break;
+            
+            case Dom_Link: {
+                sink_push_pending_space(sink);
+                sink_push_cstring(sink, "<a href=\"");
+                sink_push_url(sink, compact_dom_text(dom, node->source.offset, node->source.count));
+                sink_push_cstring(sink, "\">");
+                sink_push_text(sink, text);
+                sink_push_cstring(sink, "</a>");
+                sink_push_inline_new_line(sink, depth);
+            } break;
+            
+            case Dom_Code_Block: {
+                sink_push_code_block(sink, text, (Code_Block_Language) node->language, depth);
+            } break;
+            
+            case Dom_Line_Break: {
+                sink_push_cstring(sink, "<br>");
+                sink->pending_space = false;
+                sink->after_space = true;
+            } break;
+            
+            case Dom_Inline_Text: {
+                if (node->text_style) {
+                    sink_push_pending_space(sink);
+                }
+                if (node->text_style & TextStyle_Bold) {
+                    sink_push_cstring(sink, "<strong>");
+                }
+                if (node->text_style & TextStyle_Italics) {
+                    sink_push_cstring(sink, "<em>");
+                }
+                if (node->text_style & TextStyle_Code) {
+                    sink_push_cstring(sink, "<code>");
+                }
+                sink_push_text(sink, text);
+                if (node->text_style & TextStyle_Italics) {
+                    sink_push_cstring(sink, "</em>");
+                }
+                if (node->text_style & TextStyle_Bold) {
+                    sink_push_cstring(sink, "</strong>");
+                }
+                if (node->text_style & TextStyle_Code) {
+                    sink_push_cstring(sink, "</code>");
+                }
+            } break;
+        }
+    }
+    
+    if (open != fixed_stack) {
+        free(open);
+    }
+    sink_flush(sink);
+    PROFILE_END();
+}
+
+string
+generate_html_from_compact_dom(Compact_Dom* dom) {
+    Memory_Arena html_buffer;
+    zero_struct(html_buffer);
+    
+    Output_Sink sink = output_sink_arena(&html_buffer);
+    generate_html_from_compact_dom_to_sink(dom, &sink);
+    string result = convert_memory_arena_to_string(&html_buffer);
+    arena_clear(&html_buffer);
+    return result;
+}
+
+// NOTE(Alexander): template compiled once into a list of literal segments and $N parameter
+// slots, the literals points directly into the template source so it has to outlive the template.
+typedef enum {
+    TemplateSegment_Literal,
+    TemplateSegment_Parameter,
+} Template_Segment_Type;
+
+typedef struct {
+    Template_Segment_Type type;
+    string text; // NOTE(Alexander): for parameters this is the $N placeholder itself
+    int arg_index;
+} Template_Segment;
+
+// NOTE(Alexander): a file read while compiling a template, canonical filepath
+typedef struct Template_Dependency Template_Dependency;
+struct Template_Dependency {
+    cstring filepath;
+    u64 size;
+    u64 modified_time;
+    u64 hash;
+    string source;
+    Template_Dependency* next;
+};
+
+typedef struct {
+    Template_Segment* segments;
+    int segment_count;
+    int segment_capacity;
+    char* minified; // NOTE(Alexander): storage of the literals after template_minify
+    int unknown_parameter_count; // NOTE(Alexander): ${name} placeholders that didn't match any name
+    
+    // NOTE(Alexander): only for templates compiled from files, the arena owns their sources
+    Memory_Arena arena;
+    Template_Dependency* dependencies;
+    u64 hash; // NOTE(Alexander): of all the dependencies
+} Template;
+
+void
+template_push_segment(Template* tmpl, Template_Segment_Type type, string text, int arg_index) {
+    if (type == TemplateSegment_Literal && tmpl->segment_count > 0) {
+        Template_Segment* last = &tmpl->segments[tmpl->segment_count - 1];
+        if (last->type == TemplateSegment_Literal && last->text.data + last->text.count == text.data) {
+            last->text.count += text.count;
+            return;
+        }
+    }
+    
+    if (tmpl->segment_count == tmpl->segment_capacity) {
+        tmpl->segment_capacity = tmpl->segment_capacity ? tmpl->segment_capacity * 2 : 16;
+        tmpl->segments = (Template_Segment*) realloc(tmpl->segments, 
+                                                     tmpl->segment_capacity*sizeof(Template_Segment));
+    }
+    
+    Template_Segment* segment = &tmpl->segments[tmpl->segment_count++];
+    segment->type = type;
+    segment->text = text;
+    segment->arg_index = arg_index;
+}
+
+#define TEMPLATE_MAX_PARAMETER_NAME 64
+
+inline bool
+is_template_parameter_name_char(char c) {
+    return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || 
+            c == '_' || c == '-' || c == '.');
+}
+
+// NOTE(Alexander): parses the name of a ${name} placeholder right after the `$` token and skips past
+// the closing brace, returns an empty string without consuming anything if it's not a valid placeholder.
+string
+parse_template_parameter_name(Tokenizer* t) {
+    string result;
+    zero_struct(result);
+    if (t->peeked.symbol || t->curr == t->end || *t->curr != '{') {
+        return result;
+    }
+    
+    char* begin = t->curr + 1;
+    char* end = begin;
+    while (end < t->end && end - begin <= TEMPLATE_MAX_PARAMETER_NAME && is_template_parameter_name_char(*end)) {
+        end++;
+    }
+    
+    if (end == begin || end == t->end || *end != '}' || end - begin > TEMPLATE_MAX_PARAMETER_NAME) {
+        return result;
+    }
+    
+    result.data = begin;
+    result.count = end - begin;
+    t->curr = end + 1;
+    return result;
+}
+
+// NOTE(Alexander): @include, @extends, @block and @end directives in templates compiled from files,
+// they have to be on a line of their own and are removed from the output together with that line.
+typedef enum {
+    TemplateDirective_None,
+    TemplateDirective_Include,
+    TemplateDirective_Extends,
+    TemplateDirective_Block,
+    TemplateDirective_End,
+} Template_Directive_Type;
+
+typedef struct {
+    Template_Directive_Type type;
+    string argument; // NOTE(Alexander): filename of @include/@extends or the name of the @block
+    char* end; // NOTE(Alexander): after the line of the directive
+} Template_Directive;
+
+#define TEMPLATE_MAX_INCLUDE_DEPTH 32
+#define TEMPLATE_MAX_BLOCK_DEPTH 32
+
+// NOTE(Alexander): the segments of a block, the first definition of a name is used
+typedef struct {
+    Template* tmpl;
+    int first;
+    int count;
+} Template_Block;
+
+typedef struct {
+    Template* result; // NOTE(Alexander): owns the sources and the dependencies
+    String_Map slots;
+    String_Map reported;
+    cstring include_stack[TEMPLATE_MAX_INCLUDE_DEPTH];
+    int include_depth;
+    bool directives;
+} Template_Compiler;
+
+// NOTE(Alexander): curr has to point at the `@`, returns a directive of type none if it isn't one
+Template_Directive
+parse_template_directive(char* curr, char* end) {
+    static cstring keywords[] = { "", "include", "extends", "block", "end" };
+    
+    Template_Directive result;
+    zero_struct(result);
+    
+    char* begin = ++curr;
+    while (curr < end && *curr >= 'a' && *curr <= 'z') curr++;
+    Template_Directive_Type type = TemplateDirective_None;
+    for (int i = 1; i < array_count(keywords); i++) {
+        if (strlen(keywords[i]) == (umm) (curr - begin) && memcmp(keywords[i], begin, curr - begin) == 0) {
+            type = (Template_Directive_Type) i;
+        }
+    }
+    if (type == TemplateDirective_None) {
+        return result;
+    }
+    
+    while (curr < end && is_whitespace_no_new_line(*curr)) curr++;
+    string argument;
+    zero_struct(argument);
+    if (type == TemplateDirective_Include || type == TemplateDirective_Extends) {
+        if (curr == end || *curr != '"') {
+            return result;
+        }
+        argument.data = ++curr;
+        while (curr < end && *curr != '"' && !is_end_of_line(*curr)) curr++;
+        if (curr == end || *curr != '"' || curr == argument.data) {
+            return result;
+        }
+        argument.count = curr++ - argument.data;
+    } else if (type == TemplateDirective_Block) {
+        argument.data = curr;
+        while (curr < end && is_template_parameter_name_char(*curr)) curr++;
+        argument.count = curr - argument.data;
+        if (argument.count == 0) {
+            return result;
+        }
+    }
+    
+    while (curr < end && is_whitespace_no_new_line(*curr)) curr++;
+    if (curr < end && !is_end_of_line(*curr)) {
+        return result;
+    }
+    if (curr < end && *curr++ == '\r' && curr < end && *curr == '\n') curr++;
+    
+    result.type = type;
+    result.argument = argument;
+    result.end = curr;
+    return result;
+}
+
+bool template_compile_file(Template_Compiler* c, Template* out, cstring filename, 
+                           String_Map* overrides, String_Map* blocks);
+
+// NOTE(Alexander): blocks named in overrides are replaced by the overriding segments and the
+// segments of every block are recorded in blocks (if given), e.g. for the layout it extends.
+void
+template_compile_source(Template_Compiler* c, Template* out, string source, 
+                        String_Map* overrides, String_Map* blocks) {
+    Tokenizer tokenizer;
+    zero_struct(tokenizer);
+    
+    Tokenizer* t = &tokenizer;
+    t->base = source.data;
+    t->curr = t->base;
+    t->end = t->curr + source.count;
+    
+    string block_names[TEMPLATE_MAX_BLOCK_DEPTH];
+    int block_firsts[TEMPLATE_MAX_BLOCK_DEPTH];
+    int block_depth = 0;
+    int skip_depth = 0; // NOTE(Alexander): nested blocks of an overridden block being skipped
+    
+    bool line_start = true;
+    string name;
+    Token token = next_token(t);
+    while (token.symbol) {
+        Template_Directive directive;
+        directive.type = TemplateDirective_None;
+        if (c->directives && line_start && token.symbol == '@' && token.text.count == 1) {
+            directive = parse_template_directive(token.text.data, t->end);
+        }
+        
+        if (directive.type != TemplateDirective_None) {
+            // NOTE(Alexander): drop the indentation of the directive
+            Template_Segment* last = out->segment_count ? &out->segments[out->segment_count - 1] : 0;
+            if (last && last->type == TemplateSegment_Literal && last->text.data + last->text.count == token.text.data) {
+                while (last->text.count > 0 && is_whitespace_no_new_line(last->text.data[last->text.count - 1])) {
+                    last->text.count--;
+                }
+            }
+            t->curr = directive.end;
+            string argument = directive.argument;
+            
+            if (skip_depth > 0) {
+                skip_depth += directive.type == TemplateDirective_Block;
+                skip_depth -= directive.type == TemplateDirective_End;
+                if (skip_depth > 0) {
+                    token = next_token(t);
+                    continue;
+                }
+            }
+            
+            switch (directive.type) {
+                case TemplateDirective_Include: {
+                    cstring filename = arena_push_format(&c->result->arena, "%.*s", (int) argument.count, argument.data);
+                    template_compile_file(c, out, filename, overrides, blocks);
+                } break;
+                
+                case TemplateDirective_Extends: {
+                    printf("@extends has to be the first line of the template, ignored `%.*s`\n", 
+                           (int) argument.count, argument.data);
+                } break;
+                
+                case TemplateDirective_Block: {
+                    if (block_depth == TEMPLATE_MAX_BLOCK_DEPTH) {
+                        printf("Too many nested @block, ignored `%.*s`\n", (int) argument.count, argument.data);
+                        break;
+                    }
+                    block_names[block_depth] = argument;
+                    block_firsts[block_depth] = out->segment_count;
+                    block_depth++;
+                    
+                    Template_Block* override = overrides ? (Template_Block*) string_map_get(overrides, argument) : 0;
+                    if (override) {
+                        for (int i = 0; i < override->count; i++) {
+                            Template_Segment* segment = &override->tmpl->segments[override->first + i];
+                            template_push_segment(out, segment->type, segment->text, segment->arg_index);
+                        }
+                        skip_depth = 1;
+                    }
+                } break;
+                
+                case TemplateDirective_End: {
+                    if (block_depth == 0) {
+                        printf("@end without a matching @block was ignored\n");
+                        break;
+                    }
+                    block_depth--;
+                    string block_name = block_names[block_depth];
+                    if (blocks && !string_map_get(blocks, block_name)) {
+                        Template_Block* block = arena_push_struct(&c->result->arena, Template_Block);
+                        block->tmpl = out;
+                        block->first = block_firsts[block_depth];
+                        block->count = out->segment_count - block->first;
+                        string_map_put(blocks, block_name, block);
+                    }
+                } break;
+                
+                default: break;
+            }
+            
+            line_start = true;
+            token = next_token(t);
+            continue;
+        }
+        
+        line_start = token.new_line || (line_start && token.whitespace);
+        if (skip_depth > 0) {
+            token = next_token(t);
+            continue;
+        }
+        
+        if (token.symbol == '$' && token.text.count == 1 && 
+            (name = parse_template_parameter_name(t)).count > 0) {
+            string placeholder = token.text;
+            placeholder.count = t->curr - token.text.data;
+            
+            umm slot = (umm) string_map_get(&c->slots, name);
+            if (slot) {
+                template_push_segment(out, TemplateSegment_Parameter, placeholder, (int) slot - 1);
+            } else {
+                if (!string_map_get(&c->reported, name)) {
+                    string_map_put(&c->reported, name, (void*) 1);
+                    printf("Unknown template parameter `%.*s`\n", (int) name.count, name.data);
+                }
+                c->result->unknown_parameter_count++;
+                template_push_segment(out, TemplateSegment_Literal, placeholder, -1);
+            }
+        } else if (token.symbol == '$' && token.text.count == 1 && peek_token(t).number >= 0) {
+            Token number = next_token(t);
+            string placeholder = token.text;
+            placeholder.count += number.text.count;
+            template_push_segment(out, TemplateSegment_Parameter, placeholder, number.number);
+        } else {
+            template_push_segment(out, TemplateSegment_Literal, token.text, -1);
+        }
+        token = next_token(t);
+    }
+    
+    if (block_depth > 0) {
+        printf("Missing @end of @block `%.*s`\n", (int) block_names[block_depth - 1].count, 
+               block_names[block_depth - 1].data);
+    }
+}
+
+void
+template_compiler_begin(Template_Compiler* c, Template* result, string* names, int name_count) {
+    zero_struct(*c);
+    c->result = result;
+    for (int i = 0; i < name_count; i++) {
+        if (!string_map_get(&c->slots, names[i])) {
+            string_map_put(&c->slots, names[i], (void*) (umm) (i + 1));
+        }
+    }
+}
+
+void
+template_compiler_end(Template_Compiler* c) {
+    string_map_free(&c->slots);
+    string_map_free(&c->reported);
+}
+
+// NOTE(Alexander): ${name} placeholders are resolved to the index of the name in names when the
+// template is compiled so rendering is still just indexing into the args. Unknown names are reported
+// once per template and kept as literal text, positional $0..$N placeholders still work as before.
+Template
+compile_template_ex(string source, string* names, int name_count) {
+    Template result;
+    zero_struct(result);
+    
+    Template_Compiler compiler;
+    template_compiler_begin(&compiler, &result, names, name_count);
+    template_compile_source(&compiler, &result, source, 0, 0);
+    template_compiler_end(&compiler);
+    return result;
+}
+
+inline Template
+compile_template(string source) {
+    return compile_template_ex(source, 0, 0);
+}
+
+// NOTE(Alexander): the sources are copied so the template doesn't change if the files do,
+// the same file is only read once even if it's included several times.
+string
+template_read_dependency(Template_Compiler* c, cstring filepath) {
+    string result;
+    zero_struct(result);
+    
+    Template* tmpl = c->result;
+    for (Template_Dependency* it = tmpl->dependencies; it; it = it->next) {
+        if (strcmp(it->filepath, filepath) == 0) {
+            return it->source;
+        }
+    }
+    
+    File_Info info = platform_get_file_info(filepath);
+    if (!info.exists) {
+        return result;
+    }
+    Mapped_File file = map_entire_file(filepath);
+    if (!file.contents.data && info.size > 0) {
+        return result;
+    }
+    
+    Template_Dependency* dependency = arena_push_struct(&tmpl->arena, Template_Dependency);
+    dependency->filepath = arena_push_format(&tmpl->arena, "%s", filepath);
+    dependency->size = info.size;
+    dependency->modified_time = info.modified_time;
+    dependency->hash = string_content_hash(file.contents);
+    dependency->source.data = (char*) arena_push_size(&tmpl->arena, file.contents.count + 1, 1);
+    dependency->source.count = file.contents.count;
+    if (file.contents.count > 0) {
+        memcpy(dependency->source.data, file.contents.data, file.contents.count);
+    }
+    unmap_file(&file);
+    
+    dependency->next = tmpl->dependencies;
+    tmpl->dependencies = dependency;
+    tmpl->hash = content_hash_mix(tmpl->hash, dependency->hash);
+    return dependency->source;
+}
+
+// NOTE(Alexander): a template starting with @extends "layout" only defines blocks, the layout is
+// compiled in its place with those blocks (and the ones overriding them in turn) replacing its own.
+bool
+template_compile_file(Template_Compiler* c, Template* out, cstring filename, 
+                      String_Map* overrides, String_Map* blocks) {
+    char filepath[4096];
+    if (!platform_get_full_path(filename, filepath, sizeof(filepath))) {
+        printf("File `%s` was not found!\n", filename);
+        return false;
+    }
+    
+    for (int i = 0; i < c->include_depth; i++) {
+        if (strcmp(c->include_stack[i], filepath) == 0) {
+            printf("Cyclic template @include or @extends of `%s` was ignored!\n", filename);
+            return false;
+        }
+    }
+    if (c->include_depth == TEMPLATE_MAX_INCLUDE_DEPTH) {
+        printf("Too many nested templates, ignored `%s`\n", filename);
+        return false;
+    }
+    
+    string source = template_read_dependency(c, filepath);
+    if (!source.data) {
+        printf("File `%s` was not found!\n", filename);
+        return false;
+    }
+    
+    bool result = true;
+    c->include_stack[c->include_depth++] = filepath;
+    
+    char* first_line = source.data;
+    while (first_line < source.data + source.count && is_whitespace(*first_line)) first_line++;
+    Template_Directive extends;
+    extends.type = TemplateDirective_None;
+    if (first_line < source.data + source.count && *first_line == '@') {
+        extends = parse_template_directive(first_line, source.data + source.count);
+    }
+    
+    if (extends.type == TemplateDirective_Extends) {
+        Template body;
+        zero_struct(body);
+        String_Map body_blocks;
+        zero_struct(body_blocks);
+        
+        string rest;
+        rest.data = extends.end;
+        rest.count = source.data + source.count - extends.end;
+        template_compile_source(c, &body, rest, overrides, &body_blocks);
+        
+        // NOTE(Alexander): blocks this template didn't define may still be in the layouts above
+        for (u32 i = 0; overrides && i < overrides->capacity; i++) {
+            String_Map_Entry* entry = &overrides->entries[i];
+            if (entry->key.data && !string_map_get(&body_blocks, entry->key)) {
+                string_map_put(&body_blocks, entry->key, entry->value);
+            }
+        }
+        
+        cstring layout = arena_push_format(&c->result->arena, "%.*s", 
+                                           (int) extends.argument.count, extends.argument.data);
+        result = template_compile_file(c, out, layout, &body_blocks, blocks);
+        string_map_free(&body_blocks);
+        free(body.segments);
+    } else {
+        template_compile_source(c, out, source, overrides, blocks);
+    }
+    
+    c->include_depth--;
+    return result;
+}
+
+// NOTE(Alexander): compiles the template and everything it includes or extends into a single list of
+// segments, relative filenames are resolved from the working directory (like @include in markdown).
+// Returns false if the template or any layout it extends couldn't be read, missing includes are skipped.
+bool
+compile_template_file(Template* result, cstring filepath, string* names, int name_count) {
+    zero_struct(*result);
+    
+    Template_Compiler compiler;
+    template_compiler_begin(&compiler, result, names, name_count);
+    compiler.directives = true;
+    bool success = template_compile_file(&compiler, result, filepath, 0, 0);
+    template_compiler_end(&compiler);
+    return success;
+}
+
+// NOTE(Alexander): checks the size and modification time of every file the template was compiled
+// from, files that were touched are hashed again so the template is only invalidated if they changed.
+bool
+template_is_up_to_date(Template* tmpl) {
+    for (Template_Dependency* it = tmpl->dependencies; it; it = it->next) {
+        File_Info info = platform_get_file_info(it->filepath);
+        if (!info.exists || info.size != it->size) {
+            return false;
+        }
+        
+        if (info.modified_time != it->modified_time) {
+            Mapped_File file = map_entire_file(it->filepath);
+            bool changed = file.contents.count != it->size || string_content_hash(file.contents) != it->hash;
+            unmap_file(&file);
+            if (changed) {
+                return false;
+            }
+            it->modified_time = info.modified_time;
+        }
+    }
+    return true;
+}
+
+bool
+template_depends_on(Template* tmpl, cstring filepath) {
+    for (Template_Dependency* it = tmpl->dependencies; it; it = it->next) {
+        if (strcmp(it->filepath, filepath) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// NOTE(Alexander): copies the segments, the literals and dependencies still refer to the original
+Template
+template_copy(Template* tmpl) {
+    Template result;
+    zero_struct(result);
+    result.segment_count = tmpl->segment_count;
+    result.segment_capacity = tmpl->segment_count;
+    result.segments = (Template_Segment*) malloc(max(tmpl->segment_count, 1)*sizeof(Template_Segment));
+    memcpy(result.segments, tmpl->segments, tmpl->segment_count*sizeof(Template_Segment));
+    result.unknown_parameter_count = tmpl->unknown_parameter_count;
+    result.dependencies = tmpl->dependencies;
+    result.hash = tmpl->hash;
+    return result;
+}
+
+void
+free_template(Template* tmpl) {
+    free(tmpl->segments);
+    free(tmpl->minified);
+    arena_clear(&tmpl->arena);
+    zero_struct(*tmpl);
+}
+
+// NOTE(Alexander): process wide cache of templates compiled from files keyed by their canonical path,
+// so layouts are compiled once and shared by every page and build. Entries are revalidated with
+// template_is_up_to_date on every lookup, replaced entries are kept alive until template_cache_free_retired
+// is called since copies of them may still refer to their sources.
+typedef struct Template_Cache_Entry Template_Cache_Entry;
+struct Template_Cache_Entry {
+    cstring filepath;
+    u64 names_hash;
+    Template tmpl;
+    Template_Cache_Entry* next_retired;
+};
+
+typedef struct {
+    Mutex mutex;
+    String_Map entries;
+    Memory_Arena keys; // NOTE(Alexander): the map keys, entries are freed once they're retired
+    Template_Cache_Entry* retired;
+} Template_Cache;
+
+static Template_Cache global_template_cache = { MUTEX_INITIALIZER };
+
+void
+template_cache_free_entry(Template_Cache_Entry* entry) {
+    free_template(&entry->tmpl);
+    free(entry);
+}
+
+// NOTE(Alexander): frees the replaced templates, no template copied from them may be used anymore
+void
+template_cache_free_retired(void) {
+    Template_Cache* cache = &global_template_cache;
+    mutex_lock(&cache->mutex);
+    while (cache->retired) {
+        Template_Cache_Entry* entry = cache->retired;
+        cache->retired = entry->next_retired;
+        template_cache_free_entry(entry);
+    }
+    mutex_unlock(&cache->mutex);
+}
+
+void
+template_cache_clear(void) {
+    Template_Cache* cache = &global_template_cache;
+    mutex_lock(&cache->mutex);
+    for (u32 i = 0; i < cache->entries.capacity; i++) {
+        Template_Cache_Entry* entry = (Template_Cache_Entry*) cache->entries.entries[i].value;
+        if (entry) {
+            template_cache_free_entry(entry);
+        }
+    }
+    string_map_free(&cache->entries);
+    arena_clear(&cache->keys);
+    mutex_unlock(&cache->mutex);
+    
+    template_cache_free_retired();
+}
+
+// NOTE(Alexander): the mutex has to be held, the key is only copied the first time the file is cached
+void
+template_cache_put(Template_Cache* cache, Template_Cache_Entry* entry) {
+    string key = string_lit(entry->filepath);
+    if (cache->entries.count == 0 || !string_map_find_entry(&cache->entries, key, string_hash(key))->key.data) {
+        key = string_lit(arena_push_format(&cache->keys, "%s", entry->filepath));
+    }
+    string_map_put(&cache->entries, key, entry);
+}
+
+// NOTE(Alexander): returns null if the template couldn't be compiled, see compile_template_file
+Template*
+template_cache_get(cstring filename, string* names, int name_count) {
+    char filepath[4096];
+    if (!platform_get_full_path(filename, filepath, sizeof(filepath))) {
+        printf("File `%s` was not found!\n", filename);
+        return 0;
+    }
+    
+    Content_Hash state;
+    content_hash_begin(&state);
+    for (int i = 0; i < name_count; i++) {
+        content_hash_update(&state, &names[i].count, sizeof(names[i].count));
+        content_hash_update(&state, names[i].data, names[i].count);
+    }
+    u64 names_hash = content_hash_end(&state);
+    
+    // NOTE(Alexander): compiled under the lock, templates are small and rarely change
+    Template_Cache* cache = &global_template_cache;
+    mutex_lock(&cache->mutex);
+    Template_Cache_Entry* entry = (Template_Cache_Entry*) string_map_get(&cache->entries, string_lit(filepath));
+    if (entry && entry->names_hash == names_hash && template_is_up_to_date(&entry->tmpl)) {
+        mutex_unlock(&cache->mutex);
+        return &entry->tmpl;
+    }
+    
+    Template_Cache_Entry* new_entry = (Template_Cache_Entry*) calloc(1, sizeof(Template_Cache_Entry));
+    if (!compile_template_file(&new_entry->tmpl, filepath, names, name_count)) {
+        template_cache_free_entry(new_entry);
+        mutex_unlock(&cache->mutex);
+        return 0;
+    }
+    new_entry->filepath = arena_push_format(&new_entry->tmpl.arena, "%s", filepath);
+    new_entry->names_hash = names_hash;
+    
+    if (entry) {
+        entry->next_retired = cache->retired;
+        cache->retired = entry;
+    }
+    template_cache_put(cache, new_entry);
+    mutex_unlock(&cache->mutex);
+    return &new_entry->tmpl;
+}
+
+// NOTE(Alexander): tags where the surrounding whitespace doesn't affect the rendering
+static cstring minify_block_tags[] = {
+    "!doctype", "html", "head", "body", "title", "meta", "link", "base", "script", "style", "noscript",
+    "header", "footer", "main", "nav", "section", "article", "aside", "div", "p", "ul", "ol", "li",
+    "h1", "h2", "h3", "h4", "h5", "h6", "pre", "table", "thead", "tbody", "tr", "td", "th", "br", "hr", "form"
+};
+
+// NOTE(Alexander): the contents of these are copied as is
+static cstring minify_raw_tags[] = { "pre", "textarea", "script", "style" };
+
+// NOTE(Alexander): reads the lower case name of the tag starting at curr (after the `<` or `</`)
+int
+minify_read_tag_name(char* curr, char* end, char* name, int name_size) {
+    int count = 0;
+    while (curr < end && count < name_size - 1 && !is_whitespace(*curr) && *curr != '>' && *curr != '/') {
+        char c = *curr++;
+        name[count++] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+    name[count] = 0;
+    return count;
+}
+
+bool
+minify_is_tag(char* curr, char* end, cstring* tags, int tag_count) {
+    char name[16];
+    if (curr < end && *curr == '/') curr++;
+    minify_read_tag_name(curr, end, name, sizeof(name));
+    for (int i = 0; i < tag_count; i++) {
+        if (strcmp(name, tags[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// NOTE(Alexander): minifies the html in the literal segments, comments are removed and runs of
+// whitespace are collapsed into a single space, or removed entirely next to block level tags and at
+// the start and end of the template. The contents of pre, textarea, script and style are kept and
+// parameters are left untouched, i.e. the whitespace next to them is always kept as a space.
+void
+template_minify(Template* tmpl) {
+    umm size = 0;
+    for (int i = 0; i < tmpl->segment_count; i++) {
+        if (tmpl->segments[i].type == TemplateSegment_Literal) {
+            size += tmpl->segments[i].text.count;
+        }
+    }
+    
+    char* dest = (char*) malloc(size + 1);
+    free(tmpl->minified);
+    tmpl->minified = dest;
+    
+    char raw_tag[16] = {0};
+    bool in_tag = false;
+    bool after_block_tag = true;
+    for (int i = 0; i < tmpl->segment_count; i++) {
+        Template_Segment* segment = &tmpl->segments[i];
+        if (segment->type != TemplateSegment_Literal) {
+            after_block_tag = false;
+            continue;
+        }
+        
+        char* curr = segment->text.data;
+        char* end = curr + segment->text.count;
+        char* begin = dest;
+        while (curr < end) {
+            if (in_tag) {
+                // NOTE(Alexander): attributes are kept as is
+                while (curr < end && *curr != '>') *dest++ = *curr++;
+                if (curr < end) {
+                    *dest++ = *curr++;
+                    in_tag = false;
+                }
+                
+            } else if (raw_tag[0]) {
+                if (curr[0] == '<' && curr + 1 < end && curr[1] == '/') {
+                    char name[16];
+                    minify_read_tag_name(curr + 2, end, name, sizeof(name));
+                    if (strcmp(name, raw_tag) == 0) {
+                        raw_tag[0] = 0;
+                        after_block_tag = minify_is_tag(curr + 1, end, minify_block_tags, 
+                                                        array_count(minify_block_tags));
+                        in_tag = true;
+                        continue;
+                    }
+                }
+                *dest++ = *curr++;
+                
+            } else if (end - curr >= 4 && memcmp(curr, "<!--", 4) == 0 && !(end - curr >= 5 && curr[4] == '[')) {
+                // NOTE(Alexander): comments split by a parameter are kept
+                char* comment_end = curr + 4;
+                while (end - comment_end >= 3 && memcmp(comment_end, "-->", 3) != 0) comment_end++;
+                if (end - comment_end >= 3) {
+                    curr = comment_end + 3;
+                } else {
+                    while (curr < end) *dest++ = *curr++;
+                }
+                
+            } else if (*curr == '<') {
+                after_block_tag = minify_is_tag(curr + 1, end, minify_block_tags, array_count(minify_block_tags));
+                if (curr + 1 < end && curr[1] != '/' && 
+                    minify_is_tag(curr + 1, end, minify_raw_tags, array_count(minify_raw_tags))) {
+                    minify_read_tag_name(curr + 1, end, raw_tag, sizeof(raw_tag));
+                }
+                in_tag = true;
+                
+            } else if (is_whitespace(*curr)) {
+                while (curr < end && is_whitespace(*curr)) curr++;
+                bool at_start = dest == tmpl->minified;
+                bool at_end = curr == end && i + 1 == tmpl->segment_count;
+                bool before_block_tag = curr < end && *curr == '<' && 
+                    (minify_is_tag(curr + 1, end, minify_block_tags, array_count(minify_block_tags)) ||
+                     (end - curr >= 4 && memcmp(curr, "<!--", 4) == 0));
+                if (!at_start && !at_end && !after_block_tag && !before_block_tag) {
+                    *dest++ = ' ';
+                }
+                
+            } else {
+                while (curr < end && *curr != '<' && !is_whitespace(*curr)) *dest++ = *curr++;
+                after_block_tag = false;
+            }
+        }
+        
+        segment->text.data = begin;
+        segment->text.count = dest - begin;
+    }
+}
+
+// NOTE(Alexander): parameters without a matching argument are kept as is
+inline string
+template_segment_text(Template_Segment* segment, int argc, string* args) {
+    if (segment->type == TemplateSegment_Parameter && segment->arg_index < argc) {
+        return args[segment->arg_index];
+    }
+    return segment->text;
+}
+
+void
+template_render_to_sink(Template* tmpl, int argc, string* args, Output_Sink* sink) {
+    for (int i = 0; i < tmpl->segment_count; i++) {
+        sink_push_string(sink, template_segment_text(&tmpl->segments[i], argc, args));
+    }
+}
+
+// NOTE(Alexander): list of buffers written out together with platform_write_file_gather
+typedef struct {
+    string* buffers;
+    int count;
+    int capacity;
+} Gather_List;
+
+void
+gather_push(Gather_List* list, string buffer) {
+    if (buffer.count == 0) {
+        return;
+    }
+    
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->buffers = (string*) realloc(list->buffers, list->capacity*sizeof(string));
+    }
+    list->buffers[list->count++] = buffer;
+}
+
+// NOTE(Alexander): pushes the memory pushed to the arena since begin_temporary_memory
+// without copying it, one buffer per arena block.
+void
+gather_push_temporary_memory(Gather_List* list, Temporary_Memory temp) {
+    Memory_Block_Header* current = (Memory_Block_Header*) temp.arena->base;
+    Memory_Block_Header* header = (Memory_Block_Header*) temp.base;
+    umm offset = temp.curr_used;
+    if (!header) {
+        header = current;
+        while (header && header->prev) {
+            header = header->prev;
+        }
+        offset = sizeof(Memory_Block_Header);
+    }
+    
+    while (header) {
+        string buffer;
+        buffer.data = (char*) header + offset;
+        buffer.count = header->size_used - offset;
+        gather_push(list, buffer);
+        
+        if (header == current) break;
+        header = header->next;
+        offset = sizeof(Memory_Block_Header);
+    }
+}
+
+inline void
+gather_push_arena(Gather_List* list, Memory_Arena* arena) {
+    Temporary_Memory temp;
+    zero_struct(temp);
+    temp.arena = arena;
+    gather_push_temporary_memory(list, temp);
+}
+
+inline void
+gather_list_free(Gather_List* list) {
+    free(list->buffers);
+    zero_struct(*list);
+}
+
+void
+template_gather(Template* tmpl, int argc, string* args, Gather_List* list) {
+    for (int i = 0; i < tmpl->segment_count; i++) {
+        gather_push(list, template_segment_text(&tmpl->segments[i], argc, args));
+    }
+}
+
+bool
+template_write_file(Template* tmpl, int argc, string* args, cstring filepath) {
+    int fd = platform_open_file_for_writing(filepath);
+    if (fd < 0) {
+        printf("Failed to open `%s` for writing!\n", filepath);
+        return false;
+    }
+    
+    PROFILE_BEGIN(Template, 0);
+    Gather_List list;
+    zero_struct(list);
+    template_gather(tmpl, argc, args, &list);
+    PROFILE_END();
+    
+    PROFILE_BEGIN(Write, filepath);
+    bool result = platform_write_file_gather(fd, list.buffers, list.count);
+    gather_list_free(&list);
+    platform_close_file(fd);
+    PROFILE_END();
+    return result;
+}
+
+// NOTE(Alexander): names are optional, otherwise names[i] refers to args[i] in ${name} placeholders
+string
+template_process_string_ex(string source, int argc, string* args, string* names) {
+    assert(source.data);
+    
+    Template tmpl = compile_template_ex(source, names, names ? argc : 0);
+    
+    string result;
+    result.count = 0;
+    for (int i = 0; i < tmpl.segment_count; i++) {
+        result.count += template_segment_text(&tmpl.segments[i], argc, args).count;
+    }
+    
+    result.data = (char*) malloc(result.count + 1);
+    char* dest = result.data;
+    for (int i = 0; i < tmpl.segment_count; i++) {
+        string text = template_segment_text(&tmpl.segments[i], argc, args);
+        memcpy(dest, text.data, text.count);
+        dest += text.count;
+    }
+    *dest = 0;
+    
+    free_template(&tmpl);
+    return result;
+}
+
+inline string
+template_process_string(string source, int argc, string* args) {
+    return template_process_string_ex(source, argc, args, 0);
+}
+
+// NOTE(Alexander): crc32 (as used by gzip) computed 8 bytes at a time (slice-by-8)
+static u32 crc32_table[8][256];
+static volatile u32 crc32_table_initialized;
+static Mutex crc32_table_mutex = MUTEX_INITIALIZER;
+
+void
+crc32_init_table(void) {
+    for (u32 i = 0; i < 256; i++) {
+        u32 crc = i;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+        }
+        crc32_table[0][i] = crc;
+    }
+    
+    for (u32 i = 0; i < 256; i++) {
+        for (int slice = 1; slice < 8; slice++) {
+            u32 crc = crc32_table[slice - 1][i];
+            crc32_table[slice][i] = (crc >> 8) ^ crc32_table[0][crc & 0xFF];
+        }
+    }
+}
+
+// NOTE(Alexander): the table is built once by the first thread, the others wait on the mutex
+inline void
+crc32_ensure_table(void) {
+    if (atomic_load_u32(&crc32_table_initialized)) {
+        return;
+    }
+    
+    mutex_lock(&crc32_table_mutex);
+    if (!crc32_table_initialized) {
+        crc32_init_table();
+        atomic_add_u32(&crc32_table_initialized, 1);
+    }
+    mutex_unlock(&crc32_table_mutex);
+}
+
+u32
+crc32_update(u32 crc, void* data, umm count) {
+    crc32_ensure_table();
+    
+    u8* curr = (u8*) data;
+    crc = ~crc;
+    while (count >= 8) {
+        u32 low, high;
+        memcpy(&low, curr, 4);
+        memcpy(&high, curr + 4, 4);
+        low ^= crc;
+        crc = (crc32_table[7][low & 0xFF] ^ crc32_table[6][(low >> 8) & 0xFF] ^
+               crc32_table[5][(low >> 16) & 0xFF] ^ crc32_table[4][low >> 24] ^
+               crc32_table[3][high & 0xFF] ^ crc32_table[2][(high >> 8) & 0xFF] ^
+               crc32_table[1][(high >> 16) & 0xFF] ^ crc32_table[0][high >> 24]);
+        curr += 8;
+        count -= 8;
+    }
+    while (count-- > 0) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *curr++) & 0xFF];
+    }
+    return ~crc;
+}
+
+// NOTE(Alexander): deflate (RFC 1951) compressor with hash chain LZ77 matching, each block is
+// emitted with whichever of stored, fixed or dynamic huffman codes is the smallest.
+#define DEFLATE_WINDOW_SIZE 32768
+#define DEFLATE_WINDOW_MASK (DEFLATE_WINDOW_SIZE - 1)
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_BLOCK_SYMBOLS 16384
+
+static u16 deflate_length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static u8 deflate_length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static u16 deflate_distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577
+};
+static u8 deflate_distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static u8 deflate_code_length_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+typedef struct {
+    int max_chain;
+    int nice_length;
+    bool lazy;
+} Deflate_Level;
+
+static Deflate_Level deflate_levels[10] = {
+    { 0, 0, false }, // NOTE(Alexander): level 0 only stores
+    { 4, 8, false }, { 8, 16, false }, { 16, 32, false },
+    { 16, 32, true }, { 32, 64, true }, { 128, 128, true },
+    { 256, 128, true }, { 1024, 258, true }, { 4096, 258, true },
+};
+
+typedef struct {
+    u16 length; // NOTE(Alexander): the literal if distance is zero
+    u16 distance;
+} Deflate_Symbol;
+
+typedef struct {
+    u16 code; // NOTE(Alexander): bit reversed, deflate writes huffman codes msb first
+    u8 length;
+} Huffman_Code;
+
+typedef struct {
+    u8* data;
+    umm count;
+    umm capacity;
+    u64 bits;
+    u32 bit_count;
+} Bit_Writer;
+
+inline void
+bit_writer_reserve(Bit_Writer* writer, umm count) {
+    if (writer->count + count > writer->capacity) {
+        writer->capacity = max(writer->capacity*2, writer->count + count);
+        writer->data = (u8*) realloc(writer->data, writer->capacity);
+    }
+}
+
+inline void
+write_bits(Bit_Writer* writer, u32 value, u32 count) {
+    writer->bits |= (u64) value << writer->bit_count;
+    writer->bit_count += count;
+    while (writer->bit_count >= 8) {
+        writer->data[writer->count++] = (u8) writer->bits;
+        writer->bits >>= 8;
+        writer->bit_count -= 8;
+    }
+}
+
+inline void
+write_bits_align(Bit_Writer* writer) {
+    if (writer->bit_count > 0) {
+        write_bits(writer, 0, 8 - writer->bit_count);
+    }
+}
+
+inline int
+deflate_length_symbol(int length) {
+    int index = 28;
+    while (deflate_length_base[index] > length) index--;
+    return index;
+}
+
+inline int
+deflate_distance_symbol(int distance) {
+    int index = 29;
+    while (deflate_distance_base[index] > distance) index--;
+    return index;
+}
+
+// NOTE(Alexander): computes the code lengths of a huffman tree with at most max_length bits,
+// if the tree is too deep the frequencies are flattened and the tree is rebuilt.
+void
+huffman_build_lengths(u32* frequencies, int count, int max_length, u8* lengths) {
+    u32 node_frequency[2*288];
+    s16 node_parent[2*288];
+    bool node_merged[2*288];
+    u32 scaled[288];
+    assert(count <= 288);
+    memcpy(scaled, frequencies, count*sizeof(u32));
+    
+    // NOTE(Alexander): a single used symbol still needs a complete code
+    int used_count = 0;
+    for (int i = 0; i < count; i++) used_count += scaled[i] > 0;
+    for (int i = 0; i < count && used_count < 2; i++) {
+        if (scaled[i] == 0) {
+            scaled[i] = 1;
+            used_count++;
+        }
+    }
+    
+    for (;;) {
+        int node_count = 0;
+        int leaf_of_symbol[288];
+        for (int i = 0; i < count; i++) {
+            leaf_of_symbol[i] = -1;
+            if (scaled[i] > 0) {
+                leaf_of_symbol[i] = node_count;
+                node_frequency[node_count] = scaled[i];
+                node_parent[node_count] = -1;
+                node_merged[node_count] = false;
+                node_count++;
+            }
+        }
+        
+        for (int remaining = node_count; remaining > 1; remaining--) {
+            int first = -1, second = -1;
+            for (int i = 0; i < node_count; i++) {
+                if (node_merged[i]) continue;
+                if (first < 0 || node_frequency[i] < node_frequency[first]) {
+                    second = first;
+                    first = i;
+                } else if (second < 0 || node_frequency[i] < node_frequency[second]) {
+                    second = i;
+                }
+            }
+            
+            node_frequency[node_count] = node_frequency[first] + node_frequency[second];
+            node_parent[node_count] = -1;
+            node_merged[node_count] = false;
+            node_parent[first] = (s16) node_count;
+            node_parent[second] = (s16) node_count;
+            node_merged[first] = true;
+            node_merged[second] = true;
+            node_count++;
+        }
+        
+        int max_depth = 0;
+        for (int i = 0; i < count; i++) {
+            int depth = 0;
+            if (leaf_of_symbol[i] >= 0) {
+                for (int node = leaf_of_symbol[i]; node_parent[node] >= 0; node = node_parent[node]) depth++;
+            }
+            lengths[i] = (u8) depth;
+            max_depth = max(max_depth, depth);
+        }
+        
+        if (max_depth <= max_length) {
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (scaled[i] > 0) scaled[i] = (scaled[i] >> 1) | 1;
+        }
+    }
+}
+
+// NOTE(Alexander): assigns canonical codes from the code lengths
+void
+huffman_build_codes(u8* lengths, int count, Huffman_Code* codes) {
+    u16 length_count[16] = {0};
+    u16 next_code[16] = {0};
+    for (int i = 0; i < count; i++) {
+        length_count[lengths[i]]++;
+    }
+    length_count[0] = 0;
+    
+    u16 code = 0;
+    for (int bits = 1; bits < 16; bits++) {
+        code = (u16) ((code + length_count[bits - 1]) << 1);
+        next_code[bits] = code;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        int length = lengths[i];
+        codes[i].length = (u8) length;
+        codes[i].code = 0;
+        if (length > 0) {
+            u16 value = next_code[length]++;
+            u16 reversed = 0;
+            for (int bit = 0; bit < length; bit++) {
+                reversed = (u16) ((reversed << 1) | ((value >> bit) & 1));
+            }
+            codes[i].code = reversed;
+        }
+    }
+}
+
+typedef struct {
+    u8* input;
+    umm input_count;
+    Bit_Writer writer;
+    
+    Deflate_Symbol* symbols;
+    int symbol_count;
+    umm block_begin;
+    
+    bool stored_only;
+    u32 litlen_frequencies[286];
+    u32 distance_frequencies[30];
+} Deflate_State;
+
+void
+deflate_write_symbols(Deflate_State* state, Huffman_Code* litlen_codes, Huffman_Code* distance_codes) {
+    Bit_Writer* writer = &state->writer;
+    for (int i = 0; i < state->symbol_count; i++) {
+        Deflate_Symbol symbol = state->symbols[i];
+        if (symbol.distance == 0) {
+            write_bits(writer, litlen_codes[symbol.length].code, litlen_codes[symbol.length].length);
+        } else {
+            int length_symbol = deflate_length_symbol(symbol.length);
+            Huffman_Code code = litlen_codes[257 + length_symbol];
+            write_bits(writer, code.code, code.length);
+            write_bits(writer, symbol.length - deflate_length_base[length_symbol], deflate_length_extra[length_symbol]);
+            
+            int distance_symbol = deflate_distance_symbol(symbol.distance);
+            code = distance_codes[distance_symbol];
+            write_bits(writer, code.code, code.length);
+            write_bits(writer, symbol.distance - deflate_distance_base[distance_symbol], 
+                       deflate_distance_extra[distance_symbol]);
+        }
+    }
+    write_bits(writer, litlen_codes[256].code, litlen_codes[256].length);
+}
+
+umm
+deflate_symbols_cost(Deflate_State* state, u8* litlen_lengths, u8* distance_lengths) {
+    umm result = 0;
+    for (int i = 0; i < 286; i++) {
+        u32 extra = i >= 257 ? deflate_length_extra[i - 257] : 0;
+        result += (umm) state->litlen_frequencies[i]*(litlen_lengths[i] + extra);
+    }
+    for (int i = 0; i < 30; i++) {
+        result += (umm) state->distance_frequencies[i]*(distance_lengths[i] + deflate_distance_extra[i]);
+    }
+    return result;
+}
+
+void
+deflate_flush_block(Deflate_State* state, umm block_end, bool is_final) {
+    Bit_Writer* writer = &state->writer;
+    umm block_size = block_end - state->block_begin;
+    bit_writer_reserve(writer, block_size + (block_size/65535 + 1)*5 + state->symbol_count*6 + 1024);
+    
+    memset(state->litlen_frequencies, 0, sizeof(state->litlen_frequencies));
+    memset(state->distance_frequencies, 0, sizeof(state->distance_frequencies));
+    for (int i = 0; i < state->symbol_count; i++) {
+        Deflate_Symbol symbol = state->symbols[i];
+        if (symbol.distance == 0) {
+            state->litlen_frequencies[symbol.length]++;
+        } else {
+            state->litlen_frequencies[257 + deflate_length_symbol(symbol.length)]++;
+            state->distance_frequencies[deflate_distance_symbol(symbol.distance)]++;
+        }
+    }
+    state->litlen_frequencies[256] = 1;
+    
+    // NOTE(Alexander): fixed huffman codes
+    u8 fixed_litlen_lengths[288];
+    u8 fixed_distance_lengths[30];
+    for (int i = 0; i < 288; i++) {
+        fixed_litlen_lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    }
+    memset(fixed_distance_lengths, 5, sizeof(fixed_distance_lengths));
+    umm fixed_cost = 3 + deflate_symbols_cost(state, fixed_litlen_lengths, fixed_distance_lengths);
+    
+    // NOTE(Alexander): dynamic huffman codes, the code lengths are run length encoded
+    u8 litlen_lengths[286];
+    u8 distance_lengths[30];
+    huffman_build_lengths(state->litlen_frequencies, 286, 15, litlen_lengths);
+    huffman_build_lengths(state->distance_frequencies, 30, 15, distance_lengths);
+    
+    int litlen_count = 286;
+    while (litlen_count > 257 && litlen_lengths[litlen_count - 1] == 0) litlen_count--;
+    int distance_count = 30;
+    while (distance_count > 1 && distance_lengths[distance_count - 1] == 0) distance_count--;
+    
+    u8 combined[286 + 30];
+    memcpy(combined, litlen_lengths, litlen_count);
+    memcpy(combined + litlen_count, distance_lengths, distance_count);
+    int combined_count = litlen_count + distance_count;
+    
+    u8 rle_symbols[286 + 30];
+    u8 rle_extra[286 + 30];
+    int rle_count = 0;
+    u32 code_length_frequencies[19] = {0};
+    for (int i = 0; i < combined_count;) {
+        u8 value = combined[i];
+        int run = 1;
+        while (i + run < combined_count && combined[i + run] == value) run++;
+        i += run;
+        
+        if (value == 0) {
+            while (run >= 11) {
+                int n = min(run, 138);
+                rle_symbols[rle_count] = 18;
+                rle_extra[rle_count++] = (u8) (n - 11);
+                run -= n;
+            }
+            if (run >= 3) {
+                rle_symbols[rle_count] = 17;
+                rle_extra[rle_count++] = (u8) (run - 3);
+                run = 0;
+            }
+        } else {
+            rle_symbols[rle_count] = value;
+            rle_extra[rle_count++] = 0;
+            run--;
+            while (run >= 3) {
+                int n = min(run, 6);
+                rle_symbols[rle_count] = 16;
+                rle_extra[rle_count++] = (u8) (n - 3);
+                run -= n;
+            }
+        }
+        while (run-- > 0) {
+            rle_symbols[rle_count] = value;
+            rle_extra[rle_count++] = 0;
+        }
+    }
+    for (int i = 0; i < rle_count; i++) {
+        code_length_frequencies[rle_symbols[i]]++;
+    }
+    
+    u8 code_length_lengths[19];
+    huffman_build_lengths(code_length_frequencies, 19, 7, code_length_lengths);
+    int code_length_count = 19;
+    while (code_length_count > 4 && code_length_lengths[deflate_code_length_order[code_length_count - 1]] == 0) {
+        code_length_count--;
+    }
+    
+    umm dynamic_cost = 3 + 5 + 5 + 4 + 3*code_length_count;
+    for (int i = 0; i < 19; i++) {
+        u32 extra = i == 16 ? 2 : i == 17 ? 3 : i == 18 ? 7 : 0;
+        dynamic_cost += (umm) code_length_frequencies[i]*(code_length_lengths[i] + extra);
+    }
+    dynamic_cost += deflate_symbols_cost(state, litlen_lengths, distance_lengths);
+    
+    umm stored_cost = (block_size + (block_size/65535 + 1)*5)*8 + 8;
+    
+    if (state->stored_only || (stored_cost <= fixed_cost && stored_cost <= dynamic_cost)) {
+        umm offset = state->block_begin;
+        do {
+            umm count = min(block_end - offset, 65535);
+            bool is_last = offset + count == block_end;
+            write_bits(writer, is_final && is_last, 1);
+            write_bits(writer, 0, 2);
+            write_bits_align(writer);
+            write_bits(writer, (u32) count, 16);
+            write_bits(writer, (u32) ~count & 0xFFFF, 16);
+            memcpy(writer->data + writer->count, state->input + offset, count);
+            writer->count += count;
+            offset += count;
+        } while (offset < block_end);
+        
+    } else if (fixed_cost <= dynamic_cost) {
+        Huffman_Code litlen_codes[288];
+        Huffman_Code distance_codes[30];
+        huffman_build_codes(fixed_litlen_lengths, 288, litlen_codes);
+        huffman_build_codes(fixed_distance_lengths, 30, distance_codes);
+        write_bits(writer, is_final, 1);
+        write_bits(writer, 1, 2);
+        deflate_write_symbols(state, litlen_codes, distance_codes);
+        
+    } else {
+        Huffman_Code litlen_codes[286];
+        Huffman_Code distance_codes[30];
+        Huffman_Code code_length_codes[19];
+        huffman_build_codes(litlen_lengths, 286, litlen_codes);
+        huffman_build_codes(distance_lengths, 30, distance_codes);
+        huffman_build_codes(code_length_lengths, 19, code_length_codes);
+        
+        write_bits(writer, is_final, 1);
+        write_bits(writer, 2, 2);
+        write_bits(writer, litlen_count - 257, 5);
+        write_bits(writer, distance_count - 1, 5);
+        write_bits(writer, code_length_count - 4, 4);
+        for (int i = 0; i < code_length_count; i++) {
+            write_bits(writer, code_length_lengths[deflate_code_length_order[i]], 3);
+        }
+        for (int i = 0; i < rle_count; i++) {
+            Huffman_Code code = code_length_codes[rle_symbols[i]];
+            write_bits(writer, code.code, code.length);
+            if (rle_symbols[i] >= 16) {
+                write_bits(writer, rle_extra[i], rle_symbols[i] == 16 ? 2 : rle_symbols[i] == 17 ? 3 : 7);
+            }
+        }
+        deflate_write_symbols(state, litlen_codes, distance_codes);
+    }
+    
+    state->symbol_count = 0;
+    state->block_begin = block_end;
+}
+
+inline void
+deflate_push_symbol(Deflate_State* state, int length, int distance, umm end) {
+    Deflate_Symbol* symbol = &state->symbols[state->symbol_count++];
+    symbol->length = (u16) length;
+    symbol->distance = (u16) distance;
+    if (state->symbol_count == DEFLATE_BLOCK_SYMBOLS) {
+        deflate_flush_block(state, end, false);
+    }
+}
+
+inline u32
+deflate_hash(u8* data) {
+    u32 value = (u32) data[0] | ((u32) data[1] << 8) | ((u32) data[2] << 16);
+    return (value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+// NOTE(Alexander): compresses input as raw deflate data into the writer
+void
+deflate_compress(Bit_Writer* writer, string input, int level) {
+    Deflate_State state;
+    zero_struct(state);
+    state.input = (u8*) input.data;
+    state.input_count = input.count;
+    state.writer = *writer;
+    
+    level = min(max(level, 0), 9);
+    Deflate_Level params = deflate_levels[level];
+    
+    s32* head = 0;
+    s32* prev = 0;
+    if (level > 0) {
+        head = (s32*) malloc(sizeof(s32) << DEFLATE_HASH_BITS);
+        prev = (s32*) malloc(sizeof(s32)*DEFLATE_WINDOW_SIZE);
+        memset(head, 0xFF, sizeof(s32) << DEFLATE_HASH_BITS);
+        state.symbols = (Deflate_Symbol*) malloc(sizeof(Deflate_Symbol)*DEFLATE_BLOCK_SYMBOLS);
+    } else {
+        state.stored_only = true;
+    }
+    
+    u8* data = state.input;
+    umm count = state.input_count;
+    if (head) {
+        umm pos = 0;
+        int prev_length = 0;
+        int prev_distance = 0;
+        bool has_pending = false; // NOTE(Alexander): lazy matching, data[pos - 1] is not emitted yet
+        
+        while (pos < count) {
+            int best_length = 0;
+            int best_distance = 0;
+            if (pos + DEFLATE_MIN_MATCH <= count) {
+                u32 hash = deflate_hash(data + pos);
+                int max_length = (int) min(count - pos, DEFLATE_MAX_MATCH);
+                int chain = params.max_chain;
+                if (params.lazy && prev_length >= params.nice_length) chain >>= 2;
+                
+                s32 candidate = head[hash];
+                while (candidate >= 0 && pos - (umm) candidate <= DEFLATE_WINDOW_SIZE && chain-- > 0) {
+                    u8* a = data + candidate;
+                    u8* b = data + pos;
+                    if (a[best_length] == b[best_length] && a[0] == b[0] && a[1] == b[1]) {
+                        int length = 2;
+                        while (length < max_length && a[length] == b[length]) length++;
+                        if (length > best_length) {
+                            best_length = length;
+                            best_distance = (int) (pos - (umm) candidate);
+                            if (length >= params.nice_length || length == max_length) break;
+                        }
+                    }
+                    
+                    s32 next = prev[candidate & DEFLATE_WINDOW_MASK];
+                    if (next >= candidate) break;
+                    candidate = next;
+                }
+                
+                prev[pos & DEFLATE_WINDOW_MASK] = head[hash];
+                head[hash] = (s32) pos;
+            }
+            if (best_length < DEFLATE_MIN_MATCH || (best_length == DEFLATE_MIN_MATCH && best_distance > 4096)) {
+                best_length = 0;
+            }
+            
+            if (!params.lazy) {
+                if (best_length) {
+                    umm end = pos + best_length;
+                    for (umm i = pos + 1; i < end && i + DEFLATE_MIN_MATCH <= count; i++) {
+                        u32 hash = deflate_hash(data + i);
+                        prev[i & DEFLATE_WINDOW_MASK] = head[hash];
+                        head[hash] = (s32) i;
+                    }
+                    pos = end;
+                    deflate_push_symbol(&state, best_length, best_distance, pos);
+                } else {
+                    pos++;
+                    deflate_push_symbol(&state, data[pos - 1], 0, pos);
+                }
+                continue;
+            }
+            
+            if (has_pending && prev_length >= DEFLATE_MIN_MATCH && best_length <= prev_length) {
+                // NOTE(Alexander): the match at pos - 1 is at least as good, emit it
+                umm end = pos - 1 + prev_length;
+                for (umm i = pos + 1; i < end && i + DEFLATE_MIN_MATCH <= count; i++) {
+                    u32 hash = deflate_hash(data + i);
+                    prev[i & DEFLATE_WINDOW_MASK] = head[hash];
+                    head[hash] = (s32) i;
+                }
+                pos = end;
+                has_pending = false;
+                deflate_push_symbol(&state, prev_length, prev_distance, pos);
+                continue;
+            }
+            
+            if (has_pending) {
+                deflate_push_symbol(&state, data[pos - 1], 0, pos);
+            }
+            has_pending = true;
+            prev_length = best_length;
+            prev_distance = best_distance;
+            pos++;
+        }
+        
+        if (has_pending) {
+            deflate_push_symbol(&state, data[count - 1], 0, count);
+        }
+    }
+    
+    deflate_flush_block(&state, count, true);
+    write_bits_align(&state.writer);
+    *writer = state.writer;
+    
+    free(state.symbols);
+    free(head);
+    free(prev);
+}
+
+// NOTE(Alexander): compresses input into a gzip member, level is 0 (stored) to 9 (smallest),
+// the result is malloced. The crc32 of the input is passed in if it is already known.
+string
+gzip_compress_ex(string input, int level, u32 crc) {
+    Bit_Writer writer;
+    zero_struct(writer);
+    bit_writer_reserve(&writer, input.count/2 + 1024);
+    
+    u8 header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, (u8) (level >= 9 ? 2 : level <= 1 ? 4 : 0), 3 };
+    memcpy(writer.data, header, sizeof(header));
+    writer.count = sizeof(header);
+    
+    deflate_compress(&writer, input, level);
+    
+    bit_writer_reserve(&writer, 8);
+    u32 size = (u32) input.count;
+    u8 trailer[8] = {
+        (u8) crc, (u8) (crc >> 8), (u8) (crc >> 16), (u8) (crc >> 24),
+        (u8) size, (u8) (size >> 8), (u8) (size >> 16), (u8) (size >> 24)
+    };
+    memcpy(writer.data + writer.count, trailer, sizeof(trailer));
+    writer.count += sizeof(trailer);
+    
+    string result;
+    result.data = (char*) writer.data;
+    result.count = writer.count;
+    return result;
+}
+
+string
+gzip_compress(string input, int level) {
+    return gzip_compress_ex(input, level, crc32_update(0, input.data, input.count));
+}
+
+// NOTE(Alexander): reads the crc32 and size from the trailer of an existing gzip file
+bool
+gzip_read_trailer(cstring filepath, u32* crc, u32* size) {
+    FILE* file = fopen(filepath, "rb");
+    if (!file) {
+        return false;
+    }
+    
+    u8 trailer[8];
+    bool result = fseek(file, -8, SEEK_END) == 0 && fread(trailer, sizeof(trailer), 1, file) == 1;
+    fclose(file);
+    if (result) {
+        *crc = (u32) trailer[0] | ((u32) trailer[1] << 8) | ((u32) trailer[2] << 16) | ((u32) trailer[3] << 24);
+        *size = (u32) trailer[4] | ((u32) trailer[5] << 8) | ((u32) trailer[6] << 16) | ((u32) trailer[7] << 24);
+    }
+    return result;
+}
+
+// NOTE(Alexander): work stealing thread pool, each worker owns a deque of work and a memory arena.
+// Workers pop their own work from the bottom (LIFO) and steal from the top (FIFO) of other workers.
+typedef struct Worker Worker;
+typedef struct Work_Pool Work_Pool;
+
+typedef void Work_Proc(Worker* worker, void* data);
+
+typedef struct {
+    Work_Proc* proc;
+    void* data;
+} Work_Item;
+
+typedef struct {
+    Work_Item* items;
+    u32 capacity; // NOTE(Alexander): always power of two
+    u32 top;
+    u32 bottom;
+    Mutex mutex;
+} Work_Deque;
+
+struct Worker {
+    Work_Pool* pool;
+    int index;
+    Thread thread;
+    Work_Deque deque;
+    Memory_Arena arena;
+    u32 random_state;
+};
+
+struct Work_Pool {
+    Worker* workers;
+    int worker_count;
+    volatile u32 pending_count;
+    u32 next_worker;
+    void* user_data;
+};
+
+void
+work_deque_push(Work_Deque* deque, Work_Item item) {
+    mutex_lock(&deque->mutex);
+    if (deque->bottom - deque->top == deque->capacity) {
+        u32 new_capacity = deque->capacity ? deque->capacity * 2 : 64;
+        Work_Item* new_items = (Work_Item*) malloc(new_capacity * sizeof(Work_Item));
+        for (u32 i = deque->top; i != deque->bottom; i++) {
+            new_items[i & (new_capacity - 1)] = deque->items[i & (deque->capacity - 1)];
+        }
+        free(deque->items);
+        deque->items = new_items;
+        deque->capacity = new_capacity;
+    }
+    deque->items[deque->bottom++ & (deque->capacity - 1)] = item;
+    mutex_unlock(&deque->mutex);
+}
+
+bool
+work_deque_pop(Work_Deque* deque, Work_Item* item) {
+    bool result = false;
+    mutex_lock(&deque->mutex);
+    if (deque->bottom != deque->top) {
+        *item = deque->items[--deque->bottom & (deque->capacity - 1)];
+        result = true;
+    }
+    mutex_unlock(&deque->mutex);
+    return result;
+}
+
+bool
+work_deque_steal(Work_Deque* deque, Work_Item* item) {
+    bool result = false;
+    mutex_lock(&deque->mutex);
+    if (deque->bottom != deque->top) {
+        *item = deque->items[deque->top++ & (deque->capacity - 1)];
+        result = true;
+    }
+    mutex_unlock(&deque->mutex);
+    return result;
+}
+
+void
+work_pool_init(Work_Pool* pool, int worker_count) {
+    zero_struct(*pool);
+    if (worker_count <= 0) {
+        worker_count = platform_processor_count();
+    }
+    
+    pool->worker_count = worker_count;
+    pool->workers = (Worker*) calloc(worker_count, sizeof(Worker));
+    for (int i = 0; i < worker_count; i++) {
+        Worker* worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        worker->random_state = 2463534242u + i*7919;
+        mutex_init(&worker->deque.mutex);
+    }
+}
+
+void
+work_pool_free(Work_Pool* pool) {
+    for (int i = 0; i < pool->worker_count; i++) {
+        Worker* worker = &pool->workers[i];
+        mutex_destroy(&worker->deque.mutex);
+        free(worker->deque.items);
+        arena_clear(&worker->arena);
+    }
+    free(pool->workers);
+    zero_struct(*pool);
+}
+
+// NOTE(Alexander): pushes to the workers own deque, if worker is null then work is
+// distributed round-robin, this is only safe to do from the thread running the pool.
+void
+work_pool_push(Work_Pool* pool, Worker* worker, Work_Proc* proc, void* data) {
+    if (!worker) {
+        worker = &pool->workers[pool->next_worker++ % pool->worker_count];
+    }
+    
+    Work_Item item;
+    item.proc = proc;
+    item.data = data;
+    atomic_add_u32(&pool->pending_count, 1);
+    work_deque_push(&worker->deque, item);
+}
+
+bool
+worker_steal(Worker* worker, Work_Item* item) {
+    Work_Pool* pool = worker->pool;
+    if (pool->worker_count <= 1) {
+        return false;
+    }
+    
+    // NOTE(Alexander): xorshift to pick the first victim, then try every other worker once
+    u32 x = worker->random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    worker->random_state = x;
+    
+    for (int i = 0; i < pool->worker_count; i++) {
+        Worker* victim = &pool->workers[(x + i) % pool->worker_count];
+        if (victim != worker && work_deque_steal(&victim->deque, item)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+worker_run(void* data) {
+    Worker* worker = (Worker*) data;
+    Work_Pool* pool = worker->pool;
+    
+    for (;;) {
+        Work_Item item;
+        if (work_deque_pop(&worker->deque, &item) || worker_steal(worker, &item)) {
+            item.proc(worker, item.data);
+            atomic_add_u32(&pool->pending_count, (u32) -1);
+        } else if (atomic_load_u32(&pool->pending_count) == 0) {
+            break;
+        } else {
+            platform_yield_thread();
+        }
+    }
+}
+
+// NOTE(Alexander): runs until all work (including work pushed by workers) is completed,
+// the calling thread is used as the first worker.
+void
+work_pool_run(Work_Pool* pool) {
+    for (int i = 1; i < pool->worker_count; i++) {
+        Worker* worker = &pool->workers[i];
+        if (!platform_create_thread(&worker->thread, worker_run, worker)) {
+            worker->pool = 0;
+        }
+    }
+    
+    worker_run(&pool->workers[0]);
+    
+    for (int i = 1; i < pool->worker_count; i++) {
+        Worker* worker = &pool->workers[i];
+        if (worker->pool) {
+            platform_join_thread(&worker->thread);
+        } else {
+            worker->pool = pool;
+        }
+    }
+}
+
+// NOTE(Alexander): converting markdown from memory without going through the filesystem. The dom is
+// parsed into the arena and freed again once the html is rendered. If the sink renders into the same
+// arena the dom is parsed into a scratch arena instead, so the arena only holds the html.
+void
+render_markdown_buffer_to_sink(string source, Memory_Arena* arena, Output_Sink* sink) {
+    Memory_Arena scratch;
+    zero_struct(scratch);
+    Memory_Arena* dom_arena = arena;
+    if (sink->type == OutputSink_Arena && sink->arena == arena) {
+        dom_arena = &scratch;
+    }
+    
+    Temporary_Memory dom_memory = begin_temporary_memory(dom_arena);
+    Dom dom = parse_markdown_buffer(source, dom_arena);
+    generate_html_from_dom_to_sink(&dom, sink);
+    end_temporary_memory(dom_memory);
+    arena_clear(&scratch);
+}
+
+// NOTE(Alexander): the returned html is allocated in the arena (not null terminated), the html is only
+// copied if it didn't fit in a single arena block.
+string
+render_markdown_buffer(string source, Memory_Arena* arena, bool minify) {
+    Dom dom = parse_markdown_buffer(source, arena);
+    Temporary_Memory html_memory = begin_temporary_memory(arena);
+    Output_Sink sink = output_sink_arena(arena);
+    sink.minify = minify;
+    generate_html_from_dom_to_sink(&dom, &sink);
+    
+    Gather_List list;
+    zero_struct(list);
+    gather_push_temporary_memory(&list, html_memory);
+    
+    string result;
+    zero_struct(result);
+    if (list.count == 1) {
+        result = list.buffers[0];
+    } else if (list.count > 1) {
+        for (int i = 0; i < list.count; i++) {
+            result.count += list.buffers[i].count;
+        }
+        result.data = (char*) arena_push_size(arena, result.count, 1);
+        char* dest = result.data;
+        for (int i = 0; i < list.count; i++) {
+            memcpy(dest, list.buffers[i].data, list.buffers[i].count);
+            dest += list.buffers[i].count;
+        }
+    }
+    gather_list_free(&list);
+    return result;
+}
+
+typedef struct {
+    string source;
+    string* html;
+    bool minify;
+} Markdown_Batch_Job;
+
+void
+render_markdown_batch_job(Worker* worker, void* data) {
+    Markdown_Batch_Job* job = (Markdown_Batch_Job*) data;
+    Memory_Arena* arena = &worker->arena;
+    
+    Temporary_Memory temp = begin_temporary_memory(arena);
+    string html = render_markdown_buffer(job->source, arena, job->minify);
+    job->html->data = (char*) malloc(html.count + 1);
+    job->html->count = html.count;
+    memcpy(job->html->data, html.data, html.count);
+    job->html->data[html.count] = 0;
+    end_temporary_memory(temp);
+}
+
+// NOTE(Alexander): converts count markdown buffers in one call on worker_count threads (0 uses one per
+// processor), html[i] is the html of sources[i] so the results are in input order. Each html is
+// allocated with malloc (and null terminated) like generate_html_from_dom.
+void
+render_markdown_buffers(string* sources, string* html, int count, int worker_count, bool minify) {
+    if (count <= 0) {
+        return;
+    }
+    
+    Work_Pool pool;
+    work_pool_init(&pool, min(worker_count > 0 ? worker_count : platform_processor_count(), count));
+    
+    Markdown_Batch_Job* jobs = (Markdown_Batch_Job*) calloc(count, sizeof(Markdown_Batch_Job));
+    for (int i = 0; i < count; i++) {
+        Markdown_Batch_Job* job = &jobs[i];
+        job->source = sources[i];
+        job->html = &html[i];
+        job->minify = minify;
+        work_pool_push(&pool, 0, render_markdown_batch_job, job);
+    }
+    work_pool_run(&pool);
+    
+    free(jobs);
+    work_pool_free(&pool);
+}
+
+// NOTE(Alexander): streaming conversion of very large documents. The input is pushed in chunks and
+// parsed up to its last new line, every top-level block that is followed by another one is complete
+// unless parsing it looked past the end of the input (Tokenizer.reached_end, e.g. a bracket that's still
+// open in the last paragraph, brackets are never looked for past a blank line). The complete blocks are
+// rendered into the sink and flushed, then they're dropped together with the arena so memory is bounded
+// by the chunk size and the largest block instead of the whole document, and the output is the same as
+// rendering the whole document at once. Note that consecutive paragraphs are joined into one block.
+// Incomplete blocks are parsed again later, their diagnostics are only printed the first time.
+#define MARKDOWN_STREAM_CHUNK_SIZE (256*1024)
+
+typedef struct {
+    Output_Sink* sink;
+    Memory_Arena arena;
+    
+    char* buffer;
+    umm buffer_size;
+    umm buffer_used;
+    
+    // NOTE(Alexander): the buffer is parsed again once it reaches this size, it's doubled every time
+    // nothing could be rendered, so a block larger than the chunk size isn't parsed over and over.
+    umm parse_size;
+    umm parsed_used; // NOTE(Alexander): how much of the buffer was parsed before
+} Markdown_Stream;
+
+void
+markdown_stream_begin(Markdown_Stream* stream, Output_Sink* sink) {
+    zero_struct(*stream);
+    stream->sink = sink;
+    stream->parse_size = MARKDOWN_STREAM_CHUNK_SIZE;
+}
+
+// NOTE(Alexander): renders the complete top-level blocks, or everything if finished is set
+void
+markdown_stream_render(Markdown_Stream* stream, bool finished) {
+    PROFILE_BEGIN(Parse, 0);
+    Tokenizer tokenizer;
+    zero_struct(tokenizer);
+    
+    Tokenizer* t = &tokenizer;
+    t->base = stream->buffer;
+    t->curr = t->base;
+    t->end = t->curr + stream->buffer_used;
+    t->quiet_end = t->base + stream->parsed_used;
+    if (!finished) {
+        // NOTE(Alexander): the last line may be cut off, it's left for the next render
+        while (t->end > t->base && t->end[-1] != '\n') {
+            t->end--;
+        }
+    }
+    
+    Dom dom;
+    zero_struct(dom);
+    t->dom = &dom;
+    
+    Dom_Node* root = arena_push_dom_node(&stream->arena, 0);
+    root->type = Dom_Root;
+    dom.seq.first = root;
+    Dom_Node* curr_node = root;
+    
+    Dom_Node* complete_node = root;
+    char* complete_end = t->base;
+    while (t->end > t->base) {
+        char* line_start = t->peeked.symbol ? t->peeked.text.data : t->curr;
+        Dom_Sequence nodes = parse_markdown_line(t, &stream->arena, curr_node);
+        if (!nodes.first || nodes.first->type == Dom_None) {
+            break;
+        }
+        
+        // NOTE(Alexander): a new block only completes the previous one if it was parsed
+        // without running into the end of the buffer, since more input could change it
+        if (nodes.first != curr_node) {
+            if (!t->reached_end) {
+                complete_node = curr_node;
+                complete_end = line_start;
+            }
+            curr_node->next = nodes.first;
+            curr_node = nodes.last;
+        }
+        
+        if (t->reached_end && !finished) {
+            break;
+        }
+    }
+    dom.seq.last = curr_node;
+    char* parsed_end = t->peeked.symbol ? t->peeked.text.data : t->curr;
+    PROFILE_END();
+    
+    if (finished) {
+        complete_node = curr_node;
+        complete_end = t->end;
+    }
+    
+    umm count = complete_end - t->base;
+    if (count > 0) {
+        complete_node->next = 0;
+        dom.seq.last = complete_node;
+        generate_html_from_dom_to_sink(&dom, stream->sink);
+        
+        stream->buffer_used -= count;
+        memmove(stream->buffer, stream->buffer + count, stream->buffer_used);
+    }
+    stream->parsed_used = max(stream->parsed_used, (umm) (parsed_end - t->base)) - count;
+    arena_reset(&stream->arena);
+    
+    stream->parse_size = MARKDOWN_STREAM_CHUNK_SIZE;
+    if (stream->buffer_used*2 > stream->parse_size) {
+        stream->parse_size = stream->buffer_used*2;
+    }
+}
+
+void
+markdown_stream_push(Markdown_Stream* stream, char* data, umm count) {
+    if (stream->buffer_used + count > stream->buffer_size) {
+        stream->buffer_size = max(stream->buffer_size*2, max(stream->buffer_used + count, MARKDOWN_STREAM_CHUNK_SIZE));
+        stream->buffer = (char*) realloc(stream->buffer, stream->buffer_size);
+    }
+    memcpy(stream->buffer + stream->buffer_used, data, count);
+    stream->buffer_used += count;
+    
+    if (stream->buffer_used >= stream->parse_size) {
+        markdown_stream_render(stream, false);
+    }
+}
+
+// NOTE(Alexander): renders the rest of the document and flushes the sink
+void
+markdown_stream_end(Markdown_Stream* stream) {
+    if (stream->buffer_used > 0) {
+        markdown_stream_render(stream, true);
+    }
+    sink_flush(stream->sink);
+    free(stream->buffer);
+    arena_clear(&stream->arena);
+    zero_struct(*stream);
+}
+
+// NOTE(Alexander): converts a file of any size, reading it in MARKDOWN_STREAM_CHUNK_SIZE chunks,
+// returns false if the file couldn't be read.
+bool
+render_markdown_file_streaming(cstring filename, Output_Sink* sink) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        printf("File `%s` was not found!\n", filename);
+        return false;
+    }
+    
+    PROFILE_BEGIN(Page, filename);
+    Markdown_Stream stream;
+    markdown_stream_begin(&stream, sink);
+    char* chunk = (char*) malloc(MARKDOWN_STREAM_CHUNK_SIZE);
+    bool result = true;
+    for (;;) {
+        umm count = fread(chunk, 1, MARKDOWN_STREAM_CHUNK_SIZE, file);
+        if (count == 0) {
+            result = !ferror(file);
+            break;
+        }
+        PROFILE_COUNT(Bytes_Read, count);
+        markdown_stream_push(&stream, chunk, count);
+    }
+    markdown_stream_end(&stream);
+    free(chunk);
+    fclose(file);
+    PROFILE_END();
+    return result;
+}
+
+// NOTE(Alexander): site wide search index. The text of the headings, inline text and links of each page
+// is split into lower case terms while its dom is still in cache, every worker adds the pages it
+// built to its own partial inverted index (no locking) and the partials are merged when the build is done.
+//
+// Binary format (little endian, varints are unsigned LEB128):
+//   "GSIX", u32 version, varint document_count, varint term_count
+//   then for each term in sorted (byte) order:
+//     varint prefix_count (shared with the previous term), varint suffix_count, suffix bytes,
+//     varint posting_count, then per posting in document order: varint document delta, varint frequency
+// The documents (url and title) are listed by id in a small json shard next to the index.
+#define SEARCH_INDEX_VERSION 1
+#define SEARCH_MIN_TERM_LENGTH 2
+#define SEARCH_MAX_TERM_LENGTH 32
+
+typedef struct {
+    u32 document;
+    u32 frequency;
+} Search_Posting;
+
+typedef struct {
+    string term;
+    Search_Posting* postings;
+    u32 posting_count;
+    u32 posting_capacity;
+} Search_Term;
+
+typedef struct {
+    Memory_Arena arena; // NOTE(Alexander): the terms and titles
+    String_Map terms; // NOTE(Alexander): Search_Term
+    String_Map page_terms; // NOTE(Alexander): frequency of each term in the current page
+} Search_Partial_Index;
+
+typedef struct {
+    cstring url;
+    string title;
+} Search_Document;
+
+inline void
+string_map_clear(String_Map* map) {
+    if (map->entries) {
+        memset(map->entries, 0, map->capacity*sizeof(String_Map_Entry));
+    }
+    map->count = 0;
+}
+
+inline bool
+is_search_term_char(char c) {
+    // NOTE(Alexander): utf-8 sequences are kept in the terms as is
+    return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || (u8) c >= 0x80);
+}
+
+// NOTE(Alexander): the term keys are copied into the arena, terms longer than the max are skipped
+void
+search_count_terms(String_Map* page_terms, string text, Memory_Arena* arena) {
+    char* curr = text.data;
+    char* end = curr + text.count;
+    while (curr < end) {
+        while (curr < end && !is_search_term_char(*curr)) curr++;
+        char* begin = curr;
+        while (curr < end && is_search_term_char(*curr)) curr++;
+        
+        umm count = curr - begin;
+        if (count < SEARCH_MIN_TERM_LENGTH || count > SEARCH_MAX_TERM_LENGTH) {
+            continue;
+        }
+        
+        char buffer[SEARCH_MAX_TERM_LENGTH];
+        for (umm i = 0; i < count; i++) {
+            char c = begin[i];
+            buffer[i] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+        }
+        
+        string term;
+        term.data = buffer;
+        term.count = count;
+        umm frequency = (umm) string_map_get(page_terms, term);
+        if (frequency == 0) {
+            term.data = (char*) arena_push_size(arena, count, 1);
+            memcpy(term.data, buffer, count);
+        }
+        string_map_put(page_terms, term, (void*) (frequency + 1));
+    }
+}
+
+void
+search_count_dom_terms(String_Map* page_terms, Dom_Node* node, Memory_Arena* arena, string* title) {
+    for (; node; node = node->next) {
+        switch (node->type) {
+            case Dom_Heading: {
+                if (!title->data) {
+                    *title = node->text;
+                }
+                search_count_terms(page_terms, node->text, arena);
+            } break;
+            
+            case Dom_Inline_Text:
+            case Dom_Link: {
+                search_count_terms(page_terms, node->text, arena);
+            } break;
+            
+            default: {
+                search_count_dom_terms(page_terms, dom_node_first_child(node), arena, title);
+            } break;
+        }
+    }
+}
+
+// NOTE(Alexander): adds one posting per term of the page, temp_arena is only used during the call.
+// Returns the text of the first heading (the title) copied into the index arena.
+string
+search_index_dom(Search_Partial_Index* index, Dom* dom, u32 document, Memory_Arena* temp_arena) {
+    Temporary_Memory temp = begin_temporary_memory(temp_arena);
+    string title;
+    zero_struct(title);
+    string_map_clear(&index->page_terms);
+    search_count_dom_terms(&index->page_terms, dom->seq.first, temp_arena, &title);
+    
+    for (u32 i = 0; i < index->page_terms.capacity; i++) {
+        String_Map_Entry* entry = &index->page_terms.entries[i];
+        if (!entry->key.data) {
+            continue;
+        }
+        
+        Search_Term* term = (Search_Term*) string_map_get(&index->terms, entry->key);
+        if (!term) {
+            term = arena_push_struct(&index->arena, Search_Term);
+            term->term.data = (char*) arena_push_size(&index->arena, entry->key.count, 1);
+            term->term.count = entry->key.count;
+            memcpy(term->term.data, entry->key.data, entry->key.count);
+            string_map_put(&index->terms, term->term, term);
+        }
+        
+        if (term->posting_count == term->posting_capacity) {
+            term->posting_capacity = term->posting_capacity ? term->posting_capacity*2 : 4;
+            term->postings = (Search_Posting*) realloc(term->postings, 
+                                                       term->posting_capacity*sizeof(Search_Posting));
+        }
+        Search_Posting* posting = &term->postings[term->posting_count++];
+        posting->document = document;
+        posting->frequency = (u32) (umm) entry->value;
+    }
+    string_map_clear(&index->page_terms);
+    end_temporary_memory(temp);
+    
+    string result;
+    result.data = (char*) arena_push_size(&index->arena, title.count, 1);
+    result.count = title.count;
+    memcpy(result.data, title.data, title.count);
+    return result;
+}
+
+void
+search_partial_index_free(Search_Partial_Index* index) {
+    for (u32 i = 0; i < index->terms.capacity; i++) {
+        Search_Term* term = (Search_Term*) index->terms.entries[i].value;
+        if (term) {
+            free(term->postings);
+        }
+    }
+    string_map_free(&index->terms);
+    string_map_free(&index->page_terms);
+    arena_clear(&index->arena);
+}
+
+inline void
+string_builder_push_varint(String_Builder* sb, u64 value) {
+    string_builder_ensure_capacity(sb, 10);
+    do {
+        u8 byte = (u8) (value & 0x7f);
+        value >>= 7;
+        sb->data[sb->curr_used++] = (char) (byte | (value ? 0x80 : 0));
+    } while (value);
+}
+
+int
+search_term_compare(const void* a, const void* b) {
+    string x = (*(Search_Term**) a)->term;
+    string y = (*(Search_Term**) b)->term;
+    int result = memcmp(x.data, y.data, min(x.count, y.count));
+    return result ? result : (x.count > y.count) - (x.count < y.count);
+}
+
+int
+search_posting_compare(const void* a, const void* b) {
+    u32 x = ((Search_Posting*) a)->document;
+    u32 y = ((Search_Posting*) b)->document;
+    return (x > y) - (x < y);
+}
+
+// NOTE(Alexander): merges the partial indexes into the binary index format described above, the
+// postings of a term are concatenated from the partials and then sorted by document.
+string
+search_merge_partial_indexes(Search_Partial_Index* partials, int partial_count, u32 document_count) {
+    String_Map merged;
+    zero_struct(merged);
+    Search_Term** terms = 0;
+    u32 term_count = 0;
+    u32 term_capacity = 0;
+    
+    for (int i = 0; i < partial_count; i++) {
+        String_Map* partial_terms = &partials[i].terms;
+        for (u32 j = 0; j < partial_terms->capacity; j++) {
+            Search_Term* term = (Search_Term*) partial_terms->entries[j].value;
+            if (!term) {
+                continue;
+            }
+            
+            Search_Term* dest = (Search_Term*) string_map_get(&merged, term->term);
+            if (!dest) {
+                // NOTE(Alexander): the first partial with the term donates its postings
+                if (term_count == term_capacity) {
+                    term_capacity = term_capacity ? term_capacity*2 : 1024;
+                    terms = (Search_Term**) realloc(terms, term_capacity*sizeof(Search_Term*));
+                }
+                terms[term_count++] = term;
+                string_map_put(&merged, term->term, term);
+                continue;
+            }
+            
+            if (dest->posting_count + term->posting_count > dest->posting_capacity) {
+                dest->posting_capacity = max(dest->posting_capacity*2, dest->posting_count + term->posting_count);
+                dest->postings = (Search_Posting*) realloc(dest->postings, 
+                                                           dest->posting_capacity*sizeof(Search_Posting));
+            }
+            memcpy(dest->postings + dest->posting_count, term->postings, term->posting_count*sizeof(Search_Posting));
+            dest->posting_count += term->posting_count;
+            term->posting_count = 0;
+        }
+    }
+    
+    qsort(terms, term_count, sizeof(Search_Term*), search_term_compare);
+    
+    String_Builder sb;
+    zero_struct(sb);
+    string_builder_push_string(&sb, string_lit("GSIX"));
+    u32 version = SEARCH_INDEX_VERSION;
+    u8 version_bytes[4] = { (u8) version, (u8) (version >> 8), (u8) (version >> 16), (u8) (version >> 24) };
+    string version_string;
+    version_string.data = (char*) version_bytes;
+    version_string.count = sizeof(version_bytes);
+    string_builder_push_string(&sb, version_string);
+    string_builder_push_varint(&sb, document_count);
+    string_builder_push_varint(&sb, term_count);
+    
+    string prev_term;
+    zero_struct(prev_term);
+    for (u32 i = 0; i < term_count; i++) {
+        Search_Term* term = terms[i];
+        umm prefix_count = 0;
+        while (prefix_count < min(prev_term.count, term->term.count) && 
+               prev_term.data[prefix_count] == term->term.data[prefix_count]) {
+            prefix_count++;
+        }
+        
+        string suffix;
+        suffix.data = term->term.data + prefix_count;
+        suffix.count = term->term.count - prefix_count;
+        string_builder_push_varint(&sb, prefix_count);
+        string_builder_push_varint(&sb, suffix.count);
+        string_builder_push_string(&sb, suffix);
+        prev_term = term->term;
+        
+        qsort(term->postings, term->posting_count, sizeof(Search_Posting), search_posting_compare);
+        string_builder_push_varint(&sb, term->posting_count);
+        u32 prev_document = 0;
+        for (u32 j = 0; j < term->posting_count; j++) {
+            string_builder_push_varint(&sb, term->postings[j].document - prev_document);
+            string_builder_push_varint(&sb, term->postings[j].frequency);
+            prev_document = term->postings[j].document;
+        }
+    }
+    
+    free(terms);
+    string_map_free(&merged);
+    return string_builder_to_string_nocopy(&sb);
+}
+
+// NOTE(Alexander): called from the worker threads with every generated page, the buffers are only
+// valid during the call. Removed pages (while watching) are reported with zero buffers.
+typedef void Site_Page_Callback(void* user_data, cstring output_path, string* buffers, int count);
+
+typedef struct {
+    cstring source_dir;
+    cstring output_dir;
+    
+    // NOTE(Alexander): the generated html is passed to the template as args[content_arg_index],
+    // template_arg_names is optional and gives the names of the args used by ${name} placeholders.
+    // If template_path is set the template is loaded from it through the template cache, resolving
+    // @include and @extends, and template_source is ignored.
+    cstring template_path;
+    string template_source;
+    string* template_args;
+    string* template_arg_names;
+    int template_argc;
+    int content_arg_index;
+    
+    int worker_count; // NOTE(Alexander): 0 uses one worker per processor
+    
+    // NOTE(Alexander): enables incremental builds, only files whose inputs changed are rebuilt
+    cstring manifest_path;
+    
+    Site_Page_Callback* page_callback;
+    void* page_callback_data;
+    
+    // NOTE(Alexander): writes a gzip compressed copy (.gz) next to every page and asset,
+    // compress_level 0 uses the default (6) and compress_max_size 0 has no upper limit.
+    bool precompress;
+    int compress_level;
+    umm compress_min_size;
+    umm compress_max_size;
+    
+    File_Copy_Mode asset_copy_mode;
+    
+    // NOTE(Alexander): assets (see fingerprint_extensions) are written as name.<hash>.ext and every
+    // reference to them in the template args, images and links is rewritten. The mapping is written
+    // as json to asset_manifest_path, 0 uses <output_dir>/asset-manifest.json.
+    bool fingerprint_assets;
+    cstring asset_manifest_path;
+    
+    // NOTE(Alexander): renders the pages without indentation and minifies the template, see template_minify
+    bool minify_html;
+    
+    // NOTE(Alexander): outputs identical to the existing file aren't written (keeping its modification
+    // time) and others are replaced atomically, see write_file_if_changed_gather
+    bool write_if_changed;
+    
+    // NOTE(Alexander): writes a search index of all pages, see search_merge_partial_indexes. The path
+    // defaults to <output_dir>/search-index.bin, the documents are written next to it as .json
+    bool search_index;
+    cstring search_index_path;
+} Site_Config;
+
+typedef struct {
+    u32 page_count;
+    u32 asset_count;
+    u32 skipped_count;
+    volatile u32 unchanged_count; // NOTE(Alexander): rebuilt but already up to date, nothing was written
+    volatile u32 written_count;
+    volatile u32 compressed_count;
+    volatile u32 failed_count;
+} Site_Build_Stats;
+
+typedef struct Site_File Site_File;
+struct Site_File {
+    cstring source_path;
+    cstring output_path;
+    bool is_page;
+    bool dirty;
+    bool removed; // NOTE(Alexander): the source was deleted while watching
+    u64 hash; // NOTE(Alexander): content hash of a fingerprinted asset, 0 until it's hashed
+    u32 document; // NOTE(Alexander): id of the page in the search index
+    
+    // NOTE(Alexander): files included by the page, stored in a single malloced block
+    cstring* dependencies;
+    int dependency_count;
+    
+    Site_File* next;
+};
+
+// NOTE(Alexander): the build manifest records the content hash of every source file
+// and the files each page includes, so the next build can skip unchanged pages.
+typedef struct {
+    cstring filename;
+    u64 hash;
+    u64 size;
+    u64 modified_time;
+    bool changed; // NOTE(Alexander): compared to the previous manifest
+} Manifest_File;
+
+typedef struct {
+    cstring source_path;
+    cstring* dependencies;
+    int dependency_count;
+} Manifest_Page;
+
+typedef struct {
+    Memory_Arena arena;
+    u64 config_hash;
+    String_Map files;
+    String_Map pages;
+} Build_Manifest;
+
+#define BUILD_MANIFEST_VERSION 1
+
+void
+build_manifest_free(Build_Manifest* manifest) {
+    string_map_free(&manifest->files);
+    string_map_free(&manifest->pages);
+    arena_clear(&manifest->arena);
+    zero_struct(*manifest);
+}
+
+bool
+load_build_manifest(Build_Manifest* manifest, cstring filepath) {
+    zero_struct(*manifest);
+    if (!platform_get_file_info(filepath).exists) {
+        return false;
+    }
+    
+    string contents = read_entire_file(filepath);
+    if (!contents.data) {
+        return false;
+    }
+    
+    Memory_Arena* arena = &manifest->arena;
+    Manifest_Page* page = 0;
+    int version = 0;
+    
+    char line[4096 + 128];
+    char* curr = contents.data;
+    char* end = contents.data + contents.count;
+    while (curr < end) {
+        char* line_end = curr;
+        while (line_end < end && *line_end != '\n') line_end++;
+        umm count = min((umm) (line_end - curr), sizeof(line) - 1);
+        memcpy(line, curr, count);
+        line[count] = 0;
+        curr = line_end + 1;
+        
+        unsigned long long hash, size, modified_time;
+        int offset = 0;
+        if (sscanf(line, "generator-manifest %d", &version) == 1) {
+            continue;
+        } else if (version != BUILD_MANIFEST_VERSION) {
+            break;
+        }
+        
+        if (sscanf(line, "config %llx", &hash) == 1) {
+            manifest->config_hash = hash;
+            
+        } else if (sscanf(line, "file %llx %llu %llu %n", &hash, &size, &modified_time, &offset) == 3 && offset > 0) {
+            Manifest_File* file = arena_push_struct(arena, Manifest_File);
+            file->filename = arena_push_format(arena, "%s", line + offset);
+            file->hash = hash;
+            file->size = size;
+            file->modified_time = modified_time;
+            string_map_put(&manifest->files, string_lit(file->filename), file);
+            
+        } else if (memcmp(line, "page ", 5) == 0) {
+            page = arena_push_struct(arena, Manifest_Page);
+            page->source_path = arena_push_format(arena, "%s", line + 5);
+            string_map_put(&manifest->pages, string_lit(page->source_path), page);
+            
+        } else if (memcmp(line, "dep ", 4) == 0 && page) {
+            // NOTE(Alexander): dependencies are always stored right after their page
+            cstring* dependencies = arena_push_array(arena, cstring, page->dependency_count + 1);
+            for (int i = 0; i < page->dependency_count; i++) dependencies[i] = page->dependencies[i];
+            dependencies[page->dependency_count++] = arena_push_format(arena, "%s", line + 4);
+            page->dependencies = dependencies;
+        }
+    }
+    
+    free(contents.data);
+    if (version != BUILD_MANIFEST_VERSION) {
+        build_manifest_free(manifest);
+        return false;
+    }
+    return true;
+}
+
+bool
+save_build_manifest(Build_Manifest* manifest, cstring filepath) {
+    FILE* file = fopen(filepath, "wb");
+    if (!file) {
+        printf("Failed to open `%s` for writing!\n", filepath);
+        return false;
+    }
+    
+    fprintf(file, "generator-manifest %d\n", BUILD_MANIFEST_VERSION);
+    fprintf(file, "config %llx\n", (unsigned long long) manifest->config_hash);
+    
+    for (u32 i = 0; i < manifest->files.capacity; i++) {
+        Manifest_File* entry = (Manifest_File*) manifest->files.entries[i].value;
+        if (entry) {
+            fprintf(file, "file %llx %llu %llu %s\n", (unsigned long long) entry->hash, 
+                    (unsigned long long) entry->size, (unsigned long long) entry->modified_time, 
+                    entry->filename);
+        }
+    }
+    
+    for (u32 i = 0; i < manifest->pages.capacity; i++) {
+        Manifest_Page* entry = (Manifest_Page*) manifest->pages.entries[i].value;
+        if (entry) {
+            fprintf(file, "page %s\n", entry->source_path);
+            for (int j = 0; j < entry->dependency_count; j++) {
+                fprintf(file, "dep %s\n", entry->dependencies[j]);
+            }
+        }
+    }
+    
+    fclose(file);
+    return true;
+}
+
+typedef struct {
+    Site_Config* config;
+    Site_Build_Stats stats;
+    Memory_Arena arena;
+    Work_Pool pool;
+    Template tmpl;
+    
+    Site_File* first_file;
+    Site_File* last_file;
+    
+    Build_Manifest* prev_manifest;
+    Build_Manifest manifest;
+    
+    // NOTE(Alexander): fingerprinted assets (Site_File) keyed by their path relative to the source_dir,
+    // the template args with the asset references rewritten and a hash of the entire mapping.
+    String_Map fingerprints;
+    string* template_args;
+    u64 fingerprint_hash;
+    
+    Template* cached_tmpl; // NOTE(Alexander): the cache entry tmpl was copied from, with template_path
+    
+    // NOTE(Alexander): one partial index per worker, only while the search index is built
+    Search_Partial_Index* search_partials;
+    Search_Document* search_documents;
+    u32 search_document_count;
+    
+    bool track_dependencies; // NOTE(Alexander): always record the page dependencies, e.g. when watching
+} Site_Build;
+
+// NOTE(Alexander): stats and hashes each file at most once per build, the content is only
+// read when the size or modification time is different from the previous manifest.
+Manifest_File*
+build_check_file(Site_Build* build, cstring filename) {
+    Build_Manifest* manifest = &build->manifest;
+    Manifest_File* file = (Manifest_File*) string_map_get(&manifest->files, string_lit(filename));
+    if (file) {
+        return file;
+    }
+    
+    Manifest_File* prev_file = 0;
+    if (build->prev_manifest) {
+        prev_file = (Manifest_File*) string_map_get(&build->prev_manifest->files, string_lit(filename));
+    }
+    
+    File_Info info = platform_get_file_info(filename);
+    file = arena_push_struct(&manifest->arena, Manifest_File);
+    file->filename = arena_push_format(&manifest->arena, "%s", filename);
+    file->size = info.size;
+    file->modified_time = info.modified_time;
+    
+    if (prev_file && prev_file->size == info.size && prev_file->modified_time == info.modified_time) {
+        file->hash = prev_file->hash;
+    } else {
+        if (info.exists) {
+            Mapped_File contents = map_entire_file(filename);
+            file->hash = string_content_hash(contents.contents);
+            unmap_file(&contents);
+        }
+        file->changed = !prev_file || prev_file->hash != file->hash;
+    }
+    
+    string_map_put(&manifest->files, string_lit(file->filename), file);
+    return file;
+}
+
+u64
+site_config_hash(Site_Config* config) {
+    Content_Hash state;
+    content_hash_begin(&state);
+    content_hash_update(&state, config->template_source.data, config->template_source.count);
+    for (int i = 0; i < config->template_argc; i++) {
+        if (i != config->content_arg_index) {
+            string arg = config->template_args[i];
+            content_hash_update(&state, &arg.count, sizeof(arg.count));
+            content_hash_update(&state, arg.data, arg.count);
+        }
+        if (config->template_arg_names) {
+            string name = config->template_arg_names[i];
+            content_hash_update(&state, &name.count, sizeof(name.count));
+            content_hash_update(&state, name.data, name.count);
+        }
+    }
+    content_hash_update(&state, (void*) config->output_dir, strlen(config->output_dir));
+    
+    // NOTE(Alexander): pretty and minified pages differ for the same sources
+    u8 minify_html = config->minify_html;
+    content_hash_update(&state, &minify_html, sizeof(minify_html));
+    return content_hash_end(&state);
+}
+
+bool
+build_is_page_dirty(Site_Build* build, Site_File* file) {
+    if (!build->prev_manifest || build->prev_manifest->config_hash != build->manifest.config_hash) {
+        return true;
+    }
+    
+    Manifest_Page* prev_page = (Manifest_Page*) string_map_get(&build->prev_manifest->pages, 
+                                                               string_lit(file->source_path));
+    if (!prev_page || !platform_get_file_info(file->output_path).exists) {
+        return true;
+    }
+    
+    if (build_check_file(build, file->source_path)->changed) {
+        return true;
+    }
+    
+    for (int i = 0; i < prev_page->dependency_count; i++) {
+        if (build_check_file(build, prev_page->dependencies[i])->changed) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool
+cstring_ends_with(cstring str, cstring suffix) {
+    umm count = strlen(str);
+    umm suffix_count = strlen(suffix);
+    return count >= suffix_count && memcmp(str + count - suffix_count, suffix, suffix_count) == 0;
+}
+
+// NOTE(Alexander): already compressed formats are not worth compressing again
+static cstring precompress_skip_extensions[] = {
+    ".gz", ".br", ".zip", ".png", ".jpg", ".jpeg", ".gif", ".webp", ".woff", ".woff2", ".mp3", ".mp4"
+};
+
+cstring
+site_file_gzip_path(Memory_Arena* arena, Site_File* file) {
+    return arena_push_format(arena, "%s.gz", file->output_path);
+}
+
+// NOTE(Alexander): compresses the output of a file, the existing .gz is kept if its trailer
+// (crc32 and size) matches the current output so unchanged files are not compressed again.
+void
+build_site_compress(Worker* worker, void* data) {
+    Site_File* file = (Site_File*) data;
+    Site_Build* build = (Site_Build*) worker->pool->user_data;
+    Site_Config* config = build->config;
+    Temporary_Memory temp = begin_temporary_memory(&worker->arena);
+    cstring gzip_path = site_file_gzip_path(&worker->arena, file);
+    PROFILE_BEGIN(Compress, file->output_path);
+    
+    for (int i = 0; i < array_count(precompress_skip_extensions); i++) {
+        if (cstring_ends_with(file->output_path, precompress_skip_extensions[i])) {
+            goto done;
+        }
+    }
+    
+    File_Info info = platform_get_file_info(file->output_path);
+    if (!info.exists || info.size < config->compress_min_size || 
+        (config->compress_max_size && info.size > config->compress_max_size)) {
+        remove(gzip_path);
+        goto done;
+    }
+    
+    Mapped_File output = map_entire_file(file->output_path);
+    u32 crc = crc32_update(0, output.contents.data, output.contents.count);
+    u32 prev_crc, prev_size;
+    if (gzip_read_trailer(gzip_path, &prev_crc, &prev_size) && 
+        prev_crc == crc && prev_size == (u32) output.contents.count) {
+        unmap_file(&output);
+        goto done;
+    }
+    
+    int level = config->compress_level ? config->compress_level : 6;
+    string compressed = gzip_compress_ex(output.contents, level, crc);
+    if (compressed.count < output.contents.count) {
+        bool written = (config->write_if_changed ? 
+                        write_entire_file_if_changed(gzip_path, compressed) != WriteResult_Failed :
+                        write_entire_file(gzip_path, compressed));
+        if (written) {
+            atomic_add_u32(&build->stats.compressed_count, 1);
+        } else {
+            atomic_add_u32(&build->stats.failed_count, 1);
+        }
+    } else {
+        remove(gzip_path);
+    }
+    free(compressed.data);
+    unmap_file(&output);
+    
+    done:
+    PROFILE_END();
+    end_temporary_memory(temp);
+}
+
+// NOTE(Alexander): assets that are referenced by pages and are safe to cache forever once fingerprinted,
+// other assets (e.g. robots.txt or favicon.ico) are expected at fixed urls.
+static cstring fingerprint_extensions[] = {
+    ".css", ".js", ".png", ".jpg", ".jpeg", ".gif", ".svg", ".webp", ".woff", ".woff2"
+};
+
+bool
+site_file_is_fingerprinted(Site_File* file) {
+    if (file->is_page) {
+        return false;
+    }
+    
+    for (int i = 0; i < array_count(fingerprint_extensions); i++) {
+        if (cstring_ends_with(file->source_path, fingerprint_extensions[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// NOTE(Alexander): the path relative to the source_dir without the leading separator, e.g. assets/style.css
+cstring
+site_file_relative_path(Site_Config* config, Site_File* file) {
+    cstring result = file->source_path + strlen(config->source_dir);
+    while (*result == '/' || *result == '\\') result++;
+    return result;
+}
+
+void
+build_site_hash_asset(Worker* worker, void* data) {
+    Site_File* file = (Site_File*) data;
+    Site_Build* build = (Site_Build*) worker->pool->user_data;
+    PROFILE_BEGIN(Hash, file->source_path);
+    
+    Manifest_File* prev_file = 0;
+    if (build->prev_manifest) {
+        prev_file = (Manifest_File*) string_map_get(&build->prev_manifest->files, string_lit(file->source_path));
+    }
+    
+    File_Info info = platform_get_file_info(file->source_path);
+    if (prev_file && prev_file->size == info.size && prev_file->modified_time == info.modified_time) {
+        file->hash = prev_file->hash;
+    } else {
+        Mapped_File contents = map_entire_file(file->source_path);
+        file->hash = string_content_hash(contents.contents);
+        unmap_file(&contents);
+    }
+    PROFILE_END();
+}
+
+// NOTE(Alexander): resolves a root relative (/assets/style.css) or page relative (../style.css) url
+// against page_dir and if it names a fingerprinted asset only the filename is replaced, the rest of
+// the url including any query or fragment is kept as written. Other urls are returned unchanged.
+string
+site_build_rewrite_asset_url(Site_Build* build, string page_dir, string url, char* buffer, umm buffer_size) {
+    umm path_count = 0;
+    while (path_count < url.count && url.data[path_count] != '?' && url.data[path_count] != '#') {
+        if (url.data[path_count] == ':') {
+            return url; // NOTE(Alexander): has a scheme, e.g. https: or mailto:
+        }
+        path_count++;
+    }
+    
+    if (path_count == 0 || (path_count >= 2 && url.data[0] == '/' && url.data[1] == '/')) {
+        return url;
+    }
+    
+    char path[4096];
+    umm count = 0;
+    string parts[2];
+    parts[0] = page_dir;
+    parts[0].count = url.data[0] == '/' ? 0 : page_dir.count;
+    parts[1].data = url.data;
+    parts[1].count = path_count;
+    
+    for (int i = 0; i < array_count(parts); i++) {
+        char* curr = parts[i].data;
+        char* end = curr + parts[i].count;
+        while (curr < end) {
+            char* segment = curr;
+            while (curr < end && *curr != '/') curr++;
+            umm segment_count = curr - segment;
+            if (curr < end) curr++;
+            
+            if (segment_count == 0 || (segment_count == 1 && segment[0] == '.')) {
+                continue;
+            }
+            
+            if (segment_count == 2 && segment[0] == '.' && segment[1] == '.') {
+                if (count == 0) {
+                    return url; // NOTE(Alexander): outside of the site
+                }
+                while (count > 0 && path[count - 1] != '/') count--;
+                if (count > 0) count--;
+                continue;
+            }
+            
+            if (count + segment_count + 1 >= sizeof(path)) {
+                return url;
+            }
+            if (count > 0) {
+                path[count++] = '/';
+            }
+            memcpy(path + count, segment, segment_count);
+            count += segment_count;
+        }
+    }
+    
+    string key;
+    key.data = path;
+    key.count = count;
+    Site_File* file = (Site_File*) string_map_get(&build->fingerprints, key);
+    if (!file || file->removed) {
+        return url;
+    }
+    
+    umm prefix_count = path_count;
+    while (prefix_count > 0 && url.data[prefix_count - 1] != '/') prefix_count--;
+    cstring name = file->output_path + strlen(file->output_path);
+    while (name > file->output_path && name[-1] != '/' && name[-1] != '\\') name--;
+    
+    int length = snprintf(buffer, buffer_size, "%.*s%s%.*s", (int) prefix_count, url.data, name, 
+                          (int) (url.count - path_count), url.data + path_count);
+    if (length < 0 || (umm) length >= buffer_size) {
+        return url;
+    }
+    
+    string result;
+    result.data = buffer;
+    result.count = length;
+    return result;
+}
+
+typedef struct {
+    Site_Build* build;
+    string page_dir; // NOTE(Alexander): relative to the site root, empty for pages at the root
+} Asset_Url_Context;
+
+string
+asset_url_rewrite_callback(void* user_data, string url, char* buffer, umm buffer_size) {
+    Asset_Url_Context* context = (Asset_Url_Context*) user_data;
+    return site_build_rewrite_asset_url(context->build, context->page_dir, url, buffer, buffer_size);
+}
+
+// NOTE(Alexander): json object mapping the source paths to the fingerprinted output paths,
+// e.g. { "assets/style.css": "assets/style.5f3a09c2b1d4.css" }
+bool
+write_asset_manifest(Site_Build* build, cstring filepath) {
+    Site_Config* config = build->config;
+    FILE* file = fopen(filepath, "wb");
+    if (!file) {
+        printf("Failed to open `%s` for writing!\n", filepath);
+        return false;
+    }
+    
+    fputc('{', file);
+    bool first = true;
+    for (Site_File* it = build->first_file; it; it = it->next) {
+        if (it->removed || !it->hash || !site_file_is_fingerprinted(it)) {
+            continue;
+        }
+        
+        cstring output_path = it->output_path + strlen(config->output_dir);
+        while (*output_path == '/' || *output_path == '\\') output_path++;
+        fprintf(file, first ? "\n    " : ",\n    ");
+        write_json_string(file, site_file_relative_path(config, it));
+        fprintf(file, ": ");
+        write_json_string(file, output_path);
+        first = false;
+    }
+    fprintf(file, "\n}\n");
+    fclose(file);
+    return true;
+}
+
+// NOTE(Alexander): hashes the new and changed assets in parallel and gives them their fingerprinted
+// output paths, then the template args are rewritten and the asset manifest is written.
+// Returns true if the mapping changed since the last call, i.e. the pages have to be rebuilt.
+bool
+site_build_fingerprint_assets(Site_Build* build) {
+    Site_Config* config = build->config;
+    for (Site_File* file = build->first_file; file; file = file->next) {
+        if (!file->removed && (file->dirty || !file->hash) && site_file_is_fingerprinted(file)) {
+            work_pool_push(&build->pool, 0, build_site_hash_asset, file);
+        }
+    }
+    work_pool_run(&build->pool);
+    
+    u64 mapping_hash = 0;
+    for (Site_File* file = build->first_file; file; file = file->next) {
+        if (file->removed || !file->hash || !site_file_is_fingerprinted(file)) {
+            continue;
+        }
+        
+        cstring relative_path = site_file_relative_path(config, file);
+        string key = string_lit(relative_path);
+        if (file->dirty || string_map_get(&build->fingerprints, key) != file) {
+            cstring source_path = file->source_path + strlen(config->source_dir);
+            cstring extension = strrchr(source_path, '.');
+            file->output_path = arena_push_format(&build->arena, "%s%.*s.%012llx%s", config->output_dir, 
+                                                  (int) (extension - source_path), source_path, 
+                                                  (unsigned long long) (file->hash >> 16), extension);
+            string_map_put(&build->fingerprints, key, file);
+        }
+        
+        // NOTE(Alexander): order independent, the files are visited in directory order
+        mapping_hash += content_hash_mix(string_content_hash(key), file->hash);
+    }
+    
+    if (build->template_args && mapping_hash == build->fingerprint_hash) {
+        return false;
+    }
+    build->fingerprint_hash = mapping_hash;
+    
+    build->template_args = arena_push_array(&build->arena, string, config->template_argc);
+    for (int i = 0; i < config->template_argc; i++) {
+        string arg = config->template_args[i];
+        if (i != config->content_arg_index) {
+            // NOTE(Alexander): template args are resolved from the site root
+            char buffer[4096];
+            string page_dir;
+            zero_struct(page_dir);
+            arg = site_build_rewrite_asset_url(build, page_dir, arg, buffer, sizeof(buffer));
+            if (arg.data == buffer) {
+                arg.data = (char*) arena_push_format(&build->arena, "%.*s", (int) arg.count, arg.data);
+            }
+        }
+        build->template_args[i] = arg;
+    }
+    
+    Temporary_Memory temp = begin_temporary_memory(&build->arena);
+    cstring manifest_path = config->asset_manifest_path;
+    if (!manifest_path) {
+        manifest_path = arena_push_format(&build->arena, "%s/asset-manifest.json", config->output_dir);
+    }
+    platform_create_parent_directories(manifest_path);
+    if (!write_asset_manifest(build, manifest_path)) {
+        build->stats.failed_count++;
+    }
+    end_temporary_memory(temp);
+    return true;
 }
 
-inline bool
-is_unordered_list_symbol(char c) {
-    return c == '*' || c == '+' || c == '-';
+inline void
+build_site_index_dom(Site_Build* build, Worker* worker, Site_File* file, Dom* dom) {
+    PROFILE_BEGIN(Index, file->source_path);
+    Search_Partial_Index* index = &build->search_partials[worker->index];
+    build->search_documents[file->document].title = search_index_dom(index, dom, file->document, &worker->arena);
+    PROFILE_END();
 }
 
-// NOTE(Alexander): parses a chain of nodes, returns the last node
-Dom_Sequence
-parse_markdown_text_line(Tokenizer* t, Memory_Arena* arena, Token token)  {
-    Dom_Sequence result;
+// NOTE(Alexander): pages that are up to date are only parsed to be added to the search index
+void
+build_site_index_page(Worker* worker, void* data) {
+    Site_File* file = (Site_File*) data;
+    Site_Build* build = (Site_Build*) worker->pool->user_data;
+    Dom dom = read_markdown_file_ex(file->source_path, &worker->arena);
+    build_site_index_dom(build, worker, file, &dom);
+    free_dom_sources(&dom);
+    arena_reset(&worker->arena);
+}
+
+// NOTE(Alexander): reads the document count from the header of an existing index, returns false if
+// the file is missing or isn't an index of the current version.
+bool
+search_index_read_document_count(cstring filepath, u32* document_count) {
+    FILE* file = fopen(filepath, "rb");
+    if (!file) {
+        return false;
+    }
     
-    result.first = arena_push_dom_node(arena, 0);
-    result.last = result.first;
+    u8 header[8 + 5];
+    umm count = fread(header, 1, sizeof(header), file);
+    fclose(file);
     
-    Dom_Node* node = result.first;
-    node->type = Dom_Inline_Text;
-    node->text.data = token.text.data;
-    node->text.count = 0;
+    if (count < 9 || memcmp(header, "GSIX", 4) != 0) {
+        return false;
+    }
     
-    for (;;) {
-        if (!token.symbol) {
-            break;
+    u32 version = (u32) header[4] | ((u32) header[5] << 8) | ((u32) header[6] << 16) | ((u32) header[7] << 24);
+    if (version != SEARCH_INDEX_VERSION) {
+        return false;
+    }
+    
+    u64 value = 0;
+    for (umm i = 8, shift = 0; i < count && shift < 35; i++, shift += 7) {
+        value |= (u64) (header[i] & 0x7f) << shift;
+        if (!(header[i] & 0x80)) {
+            *document_count = (u32) value;
+            return true;
         }
-        
-        if (token.new_line) {
-            node->text.count += token.text.count;
-            break;
+    }
+    return false;
+}
+
+cstring
+site_search_index_path(Site_Build* build) {
+    Site_Config* config = build->config;
+    if (config->search_index_path) {
+        return config->search_index_path;
+    }
+    return arena_push_format(&build->search_partials[0].arena, "%s/search-index.bin", config->output_dir);
+}
+
+// NOTE(Alexander): the index is only rebuilt if a page changed, was removed (compared to the previous
+// manifest or the documents in the index) or it doesn't exist yet, every page then gets a document id
+// (in file order) and a partial index is created for each worker.
+bool
+site_build_search_begin(Site_Build* build) {
+    Site_Config* config = build->config;
+    bool changed = false;
+    u32 page_count = 0;
+    for (Site_File* file = build->first_file; file; file = file->next) {
+        if (file->is_page && !file->removed) {
+            changed |= file->dirty;
+            file->document = page_count++;
+        }
+    }
+    
+    if (build->prev_manifest && build->prev_manifest->pages.count != page_count) {
+        changed = true;
+    }
+    
+    int worker_count = build->pool.worker_count;
+    build->search_partials = (Search_Partial_Index*) calloc(worker_count, sizeof(Search_Partial_Index));
+    u32 document_count = 0;
+    if (!changed && search_index_read_document_count(site_search_index_path(build), &document_count) &&
+        document_count == page_count) {
+        arena_clear(&build->search_partials[0].arena);
+        free(build->search_partials);
+        build->search_partials = 0;
+        return false;
+    }
+    
+    build->search_document_count = page_count;
+    build->search_documents = (Search_Document*) calloc(max(page_count, 1), sizeof(Search_Document));
+    for (Site_File* file = build->first_file; file; file = file->next) {
+        if (file->is_page && !file->removed) {
+            cstring url = file->output_path + strlen(config->output_dir);
+            while (*url == '/' || *url == '\\') url++;
+            build->search_documents[file->document].url = url;
+        }
+    }
+    return true;
+}
+
+void
+site_build_search_end(Site_Build* build) {
+    Site_Config* config = build->config;
+    Memory_Arena* arena = &build->search_partials[0].arena;
+    cstring index_path = site_search_index_path(build);
+    
+    string index = search_merge_partial_indexes(build->search_partials, build->pool.worker_count, 
+                                                 build->search_document_count);
+    platform_create_parent_directories(index_path);
+    bool written = (config->write_if_changed ? 
+                    write_entire_file_if_changed(index_path, index) != WriteResult_Failed :
+                    write_entire_file(index_path, index));
+    if (!written) {
+        build->stats.failed_count++;
+    }
+    free(index.data);
+    
+    // NOTE(Alexander): the json shard replaces the extension of the index, e.g. search-index.json
+    cstring index_name = index_path + strlen(index_path);
+    while (index_name > index_path && index_name[-1] != '/' && index_name[-1] != '\\') index_name--;
+    cstring extension = strrchr(index_name, '.');
+    int stem_count = (int) (extension ? extension - index_path : strlen(index_path));
+    cstring json_path = arena_push_format(arena, "%.*s.json", stem_count, index_path);
+    
+    FILE* file = fopen(json_path, "wb");
+    if (file) {
+        fprintf(file, "{\n  \"version\": %d,\n  \"index\": ", SEARCH_INDEX_VERSION);
+        write_json_string(file, index_name);
+        fprintf(file, ",\n  \"documents\": [");
+        for (u32 i = 0; i < build->search_document_count; i++) {
+            Search_Document* document = &build->search_documents[i];
+            fprintf(file, "%s\n    { \"url\": ", i > 0 ? "," : "");
+            write_json_string(file, document->url ? document->url : "");
+            fprintf(file, ", \"title\": ");
+            write_json_string(file, arena_push_format(arena, "%.*s", (int) document->title.count, document->title.data));
+            fprintf(file, " }");
+        }
+        fprintf(file, "\n  ]\n}\n");
+        fclose(file);
+    } else {
+        printf("Failed to open `%s` for writing!\n", json_path);
+        build->stats.failed_count++;
+    }
+    
+    for (int i = 0; i < build->pool.worker_count; i++) {
+        search_partial_index_free(&build->search_partials[i]);
+    }
+    free(build->search_partials);
+    free(build->search_documents);
+    build->search_partials = 0;
+    build->search_documents = 0;
+}
+
+void
+build_site_page(Worker* worker, void* data) {
+    Site_File* file = (Site_File*) data;
+    Site_Build* build = (Site_Build*) worker->pool->user_data;
+    Site_Config* config = build->config;
+    Memory_Arena* arena = &worker->arena;
+    PROFILE_BEGIN(Page, file->source_path);
+    
+    Dom dom = read_markdown_file_ex(file->source_path, arena);
+    if (build->search_partials) {
+        build_site_index_dom(build, worker, file, &dom);
+    }
+    
+    // NOTE(Alexander): the html is rendered after the dom into the same arena and written out
+    // directly from the arena blocks together with the template segments.
+    Temporary_Memory html_memory = begin_temporary_memory(arena);
+    Output_Sink sink = output_sink_arena(arena);
+    sink.minify = config->minify_html;
+    Asset_Url_Context url_context;
+    if (config->fingerprint_assets) {
+        cstring relative_path = site_file_relative_path(config, file);
+        cstring name = relative_path + strlen(relative_path);
+        while (name > relative_path && name[-1] != '/' && name[-1] != '\\') name--;
+        url_context.build = build;
+        url_context.page_dir.data = (char*) relative_path;
+        url_context.page_dir.count = name - relative_path;
+        sink.rewrite_url = asset_url_rewrite_callback;
+        sink.rewrite_url_data = &url_context;
+    }
+    generate_html_from_dom_to_sink(&dom, &sink);
+    
+    PROFILE_BEGIN(Template, 0);
+    Gather_List list;
+    zero_struct(list);
+    Template* tmpl = &build->tmpl;
+    for (int i = 0; i < tmpl->segment_count; i++) {
+        Template_Segment* segment = &tmpl->segments[i];
+        if (segment->type == TemplateSegment_Parameter && segment->arg_index == config->content_arg_index) {
+            gather_push_temporary_memory(&list, html_memory);
+        } else {
+            gather_push(&list, template_segment_text(segment, config->template_argc, build->template_args));
+        }
+    }
+    PROFILE_END();
+    
+    PROFILE_BEGIN(Write, file->output_path);
+    platform_create_parent_directories(file->output_path);
+    if (config->write_if_changed) {
+        Write_Result result = write_file_if_changed_gather(file->output_path, list.buffers, list.count);
+        if (result == WriteResult_Failed) {
+            atomic_add_u32(&build->stats.failed_count, 1);
+        } else if (result == WriteResult_Unchanged) {
+            atomic_add_u32(&build->stats.unchanged_count, 1);
+        } else {
+            atomic_add_u32(&build->stats.written_count, 1);
+        }
+    } else {
+        int fd = platform_open_file_for_writing(file->output_path);
+        if (fd < 0 || !platform_write_file_gather(fd, list.buffers, list.count)) {
+            printf("Failed to write `%s`!\n", file->output_path);
+            atomic_add_u32(&build->stats.failed_count, 1);
+        } else {
+            atomic_add_u32(&build->stats.written_count, 1);
+        }
+        if (fd >= 0) {
+            platform_close_file(fd);
+        }
+    }
+    PROFILE_END();
+    
+    if (config->page_callback) {
+        config->page_callback(config->page_callback_data, file->output_path, list.buffers, list.count);
+    }
+    
+    if (config->manifest_path || build->track_dependencies) {
+        // NOTE(Alexander): copy the unique dependencies out of the arena before it's cleared
+        free(file->dependencies);
+        file->dependency_count = 0;
+        umm size = 0;
+        int count = 0;
+        for (Dom_Dependency* it = dom.dependencies; it; it = it->next) {
+            size += sizeof(cstring) + strlen(it->filename) + 1;
+            count++;
         }
         
-        if (token.symbol == '*' || token.symbol == '`') {
-            node = arena_push_dom_node(arena, node);
-            node->type = Dom_Inline_Text;
-            
-            if (token.symbol == '*') {
-                if (token.text.count == 1 || token.text.count > 2) {
-                    node->text_style ^= TextStyle_Italics;
-                }
-                if (token.text.count >= 2) {
-                    node->text_style ^= TextStyle_Bold;
-                }
-            } else {
-                node->text_style ^= TextStyle_Code;
+        file->dependencies = (cstring*) malloc(size);
+        char* dest = (char*) (file->dependencies + count);
+        for (Dom_Dependency* it = dom.dependencies; it; it = it->next) {
+            bool duplicate = false;
+            for (int i = 0; i < file->dependency_count; i++) {
+                duplicate |= strcmp(file->dependencies[i], it->filename) == 0;
             }
             
-            token = next_token(t);
-            node->text.data = token.text.data;
-            node->text.count = 0;
-        } else if (token.symbol == '[') {
-            string text = parse_enclosed_string(t, 0, ']');
-            string src = parse_enclosed_string(t, '(', ')');
-            
-            if (text.count > 0 && src.count > 0) {
-                node = arena_push_dom_node(arena, node);
-                node->type = Dom_Link;
-                node->text = text;
-                node->link.source = src;
-                
-                token = next_token(t);
-                node = arena_push_dom_node(arena, node);
-                node->type = Dom_Inline_Text;
-                node->text.data = token.text.data;
-                node->text.count = 0;
-                continue;
+            if (!duplicate) {
+                umm length = strlen(it->filename) + 1;
+                memcpy(dest, it->filename, length);
+                file->dependencies[file->dependency_count++] = dest;
+                dest += length;
             }
-        } else if (token.text.count >= 4) {
-            if (memcmp("http", token.text.data, 4) == 0) {
-                if (token.text.count == 4 || (token.text.count == 5 && token.text.data[4] == 's')) {
-                    Tokenizer temp_t = *t;
-                    next_token(&temp_t);
-                    bool success = next_token(&temp_t).symbol != ':';
-                    success &= next_token(&temp_t).symbol != '/';
-                    success &= next_token(&temp_t).symbol != '/';
-                    success &= !next_token(&temp_t).whitespace;
-                    
-                    if (success) {
-                        string link;
-                        link.data = token.text.data;
-                        link.count = 0;
-                        
-                        // NOTE(Alexander): not complete parser for URLs, they are way to complicated
-                        while (!token.whitespace) {
-                            if ((token.symbol == ',' || token.symbol == '.') && peek_token(t).whitespace) {
-                                break;
-                            }
-                            
-                            link.count += token.text.count;
-                            token = next_token(t);
-                        }
-                        
-                        node = arena_push_dom_node(arena, node);
-                        node->type = Dom_Link;
-                        node->text = link;
-                        node->link.source = link;
-                        
-                        node = arena_push_dom_node(arena, node);
-                        node->type = Dom_Inline_Text;
-                        node->text.data = token.text.data;
-                        node->text.count = 0;
-                        continue;
-                    }
-                } 
+        }
+    }
+    
+    free_dom_sources(&dom);
+    gather_list_free(&list);
+    arena_reset(arena);
+    PROFILE_END();
+    
+    // NOTE(Alexander): pushed to this worker so it's compressed while other pages are rendered
+    if (config->precompress) {
+        work_pool_push(worker->pool, worker, build_site_compress, file);
+    }
+}
+
+void
+build_site_asset(Worker* worker, void* data) {
+    Site_File* file = (Site_File*) data;
+    Site_Build* build = (Site_Build*) worker->pool->user_data;
+    
+    PROFILE_BEGIN(Asset, file->source_path);
+    platform_create_parent_directories(file->output_path);
+    Copy_Result result = copy_file_ex(file->source_path, file->output_path, build->config->asset_copy_mode);
+    if (result == CopyResult_Failed) {
+        atomic_add_u32(&build->stats.failed_count, 1);
+    } else if (result == CopyResult_Unchanged) {
+        atomic_add_u32(&build->stats.unchanged_count, 1);
+    } else {
+        atomic_add_u32(&build->stats.written_count, 1);
+    }
+    PROFILE_END();
+    
+    if (build->config->precompress) {
+        work_pool_push(worker->pool, worker, build_site_compress, file);
+    }
+}
+
+void
+build_site_visit(void* data, cstring path, File_Type type) {
+    Site_Build* build = (Site_Build*) data;
+    Site_Config* config = build->config;
+    
+    cstring name = path + strlen(path);
+    while (name > path && name[-1] != '/' && name[-1] != '\\') name--;
+    if (name[0] == '.') {
+        return;
+    }
+    
+    if (type == FileType_Directory) {
+        platform_visit_directory(path, build_site_visit, build);
+        return;
+    }
+    
+    cstring relative_path = path + strlen(config->source_dir);
+    Site_File* file = arena_push_struct(&build->arena, Site_File);
+    file->source_path = arena_push_format(&build->arena, "%s", path);
+    file->is_page = cstring_ends_with(path, ".md");
+    
+    if (file->is_page) {
+        int count = (int) strlen(relative_path) - 3;
+        file->output_path = arena_push_format(&build->arena, "%s%.*s.html", 
+                                              config->output_dir, count, relative_path);
+        build->stats.page_count++;
+    } else {
+        file->output_path = arena_push_format(&build->arena, "%s%s", config->output_dir, relative_path);
+        build->stats.asset_count++;
+    }
+    
+    if (build->last_file) {
+        build->last_file->next = file;
+    } else {
+        build->first_file = file;
+    }
+    build->last_file = file;
+}
+
+void
+build_site_update_manifest(Site_Build* build) {
+    Build_Manifest* manifest = &build->manifest;
+    
+    for (Site_File* file = build->first_file; file; file = file->next) {
+        build_check_file(build, file->source_path);
+        if (!file->is_page) {
+            continue;
+        }
+        
+        Manifest_Page* page = arena_push_struct(&manifest->arena, Manifest_Page);
+        page->source_path = file->source_path;
+        
+        cstring* dependencies = file->dependencies;
+        int dependency_count = file->dependency_count;
+        if (!file->dirty && build->prev_manifest) {
+            Manifest_Page* prev_page = (Manifest_Page*) string_map_get(&build->prev_manifest->pages, 
+                                                                       string_lit(file->source_path));
+            if (prev_page) {
+                dependencies = prev_page->dependencies;
+                dependency_count = prev_page->dependency_count;
+            }
+        }
+        
+        page->dependencies = arena_push_array(&manifest->arena, cstring, dependency_count);
+        for (int i = 0; i < dependency_count; i++) {
+            page->dependencies[i] = build_check_file(build, dependencies[i])->filename;
+        }
+        page->dependency_count = dependency_count;
+        string_map_put(&manifest->pages, string_lit(page->source_path), page);
+    }
+}
+
+// NOTE(Alexander): returns false if the template is unchanged (the cached one was up to date) or
+// couldn't be compiled, the previous template is kept then.
+bool
+site_build_compile_template(Site_Build* build) {
+    Site_Config* config = build->config;
+    string* names = config->template_arg_names;
+    int name_count = names ? config->template_argc : 0;
+    
+    if (config->template_path) {
+        Template* cached = template_cache_get(config->template_path, names, name_count);
+        if (!cached || cached == build->cached_tmpl) {
+            return false;
+        }
+        free_template(&build->tmpl);
+        build->tmpl = template_copy(cached);
+        build->cached_tmpl = cached;
+    } else {
+        free_template(&build->tmpl);
+        build->tmpl = compile_template_ex(config->template_source, names, name_count);
+    }
+    
+    if (config->minify_html) {
+        template_minify(&build->tmpl);
+    }
+    return true;
+}
+
+void
+site_build_begin(Site_Build* build, Site_Config* config) {
+    zero_struct(*build);
+    build->config = config;
+    
+    work_pool_init(&build->pool, config->worker_count);
+    build->pool.user_data = build;
+    site_build_compile_template(build);
+    build->template_args = config->fingerprint_assets ? 0 : config->template_args;
+    if (config->template_path && !build->cached_tmpl) {
+        printf("Failed to compile the template `%s`!\n", config->template_path);
+    }
+    
+    if (!platform_visit_directory(config->source_dir, build_site_visit, build)) {
+        printf("Failed to open directory `%s`!\n", config->source_dir);
+        build->stats.failed_count++;
+    }
+}
+
+// NOTE(Alexander): builds all the dirty files in parallel. Assets are pushed last so the workers
+// (popping their own work in LIFO order) start on them first, large copies then don't end up as
+// a serial tail after the pages.
+void
+site_build_run(Site_Build* build) {
+    if (build->config->search_index) {
+        site_build_search_begin(build);
+    }
+    
+    for (Site_File* file = build->first_file; file; file = file->next) {
+        if (file->dirty && !file->removed) {
+            if (file->is_page) {
+                work_pool_push(&build->pool, 0, build_site_page, file);
+            }
+        } else {
+            build->stats.skipped_count++;
+            if (build->search_partials && file->is_page && !file->removed) {
+                work_pool_push(&build->pool, 0, build_site_index_page, file);
+            }
+            if (build->config->precompress && !file->removed) {
+                // NOTE(Alexander): the output is unchanged, only compress it if the .gz is missing
+                Temporary_Memory temp = begin_temporary_memory(&build->arena);
+                if (!platform_get_file_info(site_file_gzip_path(&build->arena, file)).exists) {
+                    work_pool_push(&build->pool, 0, build_site_compress, file);
+                }
+                end_temporary_memory(temp);
+            }
+        }
+    }
+    
+    for (Site_File* file = build->first_file; file; file = file->next) {
+        if (file->dirty && !file->removed && !file->is_page) {
+            work_pool_push(&build->pool, 0, build_site_asset, file);
+        }
+    }
+    
+    work_pool_run(&build->pool);
+    
+    // NOTE(Alexander): the pages of the build are rendered, the code blocks are highlighted again next build
+    highlight_cache_clear();
+    
+    if (build->search_partials) {
+        site_build_search_end(build);
+    }
+}
+
+void
+site_build_end(Site_Build* build) {
+    for (Site_File* file = build->first_file; file; file = file->next) {
+        free(file->dependencies);
+    }
+    
+    free_template(&build->tmpl);
+    work_pool_free(&build->pool);
+    string_map_free(&build->fingerprints);
+    arena_clear(&build->arena);
+}
+
+// NOTE(Alexander): converts every markdown file in source_dir into html in output_dir,
+// keeping the directory structure, other files are copied over as assets.
+Site_Build_Stats
+build_site(Site_Config* config) {
+    Site_Build build;
+    site_build_begin(&build, config);
+    if (config->template_path && !build.cached_tmpl) {
+        build.stats.failed_count++;
+        site_build_end(&build);
+        return build.stats;
+    }
+    
+    Build_Manifest prev_manifest;
+    if (config->manifest_path) {
+        if (load_build_manifest(&prev_manifest, config->manifest_path)) {
+            build.prev_manifest = &prev_manifest;
+        }
+        build.manifest.config_hash = site_config_hash(config);
+        if (config->template_path) {
+            // NOTE(Alexander): covers every file the template includes or extends
+            build.manifest.config_hash = content_hash_mix(build.manifest.config_hash, build.tmpl.hash);
+        }
+    }
+    
+    if (config->fingerprint_assets) {
+        // NOTE(Alexander): any page may reference the assets, so a changed mapping rebuilds every page
+        site_build_fingerprint_assets(&build);
+        build.manifest.config_hash = content_hash_mix(build.manifest.config_hash, build.fingerprint_hash);
+    }
+    
+    for (Site_File* file = build.first_file; file; file = file->next) {
+        file->dirty = true;
+        if (config->manifest_path) {
+            if (file->is_page) {
+                file->dirty = build_is_page_dirty(&build, file);
+            } else {
+                file->dirty = (build_check_file(&build, file->source_path)->changed ||
+                               !platform_get_file_info(file->output_path).exists);
             }
         }
+    }
+    
+    site_build_run(&build);
+    
+    if (config->manifest_path) {
+        build_site_update_manifest(&build);
+        if (!save_build_manifest(&build.manifest, config->manifest_path)) {
+            build.stats.failed_count++;
+        }
         
-        node->text.count += token.text.count;
-        token = next_token(t);
+        if (build.prev_manifest) {
+            build_manifest_free(build.prev_manifest);
+        }
+        build_manifest_free(&build.manifest);
     }
     
-    result.last = node;
-    return result;
+    site_build_end(&build);
+    return build.stats;
 }
 
-Dom_Sequence
-parse_markdown_list(Tokenizer* t, Memory_Arena* arena, Token line_start, int curr_indent) {
-    Dom_Sequence result;
-    result.first = arena_push_dom_node(arena, 0);
-    result.last = result.first;
+// NOTE(Alexander): watch mode keeps the site build, compiled template and parsed includes in memory
+// and only rebuilds what a change affects: the changed page or asset, the pages including a changed
+// file (through the reverse dependencies) or every page if the template changed. Bursts of events,
+// e.g. editors writing a temporary file and renaming it, are debounced until it has been quiet for
+// WATCH_DEBOUNCE_MS. Only linux (inotify) is supported for now.
+#define WATCH_DEBOUNCE_MS 8
+#define WATCH_MAX_DEBOUNCE_MS 40
+
+typedef struct {
+    Site_File** pages;
+    int count;
+    int capacity;
+} Watch_Dependents;
+
+typedef struct {
+    Site_Build build;
+    Memory_Arena arena;
     
-    if (line_start.number > 0 && peek_token(t).symbol == '.') {
-        next_token(t);
+    cstring source_dir; // NOTE(Alexander): canonical, all the paths below are canonical too
+    cstring template_path;
+    bool template_changed;
+    
+    String_Map files; // NOTE(Alexander): Site_File
+    String_Map dependents; // NOTE(Alexander): Watch_Dependents keyed by the included file
+    String_Map canonical_paths; // NOTE(Alexander): dependency filename to canonical path
+    String_Map directories;
+    
+    int fd;
+    cstring* watch_paths; // NOTE(Alexander): directory of each watch descriptor
+    int watch_path_count;
+} Site_Watch;
+
+#if __linux__
+
+void
+watch_add_directory(Site_Watch* watch, cstring directory) {
+    if (string_map_get(&watch->directories, string_lit(directory))) {
+        return;
     }
     
-    Dom_Node* node = result.first;
-    node->type = Dom_List_Item;
-    node->list_item.seq = parse_markdown_text_line(t, arena, next_token(t));
+    int wd = inotify_add_watch(watch->fd, directory, (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | 
+                                                      IN_CREATE | IN_DELETE));
+    if (wd < 0) {
+        printf("Failed to watch directory `%s`!\n", directory);
+        return;
+    }
     
-    node = arena_push_dom_node(arena, node);
+    if (wd >= watch->watch_path_count) {
+        int count = max(wd + 1, watch->watch_path_count*2);
+        watch->watch_paths = (cstring*) realloc(watch->watch_paths, count*sizeof(cstring));
+        memset(watch->watch_paths + watch->watch_path_count, 0, (count - watch->watch_path_count)*sizeof(cstring));
+        watch->watch_path_count = count;
+    }
     
-    for (;;) {
-        Token token = peek_token(t);
-        if (token.new_line) {
-            break;
+    cstring path = arena_push_format(&watch->arena, "%s", directory);
+    watch->watch_paths[wd] = path;
+    string_map_put(&watch->directories, string_lit(path), (void*) path);
+}
+
+void
+watch_visit_directory(void* data, cstring path, File_Type type) {
+    cstring name = path + strlen(path);
+    while (name > path && name[-1] != '/') name--;
+    if (type == FileType_Directory && name[0] != '.') {
+        watch_add_directory((Site_Watch*) data, path);
+        platform_visit_directory(path, watch_visit_directory, data);
+    }
+}
+
+void
+watch_add_parent_directory(Site_Watch* watch, cstring filepath) {
+    char directory[4096];
+    snprintf(directory, sizeof(directory), "%s", filepath);
+    char* separator = strrchr(directory, '/');
+    if (separator) {
+        *separator = 0;
+        watch_add_directory(watch, directory[0] ? directory : "/");
+    }
+}
+
+void
+watch_add_template_directories(Site_Watch* watch) {
+    for (Template_Dependency* it = watch->build.tmpl.dependencies; it; it = it->next) {
+        watch_add_parent_directory(watch, it->filepath);
+    }
+}
+
+// NOTE(Alexander): the canonical path of a dependency, only resolved once per filename
+cstring
+watch_canonical_path(Site_Watch* watch, cstring filename) {
+    cstring result = (cstring) string_map_get(&watch->canonical_paths, string_lit(filename));
+    if (!result) {
+        char filepath[4096];
+        if (!platform_get_full_path(filename, filepath, sizeof(filepath))) {
+            return 0;
         }
         
-        if (line_start.number > 0) {
-            line_start.number++;
+        result = arena_push_format(&watch->arena, "%s", filepath);
+        cstring key = arena_push_format(&watch->arena, "%s", filename);
+        string_map_put(&watch->canonical_paths, string_lit(key), (void*) result);
+    }
+    return result;
+}
+
+void
+watch_add_file(Site_Watch* watch, Site_File* file) {
+    cstring relative_path = file->source_path + strlen(watch->build.config->source_dir);
+    cstring filepath = arena_push_format(&watch->arena, "%s%s", watch->source_dir, relative_path);
+    string_map_put(&watch->files, string_lit(filepath), file);
+}
+
+void
+watch_update_dependents(Site_Watch* watch, Site_File* page) {
+    for (int i = 0; i < page->dependency_count; i++) {
+        cstring filepath = watch_canonical_path(watch, page->dependencies[i]);
+        if (!filepath) {
+            continue;
         }
         
-        int indent = 0;
-        if (token.whitespace) {
-            indent = (int) token.text.count; // TODO(Alexander): tabs counts as 1 unit
-            next_token(t);
-            token = peek_token(t);
+        Watch_Dependents* dependents = (Watch_Dependents*) string_map_get(&watch->dependents, string_lit(filepath));
+        if (!dependents) {
+            dependents = arena_push_struct(&watch->arena, Watch_Dependents);
+            string_map_put(&watch->dependents, string_lit(filepath), dependents);
+            watch_add_parent_directory(watch, filepath);
         }
         
-        // NOTE(Alexander): either symbol +, -, * (unordered is correct) or 1. 2. etc. (ordered is correct)
-        bool correct_line_start = token.symbol == line_start.symbol 
-            || (line_start.number > 0 && token.number == line_start.number);
+        // NOTE(Alexander): pages that no longer include the file are kept, it only costs a rebuild
+        bool found = false;
+        for (int j = 0; j < dependents->count && !found; j++) {
+            found = dependents->pages[j] == page;
+        }
         
-        if (indent < curr_indent || !correct_line_start) {
-            break;
+        if (!found) {
+            if (dependents->count == dependents->capacity) {
+                dependents->capacity = dependents->capacity ? dependents->capacity*2 : 8;
+                dependents->pages = (Site_File**) realloc(dependents->pages, dependents->capacity*sizeof(Site_File*));
+            }
+            dependents->pages[dependents->count++] = page;
+        }
+    }
+}
+
+void
+watch_file_changed(Site_Watch* watch, cstring filepath, bool is_directory, bool removed) {
+    Site_Build* build = &watch->build;
+    
+    if (template_depends_on(&build->tmpl, filepath)) {
+        watch->template_changed = true;
+    }
+    
+    include_cache_invalidate(filepath);
+    Watch_Dependents* dependents = (Watch_Dependents*) string_map_get(&watch->dependents, string_lit(filepath));
+    if (dependents) {
+        for (int i = 0; i < dependents->count; i++) {
+            dependents->pages[i]->dirty = true;
+        }
+    }
+    
+    Site_File* file = (Site_File*) string_map_get(&watch->files, string_lit(filepath));
+    if (file) {
+        file->removed = removed;
+        file->dirty = !removed;
+        if (removed) {
+            remove(file->output_path);
+            Site_Config* config = build->config;
+            if (config->precompress) {
+                Temporary_Memory temp = begin_temporary_memory(&build->arena);
+                remove(site_file_gzip_path(&build->arena, file));
+                end_temporary_memory(temp);
+            }
+            if (file->is_page && config->page_callback) {
+                config->page_callback(config->page_callback_data, file->output_path, 0, 0);
+            }
         }
+        return;
+    }
+    
+    umm source_dir_count = strlen(watch->source_dir);
+    if (removed || strncmp(filepath, watch->source_dir, source_dir_count) != 0 || filepath[source_dir_count] != '/') {
+        return;
+    }
+    
+    cstring name = strrchr(filepath, '/') + 1;
+    if (name[0] == '.') {
+        return;
+    }
+    
+    // NOTE(Alexander): new file or directory in the source tree, visit it like a regular build
+    char path[4096];
+    snprintf(path, sizeof(path), "%s%s", build->config->source_dir, filepath + source_dir_count);
+    Site_File* last_file = build->last_file;
+    build_site_visit(build, path, is_directory ? FileType_Directory : FileType_File);
+    if (is_directory) {
+        watch_add_directory(watch, filepath);
+        platform_visit_directory(filepath, watch_visit_directory, watch);
+    }
+    
+    for (file = last_file ? last_file->next : build->first_file; file; file = file->next) {
+        watch_add_file(watch, file);
+        file->dirty = true;
+    }
+}
+
+// NOTE(Alexander): returns true if any event was read
+bool
+watch_read_events(Site_Watch* watch) {
+    bool result = false;
+    char buffer[16*1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    
+    for (;;) {
+        ssize_t count = read(watch->fd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) break;
         
-        if (indent > curr_indent) {
-            next_token(t);
-            node = arena_push_dom_node(arena, node);
+        for (char* curr = buffer; curr < buffer + count;) {
+            struct inotify_event* event = (struct inotify_event*) curr;
+            curr += sizeof(struct inotify_event) + event->len;
+            result = true;
             
-            if (token.number > 0) {
-                node->type = Dom_Ordered_List;
-                node->ordered_list.seq = parse_markdown_list(t, arena, token, indent);
-            } else if (is_unordered_list_symbol(token.symbol)) {
-                node->type = Dom_Unordered_List;
-                node->unordered_list.seq = parse_markdown_list(t, arena, token, indent);
+            if (event->mask & IN_Q_OVERFLOW) {
+                // NOTE(Alexander): events were lost, rebuild everything
+                for (Site_File* file = watch->build.first_file; file; file = file->next) {
+                    file->dirty = !file->removed;
+                }
+                include_cache_clear();
+                watch->template_changed = watch->template_path != 0;
+                continue;
             }
             
-            token = peek_token(t);
-            correct_line_start = token.symbol == line_start.symbol 
-                || (line_start.number > 0 && token.number == line_start.number);
-            token = peek_token(t);
-            if (!correct_line_start) {
-                break;
+            if (event->wd < 0 || event->wd >= watch->watch_path_count || !watch->watch_paths[event->wd]) {
+                continue;
             }
+            
+            cstring directory = watch->watch_paths[event->wd];
+            if (event->mask & IN_IGNORED) {
+                string_map_put(&watch->directories, string_lit(directory), 0);
+                watch->watch_paths[event->wd] = 0;
+                continue;
+            }
+            
+            bool is_directory = (event->mask & IN_ISDIR) != 0;
+            if (event->len == 0 || ((event->mask & IN_CREATE) && !is_directory)) {
+                continue; // NOTE(Alexander): wait for the file to be closed
+            }
+            
+            char filepath[4096];
+            snprintf(filepath, sizeof(filepath), "%s/%s", directory, event->name);
+            watch_file_changed(watch, filepath, is_directory, (event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0);
         }
-        
-        token = next_token(t);
-        if (line_start.number > 0 && peek_token(t).symbol == '.') {
-            next_token(t);
-        }
-        
-        node = arena_push_dom_node(arena, node);
-        node->type = Dom_List_Item;
-        node->list_item.seq = parse_markdown_text_line(t, arena, next_token(t));
     }
     
-    result.last = node;
     return result;
 }
 
-// Forward declare
-Dom read_markdown_file_ex(cstring filename, Memory_Arena* arena);
-
-Dom_Sequence
-parse_markdown_line(Tokenizer* t, Memory_Arena* arena, Dom_Node* prev_node) {
-    Dom_Sequence result;
-    zero_struct(result);
+void
+watch_rebuild(Site_Watch* watch) {
+    Site_Build* build = &watch->build;
+    u64 begin_time = platform_get_time_ns();
     
-    Token token = next_token(t);
-    for (;;) {
-        if (!token.symbol) {
-            return result;
+    if (watch->template_changed) {
+        // NOTE(Alexander): files that were only touched leave the cached template as is
+        if (site_build_compile_template(build)) {
+            for (Site_File* file = build->first_file; file; file = file->next) {
+                file->dirty |= file->is_page && !file->removed;
+            }
+            watch_add_template_directories(watch);
         }
-        
-        if (token.whitespace) {
-            token = next_token(t);
-            continue;
+        watch->template_changed = false;
+    }
+    
+    if (build->config->fingerprint_assets && site_build_fingerprint_assets(build)) {
+        for (Site_File* file = build->first_file; file; file = file->next) {
+            file->dirty |= file->is_page && !file->removed;
         }
-        
-        break;
     }
     
-    int indent = 0;
-    if (token.whitespace) {
-        indent = (int) token.text.count; // TODO(Alexander): tabs count as one indentation unit
-        token = next_token(t);
+    u32 dirty_count = 0;
+    for (Site_File* file = build->first_file; file; file = file->next) {
+        dirty_count += file->dirty && !file->removed;
+    }
+    if (dirty_count == 0) {
+        include_cache_free_retired();
+        template_cache_free_retired();
+        return;
     }
     
-    // NOTE(Alexander): remove emacs -*- encoding: utf-8 -*- crap
-    if (token.symbol == '-' && peek_token(t).symbol == '*') {
-        Tokenizer temp_t = *t;
-        next_token(&temp_t);
-        Token temp_token = next_token(&temp_t);
-        if (temp_token.symbol == '-') {
-            temp_token = next_token(&temp_t);
-            while (!temp_token.new_line) {
-                temp_token = next_token(&temp_t);
-            }
-            *t = temp_t;
-            token = next_token(t);
+    build->stats.failed_count = 0;
+    site_build_run(build);
+    
+    // NOTE(Alexander): the pages of the build were the last ones pointing into replaced includes,
+    // the template of the build was already copied from the current cached template
+    include_cache_free_retired();
+    template_cache_free_retired();
+    
+    for (Site_File* file = build->first_file; file; file = file->next) {
+        if (file->dirty && file->is_page && !file->removed) {
+            watch_update_dependents(watch, file);
         }
+        file->dirty = false;
     }
     
-    if (indent == 0 && token.symbol == '@' && token.text.count == 1 && !peek_token(t).whitespace) {
-        token = next_token(t);
-        
-        // TODO(alexander): probably not how we should detect macro definitions
-        const string include_literal = string_lit("include");
+    printf("Rebuilt %u files in %.2f ms, %u failed\n", dirty_count, 
+           (f64) (platform_get_time_ns() - begin_time) / 1e6, build->stats.failed_count);
+    fflush(stdout);
+}
+
+#endif
+
+// NOTE(Alexander): builds the site and then rebuilds it whenever a source, include or the template
+// changes, until *stop is set (or forever if stop is null). If template_path is given the template
+// is loaded from it (see Site_Config.template_path) and the files it includes or extends are watched
+// too. Returns false if watching failed.
+bool
+watch_site(Site_Config* config, cstring template_path, volatile u32* stop) {
+#if __linux__
+    Site_Watch* watch = (Site_Watch*) calloc(1, sizeof(Site_Watch));
+    bool result = false;
+    cstring config_template_path = config->template_path;
+    
+    char filepath[4096];
+    if (!platform_get_full_path(config->source_dir, filepath, sizeof(filepath))) {
+        printf("Failed to open directory `%s`!\n", config->source_dir);
+        goto cleanup;
+    }
+    watch->source_dir = arena_push_format(&watch->arena, "%s", filepath);
+    
+    if (template_path) {
+        if (!platform_get_full_path(template_path, filepath, sizeof(filepath))) {
+            printf("File `%s` was not found!\n", template_path);
+            goto cleanup;
+        }
+        watch->template_path = arena_push_format(&watch->arena, "%s", filepath);
+        config->template_path = watch->template_path;
+    }
+    
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd < 0) {
+        printf("Failed to initialize inotify!\n");
+        goto cleanup;
+    }
+    
+    watch_add_directory(watch, watch->source_dir);
+    platform_visit_directory(watch->source_dir, watch_visit_directory, watch);
+    
+    site_build_begin(&watch->build, config);
+    if (config->template_path && !watch->build.cached_tmpl) {
+        site_build_end(&watch->build);
+        goto cleanup;
+    }
+    watch_add_template_directories(watch);
+    watch->build.track_dependencies = true;
+    for (Site_File* file = watch->build.first_file; file; file = file->next) {
+        watch_add_file(watch, file);
+        file->dirty = true;
+    }
+    watch_rebuild(watch);
+    printf("Watching `%s` for changes\n", config->source_dir);
+    fflush(stdout);
+    
+    while (!stop || !atomic_load_u32(stop)) {
+        struct pollfd poll_fd;
+        poll_fd.fd = watch->fd;
+        poll_fd.events = POLLIN;
+        poll_fd.revents = 0;
+        if (poll(&poll_fd, 1, 100) <= 0 || !watch_read_events(watch)) {
+            continue;
+        }
         
-        if (string_equals(token.text, include_literal) && peek_token(t).whitespace) {
-            next_token(t);
-            
-            if (next_token(t).symbol == '"' && peek_token(t).symbol != '"') {
-                token = next_token(t);
-                string filename = token.text;
-                filename.count = 0;
-                while (token.symbol != '"') {
-                    filename.count += token.text.count;
-                    token = next_token(t);
-                }
-                next_token(t);
-                
-                // TODO(Alexander): create a preprocessing later on
-                Dom included_dom = read_markdown_file_ex(string_to_cstring(filename), arena);
-                
-                result = included_dom.seq;
-                
-            } else {
-                assert(0 && "invalid macro #include declaration");
+        u64 first_event_time = platform_get_time_ns();
+        for (;;) {
+            int elapsed_ms = (int) ((platform_get_time_ns() - first_event_time) / 1000000);
+            if (elapsed_ms >= WATCH_MAX_DEBOUNCE_MS || 
+                poll(&poll_fd, 1, min(WATCH_DEBOUNCE_MS, WATCH_MAX_DEBOUNCE_MS - elapsed_ms)) <= 0) {
+                break;
             }
-        } else {
-            printf("Parsed unexpected macro: %.*s\n", (int) token.text.count, token.text.data);
-            assert(0 && "invalid macro");
+            watch_read_events(watch);
         }
         
-    } else if (indent == 0 && token.symbol == '#' && peek_token(t).whitespace) {
-        next_token(t);
-        Token begin = next_token(t);
-        Token end = begin;
-        while (!end.new_line) {
-            end = next_token(t);
+        watch_rebuild(watch);
+    }
+    
+    site_build_end(&watch->build);
+    result = true;
+    
+cleanup:
+    if (watch->fd > 0) {
+        close(watch->fd);
+    }
+    for (u32 i = 0; i < watch->dependents.capacity; i++) {
+        Watch_Dependents* dependents = (Watch_Dependents*) watch->dependents.entries[i].value;
+        if (dependents) {
+            free(dependents->pages);
+        }
+    }
+    string_map_free(&watch->files);
+    string_map_free(&watch->dependents);
+    string_map_free(&watch->canonical_paths);
+    string_map_free(&watch->directories);
+    free(watch->watch_paths);
+    arena_clear(&watch->arena);
+    free(watch);
+    template_cache_clear();
+    config->template_path = config_template_path;
+    return result;
+#else
+    printf("Watch mode is only supported on linux!\n");
+    return false;
+#endif
+}
+
+// NOTE(Alexander): small HTTP/1.1 server for previewing the site, only listens on localhost.
+// Pages are served from an in-memory cache filled through Site_Config.page_callback, so pages
+// rebuilt by watch_site are replaced as soon as they are generated, everything else (assets and
+// pages that were skipped by an incremental build) is read from the output directory.
+// The ETag is the content hash so unchanged pages are answered with 304 Not Modified.
+// Only linux (epoll) is supported for now.
+#define PREVIEW_SERVER_MAX_REQUEST_SIZE (16*1024)
+
+typedef struct {
+    string contents;
+    u64 hash;
+} Page_Cache_Entry;
+
+typedef struct {
+    Mutex mutex;
+    String_Map pages; // NOTE(Alexander): Page_Cache_Entry keyed by url, the keys are owned by the cache
+} Page_Cache;
+
+typedef struct Preview_Connection Preview_Connection;
+struct Preview_Connection {
+    int fd;
+    char request[PREVIEW_SERVER_MAX_REQUEST_SIZE];
+    umm request_count;
+    String_Builder response;
+    umm response_sent;
+    bool close_after_response;
+    
+    Preview_Connection* prev;
+    Preview_Connection* next;
+};
+
+typedef struct {
+    cstring output_dir;
+    Page_Cache cache;
+    
+    int listen_fd;
+    int epoll_fd;
+    int port;
+    Preview_Connection* connections;
+    Thread thread;
+    volatile u32 stop;
+} Preview_Server;
+
+typedef struct {
+    cstring extension;
+    cstring content_type;
+} Content_Type_Entry;
+
+static Content_Type_Entry content_types[] = {
+    { ".html", "text/html; charset=utf-8" },
+    { ".css", "text/css; charset=utf-8" },
+    { ".js", "text/javascript; charset=utf-8" },
+    { ".json", "application/json" },
+    { ".txt", "text/plain; charset=utf-8" },
+    { ".svg", "image/svg+xml" },
+    { ".png", "image/png" },
+    { ".jpg", "image/jpeg" },
+    { ".jpeg", "image/jpeg" },
+    { ".gif", "image/gif" },
+    { ".ico", "image/x-icon" },
+    { ".woff2", "font/woff2" },
+};
+
+cstring
+content_type_from_path(cstring path) {
+    for (int i = 0; i < array_count(content_types); i++) {
+        if (cstring_ends_with(path, content_types[i].extension)) {
+            return content_types[i].content_type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+// NOTE(Alexander): the url of an output file is the path relative to output_dir, e.g. /blog/post.html
+cstring
+preview_server_url(Preview_Server* server, cstring output_path) {
+    umm count = strlen(server->output_dir);
+    while (count > 0 && (server->output_dir[count - 1] == '/' || server->output_dir[count - 1] == '\\')) {
+        count--;
+    }
+    
+    if (strncmp(output_path, server->output_dir, count) == 0) {
+        output_path += count;
+    }
+    while (output_path[0] == '/' && output_path[1] == '/') {
+        output_path++;
+    }
+    return output_path;
+}
+
+// NOTE(Alexander): replaces the cached page, or removes it if count is zero
+void
+page_cache_put(Page_Cache* cache, cstring url, string* buffers, int count) {
+    Page_Cache_Entry* entry = 0;
+    if (count > 0) {
+        umm size = 0;
+        for (int i = 0; i < count; i++) {
+            size += buffers[i].count;
         }
         
-        Dom_Node* node = arena_push_struct(arena, Dom_Node);
-        node->type = Dom_Heading;
-        node->text.data = begin.text.data;
-        node->text.count = (umm) (end.text.data - begin.text.data);
-        node->heading.level = (int) token.text.count;
-        result.first = node;
-        
-    } else if (is_unordered_list_symbol(token.symbol) && peek_token(t).whitespace) {
-        Dom_Node* node = arena_push_struct(arena, Dom_Node);
-        node->type = Dom_Unordered_List;
-        node->unordered_list.seq = parse_markdown_list(t, arena, token, indent);
-        result.first = node;
-        
-    } else if (token.number >= 0 && peek_token(t).symbol == '.') {
-        Dom_Node* node = arena_push_struct(arena, Dom_Node);
-        node->type = Dom_Ordered_List;
-        node->ordered_list.seq = parse_markdown_list(t, arena, token, indent);
-        result.first = node;
-        
-    } else if (token.symbol == '`' && token.text.count == 3) {
-        Dom_Node* node = arena_push_struct(arena, Dom_Node);
-        node->type = Dom_Code_Block;
-        result.first = node;
+        entry = (Page_Cache_Entry*) malloc(sizeof(Page_Cache_Entry) + size);
+        entry->contents.data = (char*) (entry + 1);
+        entry->contents.count = size;
         
-    } else if (token.symbol == '!' && peek_token(t).symbol == '[') {
-        string alt = parse_enclosed_string(t, '[', ']');
-        string src = parse_enclosed_string(t, '(', ')');
-        
-        if (src.count > 0 && alt.count > 0) {
-            Dom_Node* node = arena_push_struct(arena, Dom_Node);
-            node->type = Dom_Image;
-            node->image.source = src;
-            node->text = alt;
-            result.first = node;
+        Content_Hash state;
+        content_hash_begin(&state);
+        char* dest = entry->contents.data;
+        for (int i = 0; i < count; i++) {
+            memcpy(dest, buffers[i].data, buffers[i].count);
+            content_hash_update(&state, buffers[i].data, buffers[i].count);
+            dest += buffers[i].count;
         }
-    } else {
-        if (!token.new_line && prev_node->type == Dom_Paragraph) {
-            // Join the two sequence of nodes into single paragraph node
-            Dom_Sequence next_seq = parse_markdown_text_line(t, arena, token);
-            result.first = prev_node;
-            result.first->paragraph.seq.last->next = next_seq.first;
-            result.first->paragraph.seq.last = next_seq.last;
-        } else {
-            Dom_Node* node = arena_push_struct(arena, Dom_Node);
-            node->type = Dom_Paragraph;
-            node->paragraph.seq = parse_markdown_text_line(t, arena, token);
-            result.first = node;
+        entry->hash = content_hash_end(&state);
+    }
+    
+    string key = string_lit(url);
+    mutex_lock(&cache->mutex);
+    String_Map_Entry* slot = 0;
+    if (cache->pages.capacity > 0) {
+        slot = string_map_find_entry(&cache->pages, key, string_hash(key));
+    }
+    
+    if (slot && slot->key.data) {
+        free(slot->value);
+        slot->value = entry;
+    } else if (entry) {
+        string_map_put(&cache->pages, string_lit(string_to_cstring(key)), entry);
+    }
+    mutex_unlock(&cache->mutex);
+}
+
+void
+page_cache_free(Page_Cache* cache) {
+    for (u32 i = 0; i < cache->pages.capacity; i++) {
+        String_Map_Entry* entry = &cache->pages.entries[i];
+        if (entry->key.data) {
+            free(entry->key.data);
+            free(entry->value);
         }
     }
+    string_map_free(&cache->pages);
+}
+
+void
+preview_server_page_callback(void* user_data, cstring output_path, string* buffers, int count) {
+    Preview_Server* server = (Preview_Server*) user_data;
+    page_cache_put(&server->cache, preview_server_url(server, output_path), buffers, count);
+}
+
+#if __linux__
+
+void
+preview_push_response(Preview_Connection* connection, int status, cstring reason, cstring content_type,
+                      cstring etag, string body, bool include_body) {
+    char header[1024];
+    int count = snprintf(header, sizeof(header), "HTTP/1.1 %d %s\r\n", status, reason);
+    if (content_type) {
+        count += snprintf(header + count, sizeof(header) - count, "Content-Type: %s\r\n", content_type);
+    }
+    if (etag) {
+        count += snprintf(header + count, sizeof(header) - count, "ETag: %s\r\nCache-Control: no-cache\r\n", etag);
+    }
+    count += snprintf(header + count, sizeof(header) - count, "Content-Length: %llu\r\n%s\r\n", 
+                      (unsigned long long) body.count,
+                      connection->close_after_response ? "Connection: close\r\n" : "");
     
-    if (result.last == 0) {
-        result.last = result.first;
+    string str;
+    str.data = header;
+    str.count = (umm) count;
+    string_builder_push_string(&connection->response, str);
+    if (include_body && body.count > 0) {
+        string_builder_push_string(&connection->response, body);
+    }
+}
+
+void
+preview_push_error(Preview_Connection* connection, int status, cstring reason, bool include_body) {
+    preview_push_response(connection, status, reason, "text/plain; charset=utf-8", 0, string_lit(reason), include_body);
+}
+
+void
+preview_push_page(Preview_Connection* connection, cstring path, string contents, u64 hash, 
+                  string if_none_match, bool include_body) {
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long) hash);
+    bool not_modified = if_none_match.count == strlen(etag) && memcmp(if_none_match.data, etag, if_none_match.count) == 0;
+    if (not_modified) {
+        preview_push_response(connection, 304, "Not Modified", 0, etag, contents, false);
+    } else {
+        preview_push_response(connection, 200, "OK", content_type_from_path(path), etag, contents, include_body);
     }
+}
+
+// NOTE(Alexander): case insensitive search for a header, returns the trimmed value or an empty string
+string
+http_find_header(string headers, cstring name) {
+    string result;
+    zero_struct(result);
+    umm name_count = strlen(name);
     
+    char* curr = headers.data;
+    char* end = headers.data + headers.count;
+    while (curr < end) {
+        char* line_end = curr;
+        while (line_end < end && *line_end != '\r' && *line_end != '\n') line_end++;
+        
+        if ((umm) (line_end - curr) > name_count && curr[name_count] == ':' && 
+            strncasecmp(curr, name, name_count) == 0) {
+            char* value = curr + name_count + 1;
+            while (value < line_end && (*value == ' ' || *value == '\t')) value++;
+            char* value_end = line_end;
+            while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) value_end--;
+            result.data = value;
+            result.count = (umm) (value_end - value);
+            return result;
+        }
+        
+        curr = line_end;
+        while (curr < end && (*curr == '\r' || *curr == '\n')) curr++;
+    }
     return result;
 }
 
-Dom
-read_markdown_file_ex(cstring filename, Memory_Arena* arena) {
-    Dom result;
-    zero_struct(result);
+// NOTE(Alexander): decodes the path of the request target, rejects anything escaping the output dir
+bool
+http_decode_path(string target, char* buffer, umm buffer_size) {
+    umm count = 0;
+    for (umm i = 0; i < target.count && target.data[i] != '?' && target.data[i] != '#'; i++) {
+        char c = target.data[i];
+        if (c == '%' && i + 2 < target.count) {
+            char hex[3] = { target.data[i + 1], target.data[i + 2], 0 };
+            c = (char) strtol(hex, 0, 16);
+            i += 2;
+        }
+        if (c == 0 || c == '\\' || count + 1 >= buffer_size) {
+            return false;
+        }
+        buffer[count++] = c;
+    }
+    buffer[count] = 0;
+    return buffer[0] == '/' && !strstr(buffer, "/..");
+}
+
+void
+preview_server_handle_request(Preview_Server* server, Preview_Connection* connection, string request) {
+    char* curr = request.data;
+    char* end = request.data + request.count;
     
-    string source = read_entire_file(filename);
-    if (!source.data) {
-        return result;
+    string method = { curr, 0 };
+    while (curr < end && *curr != ' ') curr++;
+    method.count = (umm) (curr - method.data);
+    if (curr < end) curr++;
+    
+    string target = { curr, 0 };
+    while (curr < end && *curr != ' ') curr++;
+    target.count = (umm) (curr - target.data);
+    if (curr < end) curr++;
+    
+    string version = { curr, 0 };
+    while (curr < end && *curr != '\r' && *curr != '\n') curr++;
+    version.count = (umm) (curr - version.data);
+    
+    string headers = { curr, (umm) (end - curr) };
+    string connection_header = http_find_header(headers, "Connection");
+    bool keep_alive = version.count == 8 && memcmp(version.data, "HTTP/1.1", 8) == 0;
+    if (connection_header.count == 5 && strncasecmp(connection_header.data, "close", 5) == 0) {
+        keep_alive = false;
+    } else if (connection_header.count == 10 && strncasecmp(connection_header.data, "keep-alive", 10) == 0) {
+        keep_alive = true;
     }
+    connection->close_after_response = !keep_alive;
     
-    Tokenizer tokenizer;
-    zero_struct(tokenizer);
+    bool is_head = method.count == 4 && memcmp(method.data, "HEAD", 4) == 0;
+    bool is_get = method.count == 3 && memcmp(method.data, "GET", 3) == 0;
+    if (!is_get && !is_head) {
+        // NOTE(Alexander): request bodies are not supported, so the connection can't be reused
+        connection->close_after_response = true;
+        preview_push_error(connection, 405, "Method Not Allowed", true);
+        return;
+    }
     
-    Tokenizer* t = &tokenizer;
-    t->base = source.data;
-    t->curr = t->base;
-    t->end = t->curr + source.count;
+    char path[4096];
+    if (!http_decode_path(target, path, sizeof(path) - 16)) {
+        preview_push_error(connection, 400, "Bad Request", !is_head);
+        return;
+    }
     
-    Dom_Node* root = arena_push_struct(arena, Dom_Node);
-    root->type = Dom_Root;
-    result.seq.first = root;
-    Dom_Node* curr_node = root;
+    umm path_count = strlen(path);
+    if (path[path_count - 1] == '/') {
+        strcpy(path + path_count, "index.html");
+    } else if (!strrchr(strrchr(path, '/'), '.')) {
+        strcpy(path + path_count, ".html");
+    }
     
-    while (true) {
-        Dom_Sequence nodes = parse_markdown_line(t, arena, curr_node);
-        if (!nodes.first || nodes.first->type == Dom_None) {
-            break;
-        }
-        
-        if (nodes.first != curr_node) {
-            curr_node->next = nodes.first;
-            curr_node = nodes.last;
-        }
+    string if_none_match = http_find_header(headers, "If-None-Match");
+    
+    Page_Cache* cache = &server->cache;
+    mutex_lock(&cache->mutex);
+    Page_Cache_Entry* entry = (Page_Cache_Entry*) string_map_get(&cache->pages, string_lit(path));
+    if (entry) {
+        preview_push_page(connection, path, entry->contents, entry->hash, if_none_match, !is_head);
+    }
+    mutex_unlock(&cache->mutex);
+    if (entry) {
+        return;
     }
-    result.seq.last = curr_node;
     
-    return result;
+    // NOTE(Alexander): not generated by this process, e.g. assets or skipped pages
+    char filepath[8192];
+    snprintf(filepath, sizeof(filepath), "%s%s", server->output_dir, path);
+    if (!platform_get_file_info(filepath).exists) {
+        preview_push_error(connection, 404, "Not Found", !is_head);
+        return;
+    }
+    
+    Mapped_File file = map_entire_file(filepath);
+    preview_push_page(connection, path, file.contents, string_content_hash(file.contents), if_none_match, !is_head);
+    unmap_file(&file);
 }
 
-inline Dom
-read_markdown_file(cstring filename) {
-    Memory_Arena arena;
-    zero_struct(arena);
-    return read_markdown_file_ex(filename, &arena);
+void
+preview_connection_close(Preview_Server* server, Preview_Connection* connection) {
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->fd, 0);
+    close(connection->fd);
+    if (connection->prev) connection->prev->next = connection->next;
+    else server->connections = connection->next;
+    if (connection->next) connection->next->prev = connection->prev;
+    string_builder_free(&connection->response);
+    free(connection);
+}
+
+// NOTE(Alexander): returns false if the connection was closed
+bool
+preview_connection_flush(Preview_Server* server, Preview_Connection* connection) {
+    while (connection->response_sent < connection->response.curr_used) {
+        ssize_t sent = send(connection->fd, connection->response.data + connection->response_sent,
+                            connection->response.curr_used - connection->response_sent, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct epoll_event event;
+            event.events = EPOLLIN | EPOLLOUT;
+            event.data.ptr = connection;
+            epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+            return true;
+        }
+        if (sent <= 0) {
+            preview_connection_close(server, connection);
+            return false;
+        }
+        connection->response_sent += (umm) sent;
+    }
+    
+    connection->response.curr_used = 0;
+    connection->response_sent = 0;
+    if (connection->close_after_response) {
+        preview_connection_close(server, connection);
+        return false;
+    }
+    
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = connection;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    return true;
 }
 
 void
-push_generated_html_from_dom_node(Memory_Arena* arena, Dom_Node* node, int depth) {
-    while (node) {
-        switch (node->type) {
-            case Dom_Heading: {
-                if (node->heading.level > 6) node->heading.level = 6;
-                char level = '0' + (char) node->heading.level;
-                char* open = "<h0>";
-                char* close = "</h0>";
-                *(open + 2) = level;
-                *(close + 3) = level;
-                
-                arena_push_new_line(arena, depth);
-                arena_push_cstring(arena, open);
-                arena_push_string(arena, node->text);
-                arena_push_cstring(arena, close);
-            } break;
-            
-            case Dom_Paragraph: {
-                arena_push_new_line(arena, depth);
-                arena_push_cstring(arena, "<p>");
-                push_generated_html_from_dom_node(arena, node->paragraph.seq.first, depth + 2);
-                arena_push_cstring(arena, "</p>");
-            } break;
-            
-            case Dom_Unordered_List: {
-                arena_push_new_line(arena, depth);
-                arena_push_cstring(arena, "<ul>");
-                push_generated_html_from_dom_node(arena, node->unordered_list.seq.first, depth + 2);
-                arena_push_cstring(arena, "</ul>");
-            } break;
-            
-            case Dom_Ordered_List: {
-                arena_push_new_line(arena, depth);
-                arena_push_cstring(arena, "<ol>");
-                push_generated_html_from_dom_node(arena, node->unordered_list.seq.first, depth + 2);
-                arena_push_cstring(arena, "</ol>");
-            } break;
-            
-            case Dom_List_Item: {
-                arena_push_new_line(arena, depth);
-                arena_push_cstring(arena, "<li>");
-                push_generated_html_from_dom_node(arena, node->list_item.seq.first, depth + 2);
-                arena_push_cstring(arena, "</li>");
-            } break;
-            
-            case Dom_Image: {
-                arena_push_cstring(arena, "<img alt=\"");
-                arena_push_string(arena, node->text);
-                arena_push_cstring(arena, "\" src=\"");
-                arena_push_string(arena, node->image.source);
-                arena_push_cstring(arena, "\" width=\"100%\"/>");
-            } break;
-            
-            case Dom_Link: {
-                arena_push_cstring(arena, "<a href=\"");
-                arena_push_string(arena, node->link.source);
-                arena_push_cstring(arena, "\">");
-                arena_push_string(arena, node->text);
-                arena_push_cstring(arena, "</a>");
-                arena_push_new_line(arena, depth);
-            } break;
+preview_connection_read(Preview_Server* server, Preview_Connection* connection) {
+    for (;;) {
+        if (connection->request_count == sizeof(connection->request)) {
+            connection->close_after_response = true;
+            preview_push_error(connection, 431, "Request Header Fields Too Large", true);
+            break;
+        }
+        
+        ssize_t count = recv(connection->fd, connection->request + connection->request_count,
+                             sizeof(connection->request) - connection->request_count, 0);
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (count <= 0) {
+            preview_connection_close(server, connection);
+            return;
+        }
+        connection->request_count += (umm) count;
+        
+        // NOTE(Alexander): handle every complete request, clients may pipeline requests
+        for (;;) {
+            char* end = 0;
+            for (umm i = 3; i < connection->request_count; i++) {
+                if (memcmp(connection->request + i - 3, "\r\n\r\n", 4) == 0) {
+                    end = connection->request + i + 1;
+                    break;
+                }
+            }
+            if (!end || connection->close_after_response) {
+                break;
+            }
             
-            case Dom_Line_Break: {
-                arena_push_cstring(arena, "<br>");
-            } break;
+            string request;
+            request.data = connection->request;
+            request.count = (umm) (end - connection->request);
+            preview_server_handle_request(server, connection, request);
             
-            case Dom_Inline_Text: {
-                if (node->text_style & TextStyle_Bold) {
-                    arena_push_cstring(arena, "<strong>");
-                }
-                if (node->text_style & TextStyle_Italics) {
-                    arena_push_cstring(arena, "<em>");
-                }
-                if (node->text_style & TextStyle_Code) {
-                    arena_push_cstring(arena, "<code>");
-                }
-                arena_push_string(arena, node->text);
-                if (node->text_style & TextStyle_Italics) {
-                    arena_push_cstring(arena, "</em>");
-                }
-                if (node->text_style & TextStyle_Bold) {
-                    arena_push_cstring(arena, "</strong>");
-                }
-                if (node->text_style & TextStyle_Code) {
-                    arena_push_cstring(arena, "</code>");
-                }
-            } break;
+            connection->request_count -= request.count;
+            memmove(connection->request, end, connection->request_count);
         }
-        
-        node = node->next;
     }
-}
-
-string
-convert_memory_arena_to_string(Memory_Arena* arena) {
-    string result;
-    zero_struct(result);
     
-    Memory_Block_Header* header = (Memory_Block_Header*) arena->base;
-    Memory_Block_Header* first_header = header;
-    while (header) {
-        first_header = header;
-        result.count += header->size_used - sizeof(Memory_Block_Header);
-        header = header->prev;
+    if (connection->response.curr_used > 0) {
+        preview_connection_flush(server, connection);
     }
-    
-    if (result.count > 0) {
-        result.data = (char*) malloc(result.count + 1);
+}
+
+void
+preview_server_accept(Preview_Server* server) {
+    for (;;) {
+        int fd = accept(server->listen_fd, 0, 0);
+        if (fd < 0) {
+            break;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
         
-        char* dest = result.data;
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
         
-        header = first_header;
-        while (header) {
-            umm size = header->size_used - sizeof(Memory_Block_Header);
-            memcpy(dest, header + 1, size);
-            dest += size;
-            header = header->next;
+        Preview_Connection* connection = (Preview_Connection*) calloc(1, sizeof(Preview_Connection));
+        connection->fd = fd;
+        
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = connection;
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            free(connection);
+            continue;
         }
         
-        *dest = 0;
+        connection->next = server->connections;
+        if (server->connections) server->connections->prev = connection;
+        server->connections = connection;
     }
-    
-    return result;
 }
 
-string
-generate_html_from_dom(Dom* dom) {
-    Memory_Arena html_buffer;
-    zero_struct(html_buffer);
+void
+preview_server_run(void* data) {
+    Preview_Server* server = (Preview_Server*) data;
     
-    Dom_Node* node = dom->seq.first;
-    push_generated_html_from_dom_node(&html_buffer, node, 0);
-    string result = convert_memory_arena_to_string(&html_buffer);
-    return result;
+    struct epoll_event events[64];
+    while (!atomic_load_u32(&server->stop)) {
+        int count = epoll_wait(server->epoll_fd, events, array_count(events), 100);
+        for (int i = 0; i < count; i++) {
+            Preview_Connection* connection = (Preview_Connection*) events[i].data.ptr;
+            if (!connection) {
+                preview_server_accept(server);
+            } else if (events[i].events & EPOLLERR) {
+                preview_connection_close(server, connection);
+            } else if (events[i].events & EPOLLOUT) {
+                preview_connection_flush(server, connection);
+            } else if (events[i].events & (EPOLLIN | EPOLLHUP)) {
+                preview_connection_read(server, connection);
+            }
+        }
+    }
 }
 
-string
-template_process_string(string source, int argc, string* args) {
-    assert(source.data);
+#endif
+
+// NOTE(Alexander): starts serving output_dir on http://127.0.0.1:port on a separate thread,
+// pass preview_server_page_callback and the server as the page callback of the site config.
+bool
+preview_server_start(Preview_Server* server, cstring output_dir, int port) {
+    zero_struct(*server);
+    mutex_init(&server->cache.mutex);
+    server->output_dir = output_dir;
+    server->port = port;
+    server->listen_fd = -1;
+    server->epoll_fd = -1;
     
-    Tokenizer tokenizer;
-    zero_struct(tokenizer);
+#if __linux__
+    server->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->listen_fd < 0) {
+        printf("Failed to create socket!\n");
+        return false;
+    }
     
-    Tokenizer* t = &tokenizer;
-    t->base = source.data;
-    t->curr = t->base;
-    t->end = t->curr + source.count;
+    int enable = 1;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
     
-    String_Builder string_builder;
-    zero_struct(string_builder);
-    String_Builder* sb = &string_builder;
-    string_builder_alloc(sb, source.count);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((u16) port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server->listen_fd, (struct sockaddr*) &address, sizeof(address)) != 0 ||
+        listen(server->listen_fd, 128) != 0) {
+        printf("Failed to listen on port %d!\n", port);
+        close(server->listen_fd);
+        return false;
+    }
     
-    Token token = next_token(t);
-    while (token.symbol) {
-        if (token.symbol == '$' && token.text.count == 1) {
-            int arg_index = peek_token(t).number;
-            if (arg_index >= 0 && arg_index < argc) {
-                string_builder_push_string(sb, args[arg_index]);
-                next_token(t);
-                token = next_token(t);
-            }
-        }
-        
-        string_builder_push_string(sb, token.text);
-        token = next_token(t);
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = 0;
+    if (server->epoll_fd < 0 || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &event) != 0 ||
+        !platform_create_thread(&server->thread, preview_server_run, server)) {
+        printf("Failed to start the preview server!\n");
+        close(server->listen_fd);
+        if (server->epoll_fd >= 0) close(server->epoll_fd);
+        return false;
     }
     
-    string result = string_builder_to_string(sb);
-    return result;
+    printf("Serving `%s` on http://127.0.0.1:%d\n", output_dir, port);
+    return true;
+#else
+    printf("The preview server is only supported on linux!\n");
+    return false;
+#endif
 }
 
+// NOTE(Alexander): stops the server thread, open connections are dropped
+void
+preview_server_stop(Preview_Server* server) {
+#if __linux__
+    atomic_add_u32(&server->stop, 1);
+    platform_join_thread(&server->thread);
+    while (server->connections) {
+        preview_connection_close(server, server->connections);
+    }
+    close(server->listen_fd);
+    close(server->epoll_fd);
+#endif
+    page_cache_free(&server->cache);
+    mutex_destroy(&server->cache.mutex);
+}
 
 #endif //GENERATOR_H